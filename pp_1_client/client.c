@@ -23,6 +23,8 @@
 #define MAIN_LOOP_SLEEP_MS 100
 
 static char client_fifo[CLIENT_FIFO_NAME_LEN];
+static int fifo_fd = -1; 			/* Our FIFO, opened once for all responses */
+static struct frame_reader reader; 	/* Frames read from fifo_fd */
 static volatile sig_atomic_t int_sys_flag = false;
 
 static void exit_handler (void);
@@ -31,9 +33,13 @@ void req_format_check_connection(struct request* req);
 void req_format_connect(struct request* req);
 void req_format_disconnect(struct request* req);
 void req_format_message(struct request* req);
+bool write_request(int fd, struct request* req);
+bool read_response(int fd, struct response* resp, bool wait);
+bool open_fifo(void);
 bool check_sys_response(struct response* resp);
 void get_text_EOF(FILE* fp, char* buffer);
 bool fifo_is_empty(int fd);
+bool fifo_wait(int fd);
 bool client_connect(struct request* req, struct response* resp);
 bool client_disconnect(struct request* req, struct response* resp);
 bool client_send(struct request* req, struct response* resp);
@@ -132,17 +138,66 @@ void req_format_message(struct request* req)
 	free(choice);
 }
 
+// Write a request to fd as one frame
+bool write_request(int fd, struct request* req)
+{
+	char frame[FRAME_MAX_LEN];
+	size_t frame_len = frame_pack_request(frame, req);
+
+	return write (fd, frame, frame_len) == (ssize_t)frame_len;
+}
+
+// Read the next response; without wait, only if it has already arrived
+bool read_response(int fd, struct response* resp, bool wait)
+{
+	while (!frame_next_response(&reader, resp))
+	{
+		if (!wait && fifo_is_empty(fd))
+		{
+			return false;
+		}
+
+		if (wait && !fifo_wait(fd))
+		{
+			return false;
+		}
+
+		if (frame_reader_fill(&reader, fd) <= 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Open our FIFO once, before asking to connect, and keep it: the server's
+ * non-blocking open of the write end fails unless we are already reading, and the
+ * stream of frames continues across responses. The read end is non-blocking, since
+ * nobody writes to it yet; fifo_wait() waits for the responses.
+ */
+bool open_fifo(void)
+{
+	if (fifo_fd == -1)
+	{
+		fifo_fd = open (client_fifo, O_RDONLY | O_NONBLOCK);
+	}
+	if (fifo_fd == -1){
+		printf ("Cannot open FIFO %s for reading \n", client_fifo);
+		return false;
+	}
+
+	return true;
+}
+
 bool check_sys_response(struct response* resp)
 {
-	int client_fd;
-	/* Open our FIFO and read the response from the server. */
-	client_fd = open (client_fifo, O_RDONLY);
-	if (client_fd == -1){
+	if (fifo_fd == -1){
 		printf ("Cannot open FIFO %s for reading \n", client_fifo);
 		return false;
 	}
 
-	if (read(client_fd, resp, sizeof (struct response)) != sizeof (struct response)){
+	if (!read_response(fifo_fd, resp, true)){
 		printf ("Cannot read response from server \n");
 		return false;
 	}
@@ -186,12 +241,27 @@ bool fifo_is_empty(int fd)
 	return true;
 }
 
+// Wait until the FIFO holds data or its writer has gone
+bool fifo_wait(int fd)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	return poll(&pfd, 1, -1) == 1;
+}
+
 bool client_connect(struct request* req, struct response* resp)
 {
     int server_fd;
 
     req_format_connect(req);
 
+    if (!open_fifo())
+    {
+    	return false;
+    }
+
     server_fd = open (SERVER_FIFO, O_WRONLY);
 	if (server_fd == -1){
 		printf ("Cannot open server FIFO %s\n", SERVER_FIFO);
@@ -199,7 +269,7 @@ bool client_connect(struct request* req, struct response* resp)
 	}
 
 	/* Send the message to the server */
-	if (write (server_fd, req, sizeof (struct request)) != sizeof (struct request)){
+	if (!write_request (server_fd, req)){
 		printf ("Cannot write to server");
 		return false;
 	}
@@ -226,7 +296,7 @@ bool client_disconnect(struct request* req, struct response* resp)
 	}
 
 	/* Send the message to the server */
-	if (write (server_fd, req, sizeof (struct request)) != sizeof (struct request)){
+	if (!write_request (server_fd, req)){
 		printf ("Cannot write to server");
 		return false;
 	}
@@ -252,7 +322,7 @@ bool client_send(struct request* req, struct response* resp)
 	}
 
 	/* Send the message to the server */
-	if (write (server_fd, req, sizeof (struct request)) != sizeof (struct request)){
+	if (!write_request (server_fd, req)){
 		printf ("Cannot write to server");
 		return false;
 	}
@@ -269,34 +339,20 @@ bool client_send(struct request* req, struct response* resp)
 // Read client FIFO
 bool client_read_messages(struct request* req, struct response* resp)
 {
-	int client_fd;
-	bool flag_msg_recieved = false;
-
-	client_fd = open (client_fifo, O_RDONLY | O_NONBLOCK);
-	if (client_fd == -1){
+	if (fifo_fd == -1){
 		printf ("Cannot open FIFO %s for reading \n", client_fifo);
 		return false;
 	}
 
 	// Read messages while the FIFO still contains data
-	while (!fifo_is_empty(client_fd))
+	while (read_response(fifo_fd, resp, false))
 	{
-		if (read(client_fd, resp, sizeof (struct response)) != sizeof (struct response)){
-//			printf ("Cannot read response from server \n");
-			flag_msg_recieved = false;
-		} else {
-			flag_msg_recieved = true;
-		}
-
-		if (flag_msg_recieved)
-		{
-			// Output message with sender and text
-			printf("%sMessage from PID%s %s%s%ld%s: \n%s\n",
-					T_ITAL_ON, T_RESET,
-					T_BOLD_ON, T_C_YEL,
-					(long)resp->origin_pid,
-					T_RESET, resp->message);
-		}
+		// Output message with sender and text
+		printf("%sMessage from PID%s %s%s%ld%s: \n%s\n",
+				T_ITAL_ON, T_RESET,
+				T_BOLD_ON, T_C_YEL,
+				(long)resp->origin_pid,
+				T_RESET, resp->message);
 	}
 
 	return true;
@@ -337,6 +393,8 @@ int main (int argc, char **argv)
         exit (EXIT_FAILURE);
     }
 
+    frame_reader_init(&reader);
+
     // Initiate request
     req->origin_pid = getpid();
     req->seq_len = SEQ_LENGTH;
@@ -5,6 +5,8 @@
  * Author: Naga Kandasamy
  * Date created: July 10, 2018
  *
+ * pp_1_server/chat.h and pp_1_client/chat.h are the same file; keep them in sync.
+ *
  */
 #ifndef _CHAT_H_
 #define _CHAT_H_
@@ -18,6 +20,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Well-known name for server FIFO */
 #define SERVER_FIFO "/tmp/wja35_chat_sv"
@@ -51,4 +54,159 @@ struct response {
     char message[MESSAGE_LENGTH];
 };
 
+/* Requests and responses travel through the FIFOs as frames: a frame_header and then
+ * the message text, without its terminating NUL. An "OK" ack takes 18 bytes instead
+ * of the 528 of a whole struct response. No frame is longer than FRAME_MAX_LEN, which
+ * is well under PIPE_BUF, so a frame written with one write() never interleaves with
+ * the frames of other clients writing to the same FIFO.
+ */
+#define FRAME_GLOBAL 0x1
+#define FRAME_SYSTEM 0x2
+#define FRAME_MAX_LEN (sizeof (struct frame_header) + MESSAGE_LENGTH - 1)
+#define FRAME_READER_LEN (64 * FRAME_MAX_LEN)
+
+struct frame_header {
+    uint16_t length;    /* Bytes of message text that follow */
+    uint8_t flags;      /* FRAME_GLOBAL, FRAME_SYSTEM */
+    uint8_t reserved;
+    int32_t seq;        /* seq_len of a request, seq_num of a response */
+    int32_t origin_pid;
+    int32_t dest_pid;
+};
+
+/* Reassembles frames from the byte stream of a FIFO. A read may end anywhere, even
+ * inside a header; buffer[start .. len) holds the bytes read but not yet taken.
+ */
+struct frame_reader {
+    char buffer[FRAME_READER_LEN];
+    size_t start;
+    size_t len;
+};
+
+static inline size_t frame_pack(char* frame, int seq, bool global, bool system,
+        pid_t origin_pid, pid_t dest_pid, const char* message)
+{
+    struct frame_header hdr;
+    const char* end = (const char*)memchr(message, '\0', MESSAGE_LENGTH - 1);
+    size_t length = end ? (size_t)(end - message) : MESSAGE_LENGTH - 1;
+
+    hdr.length = (uint16_t)length;
+    hdr.flags = (global ? FRAME_GLOBAL : 0) | (system ? FRAME_SYSTEM : 0);
+    hdr.reserved = 0;
+    hdr.seq = seq;
+    hdr.origin_pid = origin_pid;
+    hdr.dest_pid = dest_pid;
+
+    memcpy(frame, &hdr, sizeof (hdr));
+    memcpy(frame + sizeof (hdr), message, length);
+    return sizeof (hdr) + length;
+}
+
+/* Pack a request into frame (FRAME_MAX_LEN bytes); returns the frame's length */
+static inline size_t frame_pack_request(char* frame, const struct request* req)
+{
+    return frame_pack(frame, req->seq_len, req->global, req->system,
+            req->origin_pid, req->dest_pid, req->message);
+}
+
+static inline size_t frame_pack_response(char* frame, const struct response* resp)
+{
+    return frame_pack(frame, resp->seq_num, resp->global, resp->system,
+            resp->origin_pid, resp->dest_pid, resp->message);
+}
+
+static inline void frame_reader_init(struct frame_reader* reader)
+{
+    reader->start = 0;
+    reader->len = 0;
+}
+
+/* Read what fd holds into the reader. Returns what read() returned: 0 at end of
+ * file, -1 on error, or with EAGAIN if a non-blocking fd is empty.
+ */
+static inline ssize_t frame_reader_fill(struct frame_reader* reader, int fd)
+{
+    ssize_t num_read;
+
+    /* Keep the partial frame, if any, at the front */
+    reader->len -= reader->start;
+    memmove(reader->buffer, reader->buffer + reader->start, reader->len);
+    reader->start = 0;
+
+    num_read = read(fd, reader->buffer + reader->len, FRAME_READER_LEN - reader->len);
+    if (num_read > 0)
+    {
+        reader->len += num_read;
+    }
+    return num_read;
+}
+
+/* Take the next whole frame out of the reader, its text NUL-terminated into message
+ * (MESSAGE_LENGTH bytes). Returns false if no whole frame is buffered yet. A header
+ * with an impossible length means the stream lost its framing, and everything
+ * buffered is discarded.
+ */
+static inline bool frame_take(struct frame_reader* reader, struct frame_header* hdr, char* message)
+{
+    size_t avail = reader->len - reader->start;
+
+    if (avail < sizeof (*hdr))
+    {
+        return false;
+    }
+
+    memcpy(hdr, reader->buffer + reader->start, sizeof (*hdr));
+    if (hdr->length >= MESSAGE_LENGTH)
+    {
+        fprintf(stderr, "Bad frame length %u, %lu bytes discarded \n",
+                (unsigned)hdr->length, (unsigned long)avail);
+        frame_reader_init(reader);
+        return false;
+    }
+
+    if (avail < sizeof (*hdr) + hdr->length)
+    {
+        return false;
+    }
+
+    memcpy(message, reader->buffer + reader->start + sizeof (*hdr), hdr->length);
+    message[hdr->length] = '\0';
+    reader->start += sizeof (*hdr) + hdr->length;
+    return true;
+}
+
+static inline bool frame_next_request(struct frame_reader* reader, struct request* req)
+{
+    struct frame_header hdr;
+
+    if (!frame_take(reader, &hdr, req->message))
+    {
+        return false;
+    }
+
+    req->seq_len = hdr.seq;
+    req->global = (hdr.flags & FRAME_GLOBAL) != 0;
+    req->system = (hdr.flags & FRAME_SYSTEM) != 0;
+    req->origin_pid = hdr.origin_pid;
+    req->dest_pid = hdr.dest_pid;
+    return true;
+}
+
+static inline bool frame_next_response(struct frame_reader* reader, struct response* resp)
+{
+    struct frame_header hdr;
+
+    if (!frame_take(reader, &hdr, resp->message))
+    {
+        return false;
+    }
+
+    resp->seq_num = hdr.seq;
+    resp->global = (hdr.flags & FRAME_GLOBAL) != 0;
+    resp->system = (hdr.flags & FRAME_SYSTEM) != 0;
+    resp->origin_pid = hdr.origin_pid;
+    resp->dest_pid = hdr.dest_pid;
+    return true;
+}
+
 #endif  /* _CHAT_H_ */
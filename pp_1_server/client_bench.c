@@ -0,0 +1,198 @@
+/*
+ * 	Chat Room: cost of the client registry
+ *
+ *	Times connect (add), lookup, broadcast (a walk over every client) and
+ *	disconnect (remove) with BENCH_CLIENTS clients, for the hash table in
+ *	clients.c and for the linked list it replaced. The list only gets a sample of
+ *	the lookups and removals, which take linear time each.
+ *
+ *	usage: ./client_bench [num-clients]
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: William Anderson
+ */
+
+#include <time.h>
+
+#include "chat.h"
+#include "clients.h"
+#include "list.h"
+
+#define LIST_SAMPLE 1000
+#define BENCH_CLIENTS 100000
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_pidt(const void* lhs, const void* rhs)
+{
+	return (*(const pid_t*)lhs > *(const pid_t*)rhs) - (*(const pid_t*)lhs < *(const pid_t*)rhs);
+}
+
+static void report(const char* what, int n, double start, double stop)
+{
+	printf("  %-10s %8d ops %12.1f ns/op %10.3f ms total \n", what, n, (stop - start) / n,
+			(stop - start) / 1e6);
+}
+
+/* Distinct pids in random order */
+static pid_t* make_pids(int n)
+{
+	pid_t* pids = (pid_t*)malloc(n * sizeof(pid_t));
+	int i, j;
+	pid_t t;
+
+	if (pids == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		pids[i] = 300 + 3 * i;
+	}
+	for (i = n - 1; i > 0; i--)
+	{
+		j = rand() % (i + 1);
+		t = pids[i];
+		pids[i] = pids[j];
+		pids[j] = t;
+	}
+
+	return pids;
+}
+
+static void bench_table(pid_t* pids, int n)
+{
+	client_table* T = client_table_init(n);
+	double start;
+	long sum = 0;
+	int i, rounds = 100;
+
+	printf("Hash table: \n");
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+	{
+		client_table_add(T, pids[i], i);
+	}
+	report("connect", n, start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+	{
+		sum += client_table_find(T, pids[(i * 7919) % n])->fd;
+	}
+	report("lookup", n, start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+	{
+		sum += (client_table_find(T, pids[i] + 1) == NULL);
+	}
+	report("miss", n, start, now_ns());
+
+	start = now_ns();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (i = 0; i < T->count; i++)
+		{
+			sum += T->clients[i].fd;
+		}
+	}
+	report("broadcast", rounds, start, now_ns());
+
+	/* Remove half, check that the rest is still found, then remove the rest */
+	start = now_ns();
+	for (i = 0; i < n; i += 2)
+	{
+		client_table_remove(T, client_table_find(T, pids[i]));
+	}
+	for (i = 1; i < n; i += 2)
+	{
+		client_table_remove(T, client_table_find(T, pids[i]));
+	}
+	report("disconnect", n, start, now_ns());
+
+	if (T->count != 0)
+	{
+		fprintf(stderr, "Error: %d clients left in the table \n", T->count);
+		exit(EXIT_FAILURE);
+	}
+
+	client_table_free(T);
+	printf("  (checksum %ld) \n", sum);
+}
+
+static void bench_list(pid_t* pids, int n)
+{
+	list* L = list_init(NULL, sizeof(pid_t), free, compare_pidt);
+	int sample = (n < LIST_SAMPLE) ? n : LIST_SAMPLE;
+	double start;
+	long sum = 0;
+	node* p;
+	int i, rounds = 100;
+
+	printf("Linked list: \n");
+
+	start = now_ns();
+	for (i = 0; i < n; i++)
+	{
+		list_push_back(L, &pids[i]);
+	}
+	report("connect", n, start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < sample; i++)
+	{
+		sum += list_contains(L, &pids[(i * 7919) % n]);
+	}
+	report("lookup", sample, start, now_ns());
+
+	start = now_ns();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (p = list_front(L); p->next != NULL; p = p->next)
+		{
+			sum += *(pid_t*)(p->data);
+		}
+	}
+	report("broadcast", rounds, start, now_ns());
+
+	start = now_ns();
+	for (i = 0; i < sample; i++)
+	{
+		list_remove_pid(L, &pids[(i * 7919) % n]);
+	}
+	report("disconnect", sample, start, now_ns());
+
+	printf("  (checksum %ld) \n", sum);
+}
+
+int main(int argc, char** argv)
+{
+	int n = (argc > 1) ? atoi(argv[1]) : BENCH_CLIENTS;
+	pid_t* pids;
+
+	if (n < 1)
+	{
+		fprintf(stderr, "usage: %s [num-clients] \n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	srand(1);
+	pids = make_pids(n);
+
+	printf("Client registry with %d clients \n", n);
+	bench_table(pids, n);
+	bench_list(pids, n);
+
+	free(pids);
+	return 0;
+}
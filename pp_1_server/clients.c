@@ -0,0 +1,172 @@
+/*
+ * 	Client registry: open-addressing hash table over a dense array
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: William Anderson
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "clients.h"
+
+static unsigned int hash_pid(pid_t pid)
+{
+	unsigned int h = (unsigned int)pid;
+
+	/* Consecutive pids would otherwise fill consecutive slots */
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/* Slot holding pid, or -1 */
+static int find_slot(client_table* T, pid_t pid)
+{
+	unsigned int i = hash_pid(pid) & T->mask;
+
+	while (T->slots[i] != 0)
+	{
+		if (T->clients[T->slots[i] - 1].pid == pid)
+		{
+			return (int)i;
+		}
+		i = (i + 1) & T->mask;
+	}
+
+	return -1;
+}
+
+/* Both arrays are allocated up front, for max_clients records at a load of at most
+ * one half, so adding a client never moves the records.
+ */
+client_table* client_table_init(int max_clients)
+{
+	client_table* T = (client_table*)malloc(sizeof(client_table));
+	unsigned int num_slots = 2;
+
+	if (T == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	while (num_slots < 2 * (unsigned int)max_clients)
+	{
+		num_slots *= 2;
+	}
+
+	T->clients = (client*)malloc(max_clients * sizeof(client));
+	T->slots = (int*)calloc(num_slots, sizeof(int));
+
+	if (T->clients == NULL || T->slots == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	T->count = 0;
+	T->max_clients = max_clients;
+	T->mask = num_slots - 1;
+
+	return T;
+}
+
+client* client_table_find(client_table* T, pid_t pid)
+{
+	int i = find_slot(T, pid);
+
+	if (i == -1)
+	{
+		return NULL;
+	}
+
+	return &T->clients[T->slots[i] - 1];
+}
+
+/* Store a new client. Returns NULL if the table is full or pid is already in it. */
+client* client_table_add(client_table* T, pid_t pid, int fd)
+{
+	unsigned int i = hash_pid(pid) & T->mask;
+	client* c;
+
+	if (T->count == T->max_clients || find_slot(T, pid) != -1)
+	{
+		return NULL;
+	}
+
+	while (T->slots[i] != 0)
+	{
+		i = (i + 1) & T->mask;
+	}
+
+	c = &T->clients[T->count];
+	c->pid = pid;
+	c->fd = fd;
+	c->backlog = NULL;
+	c->backlog_len = 0;
+	c->closing = false;
+
+	T->slots[i] = ++T->count;
+
+	return c;
+}
+
+/* Forget a client found with client_table_find(). Its fd and backlog are the
+ * caller's to release first.
+ */
+void client_table_remove(client_table* T, client* c)
+{
+	int index = (int)(c - T->clients);
+	int last = T->count - 1;
+	unsigned int i, j, home;
+	int moved;
+
+	assert(index >= 0 && index < T->count);
+
+	/* Empty the slot, pulling back the later entries of its probe run that would no
+	 * longer be reachable across the hole
+	 */
+	i = (unsigned int)find_slot(T, c->pid);
+	j = i;
+	while (1)
+	{
+		j = (j + 1) & T->mask;
+		if (T->slots[j] == 0)
+		{
+			break;
+		}
+
+		home = hash_pid(T->clients[T->slots[j] - 1].pid) & T->mask;
+		/* Leave the entry if its home lies cyclically within (i, j] */
+		if ((i < j) ? (home > i && home <= j) : (home > i || home <= j))
+		{
+			continue;
+		}
+
+		T->slots[i] = T->slots[j];
+		i = j;
+	}
+	T->slots[i] = 0;
+
+	/* Fill the hole in the array with the last record */
+	if (index != last)
+	{
+		moved = find_slot(T, T->clients[last].pid);
+		T->clients[index] = T->clients[last];
+		T->slots[moved] = index + 1;
+	}
+
+	T->count--;
+}
+
+void client_table_free(client_table* T)
+{
+	free(T->clients);
+	free(T->slots);
+	free(T);
+}
@@ -0,0 +1,53 @@
+/*
+ * clients.h
+ *
+ *	Registry of connected chat clients: an open-addressing hash table keyed by
+ *	pid, pointing into a dense array of client records.
+ *
+ *	slots:   [ 0 ][ 3 ][ 0 ][ 1 ][ 2 ][ 0 ] ...   (index + 1, 0 = empty)
+ *	clients: [ pid 812 ][ pid 77 ][ pid 4051 ]     (count entries, no holes)
+ *
+ *	Lookups probe linearly from the pid's hash. Removal moves the last record into
+ *	the hole, so the array stays dense and a broadcast walks it front to back, and
+ *	shifts back the slots that follow in the probe run, so no tombstones build up.
+ *	A record pointer stays valid until the next client_table_remove().
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: William Anderson
+ */
+
+#ifndef CLIENTS_H_
+#define CLIENTS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* A connected client. The write end of its FIFO is opened once, when the client
+ * connects, and closed when it disconnects or goes away. Responses that do not fit
+ * in a full FIFO wait in backlog (allocated on first use). A client that disconnects
+ * with a backlog is kept, closing, until the backlog has been written.
+ */
+typedef struct client {
+	pid_t pid;
+	int fd;
+	char* backlog;
+	size_t backlog_len;
+	bool closing;
+} client;
+
+typedef struct client_table {
+	client* clients;		/* clients[0 .. count) */
+	int count;
+	int max_clients;
+	int* slots;			/* Index into clients + 1, or 0 if empty */
+	unsigned int mask;		/* Number of slots - 1; a power of two minus one */
+} client_table;
+
+client_table* client_table_init(int max_clients);
+client* client_table_find(client_table* T, pid_t pid);
+client* client_table_add(client_table* T, pid_t pid, int fd);
+void client_table_remove(client_table* T, client* c);
+void client_table_free(client_table* T);
+
+#endif /* CLIENTS_H_ */
@@ -8,59 +8,241 @@
  */
 
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 
 #include "chat.h"
-#include "list.h"
+#include "clients.h"
 #include "style.h"
 
-#define MAX_NUM_CLIENTS 100
+#define MAX_EVENTS 64
+#define CLIENT_BACKLOG_LEN (256 * FRAME_MAX_LEN)
+#define SERVER_MAX_CLIENTS 100000	/* The open file limit usually allows fewer */
+#define RESERVED_FDS 16			/* Standard streams, server FIFOs and epoll */
 
-int compare_pidt(const void* lhs, const void* rhs);
-void free_pidt(void* data);
-bool send_sys_response(struct response* resp, struct request* req);
-bool client_remove (list* client_pids_list, pid_t* client_pid);
+/* The server FIFO and the epoll set watching it and the client FIFOs. Request frames
+ * are read in bulk into reader and taken out one at a time.
+ */
+struct server {
+	int server_fd;
+	int epoll_fd;
+	struct frame_reader reader;
+};
+
+int raise_fd_limit(void);
+int client_open(pid_t pid);
+bool client_add(client_table* clients, int epoll_fd, pid_t pid, int client_fd);
+void client_watch(struct client* client, int epoll_fd);
+bool client_write(struct client* client, int epoll_fd, struct response* resp);
+bool response_write(int fd, struct response* resp);
+void client_flush(struct client* client, int epoll_fd);
+bool send_sys_response(client_table* clients, int epoll_fd, struct response* resp, struct request* req);
+bool client_remove (client_table* clients, pid_t* client_pid);
+void client_close(client_table* clients, struct client* client);
+struct client* client_connected(client_table* clients, pid_t pid);
+bool next_request(struct server* sv, client_table* clients, struct request* req);
 void resp_format_OK(struct response* resp, pid_t dest, int seq_num);
 void resp_format_FAIL(struct response* resp, pid_t dest, int seq_num);
 void resp_format_msg(struct response* resp, struct request* req, int seq_num);
 void req_reset(struct request* req);
 
-void free_pidt(void* data)
+/* Every connected client holds an fd, so lift the soft limit on open files as far
+ * as the hard limit allows. Returns the number of clients the limit leaves room for,
+ * at most SERVER_MAX_CLIENTS.
+ */
+int raise_fd_limit(void)
+{
+	struct rlimit limit;
+
+	if (getrlimit (RLIMIT_NOFILE, &limit) == -1)
+	{
+		perror ("getrlimit");
+		return MAX_NUM_CLIENTS;
+	}
+
+	limit.rlim_cur = limit.rlim_max;
+	if (setrlimit (RLIMIT_NOFILE, &limit) == -1)
+	{
+		perror ("setrlimit");
+		if (getrlimit (RLIMIT_NOFILE, &limit) == -1)
+		{
+			return MAX_NUM_CLIENTS;
+		}
+	}
+
+	if (limit.rlim_cur == RLIM_INFINITY
+			|| limit.rlim_cur >= SERVER_MAX_CLIENTS + RESERVED_FDS)
+	{
+		return SERVER_MAX_CLIENTS;
+	}
+
+	return (limit.rlim_cur > RESERVED_FDS) ? (int)limit.rlim_cur - RESERVED_FDS : 1;
+}
+
+/* Open the client's FIFO for writing. The client opens it for reading before it
+ * sends its connect request, so the open does not wait: it fails with ENXIO if
+ * nobody reads, as when the client died in between. The fd stays non-blocking, so
+ * that a client that stops reading cannot stall the server either.
+ */
+int client_open(pid_t pid)
+{
+	int client_fd;
+	char client_fifo[CLIENT_FIFO_NAME_LEN];
+
+	snprintf (client_fifo, CLIENT_FIFO_NAME_LEN, CLIENT_FIFO_TEMPLATE, (long)pid);
+
+    client_fd = open (client_fifo, O_WRONLY | O_NONBLOCK);
+    if (client_fd == -1){    /* Open failed on the client FIFO. Give up and move on. */
+        printf ("Error opening client fifo %s \n", client_fifo);
+        return -1;
+    }
+
+    return client_fd;
+}
+
+/* Store a client with its open FIFO. The FIFO is added to the epoll set with no
+ * events: a FIFO write end always reports EPOLLERR once it has no reader left, which
+ * is how a client that exits without disconnecting is noticed.
+ */
+bool client_add(client_table* clients, int epoll_fd, pid_t pid, int client_fd)
+{
+	struct epoll_event ev;
+
+	ev.events = 0;
+	ev.data.u64 = (uint64_t)pid;
+	if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1)
+	{
+		perror ("epoll_ctl");
+		return false;
+	}
+
+	if (client_table_add(clients, pid, client_fd) == NULL)
+	{
+		epoll_ctl (epoll_fd, EPOLL_CTL_DEL, client_fd, &ev);
+		return false;
+	}
+	return true;
+}
+
+/* Watch the client's FIFO for room (EPOLLOUT) only while its backlog holds data */
+void client_watch(struct client* client, int epoll_fd)
 {
-	free((pid_t*)data);
+	struct epoll_event ev;
+
+	ev.events = (client->backlog_len > 0) ? EPOLLOUT : 0;
+	ev.data.u64 = (uint64_t)client->pid;
+	if (epoll_ctl (epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) == -1)
+	{
+		perror ("epoll_ctl");
+	}
 }
 
-int compare_pidt(const void* lhs, const void* rhs)
+/* Write a response to the client, or queue it behind the ones already waiting.
+ * Returns false only if it had to be dropped.
+ */
+bool client_write(struct client* client, int epoll_fd, struct response* resp)
 {
-	const pid_t* llhs = (const pid_t*)lhs;
-	const pid_t* lrhs = (const pid_t*)rhs;
+	char frame[FRAME_MAX_LEN];
+	size_t frame_len = frame_pack_response(frame, resp);
+	ssize_t num_written = -1;
+
+	if (client->backlog_len == 0)
+	{
+		/* A write of at most PIPE_BUF bytes is all or nothing */
+		num_written = write (client->fd, frame, frame_len);
+		if (num_written == (ssize_t)frame_len)
+		{
+			return true;
+		} else if (errno != EAGAIN) {
+			fprintf (stderr, "Error writing to client FIFO of PID %ld \n", (long)client->pid);
+			return false;
+		}
+	}
+
+	if (client->backlog_len + frame_len > CLIENT_BACKLOG_LEN)
+	{
+		fprintf (stderr, "Client PID %ld is not reading, response dropped \n", (long)client->pid);
+		return false;
+	}
+
+	if (client->backlog == NULL)
+	{
+		client->backlog = (char*)malloc(CLIENT_BACKLOG_LEN);
+		if (client->backlog == NULL)
+		{
+			perror ("malloc");
+			exit (EXIT_FAILURE);
+		}
+	}
 
-	if (*llhs < *lrhs)
+	memcpy(client->backlog + client->backlog_len, frame, frame_len);
+	client->backlog_len += frame_len;
+	if (client->backlog_len == frame_len)
 	{
-		return -1;
-	} else if (*llhs > *lrhs) {
-		return 1;
+		client_watch(client, epoll_fd);
 	}
 
-	return 0;
+	return true;
 }
 
-bool send_sys_response(struct response* resp, struct request* req)
+/* Write a response to fd as one frame. Returns false unless all of it was written. */
+bool response_write(int fd, struct response* resp)
+{
+	char frame[FRAME_MAX_LEN];
+	size_t frame_len = frame_pack_response(frame, resp);
+
+	return write (fd, frame, frame_len) == (ssize_t)frame_len;
+}
+
+/* Write out as much of the backlog as the client's FIFO takes */
+void client_flush(struct client* client, int epoll_fd)
+{
+	ssize_t num_written;
+
+	num_written = write (client->fd, client->backlog, client->backlog_len);
+	if (num_written == -1)
+	{
+		if (errno != EAGAIN)
+		{
+			fprintf (stderr, "Error writing to client FIFO of PID %ld \n", (long)client->pid);
+		}
+		return;
+	}
+
+	client->backlog_len -= num_written;
+	memmove(client->backlog, client->backlog + num_written, client->backlog_len);
+	if (client->backlog_len == 0)
+	{
+		client_watch(client, epoll_fd);
+	}
+}
+
+/* Send a response to the origin of req: through its cached FIFO if it is connected,
+ * else through a one-off non-blocking open, which fails at once if nobody reads.
+ */
+bool send_sys_response(client_table* clients, int epoll_fd, struct response* resp, struct request* req)
 {
 	int client_fd;
 	char client_fifo[CLIENT_FIFO_NAME_LEN];
+	struct client* client = client_table_find(clients, req->origin_pid);
+
+	if (client != NULL)
+	{
+		return client_write(client, epoll_fd, resp);
+	}
 
 	snprintf (client_fifo, CLIENT_FIFO_NAME_LEN, CLIENT_FIFO_TEMPLATE, (long)req->origin_pid);
-    // printf ("Opening client FIFO %s \n", client_fifo);
 
-    client_fd = open (client_fifo, O_WRONLY);
+    client_fd = open (client_fifo, O_WRONLY | O_NONBLOCK);
     if (client_fd == -1){    /* Open failed on the client FIFO. Give up and move on. */
         printf ("Error opening client fifo %s \n", client_fifo);
         return false;
     }
 
-    if (write (client_fd, resp, sizeof (struct response)) != sizeof (struct response))
+    if (!response_write (client_fd, resp))
     {
     	fprintf (stderr, "Error writing to client FIFO %s \n", client_fifo);
+    	close (client_fd);
     	return false;
     }
 
@@ -73,46 +255,127 @@ bool send_sys_response(struct response* resp, struct request* req)
     return true;
 }
 
-bool send_msg(struct response* resp, struct request* req)
+bool send_msg(client_table* clients, int epoll_fd, struct response* resp, struct request* req)
 {
-	int client_fd;
-	char client_fifo[CLIENT_FIFO_NAME_LEN];
+	struct client* client = client_connected(clients, req->dest_pid);
 
-	snprintf (client_fifo, CLIENT_FIFO_NAME_LEN, CLIENT_FIFO_TEMPLATE, (long)req->dest_pid);
-    // printf ("Opening client FIFO %s \n", client_fifo);
+	if (client == NULL)
+	{
+		return false;
+	}
 
-    client_fd = open (client_fifo, O_WRONLY);
-    if (client_fd == -1){    /* Open failed on the client FIFO. Give up and move on. */
-        printf ("Error opening client fifo %s \n", client_fifo);
-        return false;
-    }
+	return client_write(client, epoll_fd, resp);
+}
+
+bool client_remove (client_table* clients, pid_t* client_pid)
+{
+	struct client* client = client_table_find(clients, *client_pid);
 
-    if (write (client_fd, resp, sizeof (struct response)) != sizeof (struct response))
+    if (client == NULL)
     {
-    	fprintf (stderr, "Error writing to client FIFO %s \n", client_fifo);
     	return false;
     }
 
-    if (close (client_fd) == -1)
+    /* Closing the fd also takes it out of the epoll set */
+    if (close (client->fd) == -1)
     {
-    	fprintf (stderr, "Error closing client FIFO %s \n", client_fifo);
-    	return false;
+    	fprintf (stderr, "Error closing client FIFO of PID %ld \n", (long)client->pid);
     }
 
+    free(client->backlog);
+    client_table_remove(clients, client);
     return true;
 }
 
-bool client_remove (list* client_pids_list, pid_t* client_pid)
+/* Remove a client that disconnected. Responses still in its backlog, the
+ * acknowledgement of the disconnect among them, are written out first: until then
+ * the client stays in the table as closing, and client_flush() empties it.
+ */
+void client_close(client_table* clients, struct client* client)
 {
-	   bool client_stored = list_contains(client_pids_list, client_pid);
+	pid_t pid = client->pid;
 
-    if (client_stored)
-    {
- 	   list_remove_pid(client_pids_list, client_pid);
- 	   return true;
-    }
+	if (client->backlog_len == 0)
+	{
+		client_remove(clients, &pid);
+	} else {
+		client->closing = true;
+	}
+}
+
+/* The client with this pid, unless it is not connected or is closing */
+struct client* client_connected(client_table* clients, pid_t pid)
+{
+	struct client* client = client_table_find(clients, pid);
+
+	return (client != NULL && !client->closing) ? client : NULL;
+}
+
+/* Take the next request into req. Returns false if no whole frame was buffered: it
+ * has then waited in epoll_wait, read what the server FIFO held and dropped the
+ * clients that went away, and the caller asks again.
+ */
+bool next_request(struct server* sv, client_table* clients, struct request* req)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int num_events, i;
+	ssize_t num_read;
+	pid_t event_pid;
+	struct client* client;
+
+	if (frame_next_request(&sv->reader, req))
+	{
+		return true;
+	}
+
+	num_events = epoll_wait(sv->epoll_fd, events, MAX_EVENTS, -1);
+	if (num_events == -1)
+	{
+		if (errno != EINTR)
+		{
+			perror ("epoll_wait");
+			exit (EXIT_FAILURE);
+		}
+		return false;
+	}
+
+	for (i = 0; i < num_events; i++)
+	{
+		if (events[i].data.u64 == 0)	/* The server FIFO */
+		{
+			/* Frames are written whole, but a read may still end inside one */
+			num_read = frame_reader_fill(&sv->reader, sv->server_fd);
+			if (num_read == -1 && errno != EAGAIN && errno != EINTR)
+			{
+				perror ("read");
+				exit (EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		event_pid = (pid_t)events[i].data.u64;
+		client = client_table_find(clients, event_pid);
+		if (client == NULL)
+		{
+			continue;
+		}
+
+		/* A client FIFO without a reader: the client exited without disconnecting */
+		if (events[i].events & (EPOLLERR | EPOLLHUP))
+		{
+			client_remove(clients, &event_pid);
+			printf("Client with PID %s%ld%s went away, removed \n",
+					T_C_YEL, (long)event_pid, T_RESET);
+		} else if (events[i].events & EPOLLOUT) {
+			client_flush(client, sv->epoll_fd);
+			if (client->closing && client->backlog_len == 0)
+			{
+				client_remove(clients, &event_pid);
+			}
+		}
+	}
 
-    return false;
+	return false;
 }
 
 void resp_format_OK(struct response* resp, pid_t dest, int seq_num)
@@ -156,36 +419,36 @@ int main (int argc, char **argv)
 {
     /* Create a well-known FIFO and open it for reading. The server
      * must be run before any of its clients so that the server FIFO exists by the
-     * time a client attempts to open it. The server's open() blocks until the first client
-     * opens the other end of the server FIFO for writing.
+     * time a client attempts to open it. The server then waits in epoll_wait() for
+     * requests, and for clients that go away without disconnecting.
      * */
 
 	int client_fd;
-	char client_fifo[CLIENT_FIFO_NAME_LEN];
 	struct request req;
 	struct response resp;
 	int seq_num = 0; /* This is the service that we provide as a server */
-	char buffer[512];
 	bool msg_success = false;
 	bool success = false;
+	struct server server;
+	struct epoll_event ev;
 
 
-	pid_t* client_pid;
-	list* client_pids_list;
-
-	client_pids_list = (list*)malloc(sizeof(list));
-	/* Initialize list with associated functions for freeing and comparison */
-	client_pids_list = list_init(client_pids_list, sizeof(pid_t), free_pidt, compare_pidt);
+	struct client* client;
+	client_table* clients;
+	int i;
 
 	printf(T_BG_C_BLU T_C_YEL "\n\t ========== Chat Room 0.1: Server ========== \n\n" T_RESET);
 
+	clients = client_table_init(raise_fd_limit());
+	printf("Room for %d clients \n", clients->max_clients);
+
     umask (0);
     if (mkfifo (SERVER_FIFO, S_IRUSR | S_IWUSR | S_IWGRP) == -1 \
             && errno != EEXIST){
         perror ("mkfifo");
         exit (EXIT_FAILURE);
     }
-   int server_fd = open (SERVER_FIFO, O_RDONLY);
+   int server_fd = open (SERVER_FIFO, O_RDONLY | O_NONBLOCK);
    if (server_fd == -1){
        perror ("open");
        exit (EXIT_FAILURE);
@@ -202,10 +465,24 @@ int main (int argc, char **argv)
        exit (EXIT_FAILURE);
    }
 
+   server.server_fd = server_fd;
+   frame_reader_init(&server.reader);
+   server.epoll_fd = epoll_create1 (0);
+   if (server.epoll_fd == -1){
+       perror ("epoll_create1");
+       exit (EXIT_FAILURE);
+   }
+
+   ev.events = EPOLLIN;
+   ev.data.u64 = 0;	/* Client FIFOs are tagged with their pid, which is never 0 */
+   if (epoll_ctl (server.epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) == -1){
+       perror ("epoll_ctl");
+       exit (EXIT_FAILURE);
+   }
+
 
    while (1){
-       if (read (server_fd, &req, sizeof (struct request)) != sizeof (struct request)){
-           fprintf (stderr, "Error reading request; discarding \n");
+       if (!next_request (&server, clients, &req)){
            continue;
        }
 
@@ -215,20 +492,25 @@ int main (int argc, char **argv)
     	   if (strcmp(req.message, "new_client") == 0)
     	   {
     	       success = false;
-    		   bool client_stored = list_contains(client_pids_list, &req.origin_pid);
+    		   bool client_stored = (client_table_find(clients, req.origin_pid) != NULL);
 
-    	       if (!client_stored && client_pids_list->logical_length < MAX_NUM_CLIENTS)
+    		   /* Fails at once if the client is not reading its FIFO */
+    		   client_fd = client_stored ? -1 : client_open(req.origin_pid);
+
+    	       if (client_fd != -1 && clients->count < clients->max_clients)
     	       {
-    	    	   list_push_back(client_pids_list, &req.origin_pid);
-    	    	   printf("Client connected with PID %s%ld%s \n",
-    	    			   T_C_YEL, (long)req.origin_pid, T_RESET);
-    	    	   success = true;
-    	       } else if (!client_stored && client_pids_list->logical_length >= MAX_NUM_CLIENTS) {
+    	    	   success = client_add(clients, server.epoll_fd, req.origin_pid, client_fd);
+    	    	   if (success)
+    	    	   {
+    	    		   printf("Client connected with PID %s%ld%s \n",
+    	    				   T_C_YEL, (long)req.origin_pid, T_RESET);
+    	    	   }
+    	       } else if (client_fd != -1) {
     	    	   fprintf(stderr, "Warning: client list full, not saving client! \n");
     	    	   success = false;
     	       }
 
-               /* Send the response to the client and close FIFO */
+               /* Send the response to the client; the FIFO stays open if it was stored */
                if (success)
                {
             	   resp_format_OK(&resp, req.origin_pid, seq_num);
@@ -236,7 +518,16 @@ int main (int argc, char **argv)
             	   resp_format_FAIL(&resp, req.origin_pid, seq_num);
                }
 
-               send_sys_response(&resp, &req);
+               if (success || client_stored)
+               {
+            	   send_sys_response(clients, server.epoll_fd, &resp, &req);
+               } else if (client_fd != -1) {
+            	   if (!response_write (client_fd, &resp))
+            	   {
+            		   fprintf (stderr, "Error writing to client FIFO of PID %ld \n", (long)req.origin_pid);
+            	   }
+            	   close(client_fd);
+               }
 
                /* Update the sequence number */
                seq_num += req.seq_len;
@@ -245,16 +536,11 @@ int main (int argc, char **argv)
 
                /* Disconnect client */
     	   } else if (strcmp(req.message, "disconnect_client") == 0) {
-    		   success = false;
-
-    		   if (client_remove(client_pids_list, &req.origin_pid))
-    		   {
-    			   success = true;
-    		   } else {
-    			   success = false;
-    		   }
+    		   client = client_connected(clients, req.origin_pid);
+    		   success = (client != NULL);
 
-               /* Send the response to the client and close FIFO */
+               /* Send the response to the client, then close its FIFO once it has
+                * been written */
 
                if (success)
                {
@@ -267,7 +553,11 @@ int main (int argc, char **argv)
             			   T_C_YEL, (long)req.origin_pid, T_RESET);
                }
 
-               send_sys_response(&resp, &req);
+               send_sys_response(clients, server.epoll_fd, &resp, &req);
+               if (success)
+               {
+            	   client_close(clients, client);
+               }
 
                /* Update the sequence number */
                seq_num += req.seq_len;
@@ -278,7 +568,7 @@ int main (int argc, char **argv)
     		   /* Send response to sender confirming connection is active */
 
     		   resp_format_OK(&resp, req.origin_pid, seq_num);
-               send_sys_response(&resp, &req);
+               send_sys_response(clients, server.epoll_fd, &resp, &req);
 
                /* Update the sequence number */
                seq_num += req.seq_len;
@@ -291,7 +581,7 @@ int main (int argc, char **argv)
     		   /* Send response to sender confirming message received */
 
     		   resp_format_OK(&resp, req.origin_pid, seq_num);
-               send_sys_response(&resp, &req);
+               send_sys_response(clients, server.epoll_fd, &resp, &req);
 
                /* Update the sequence number */
                seq_num += req.seq_len;
@@ -305,58 +595,34 @@ int main (int argc, char **argv)
 
        if (req.global == true)
        {
-    	   node* p = list_front(client_pids_list);
     	   msg_success = true;
 
-    	   while(p->next != NULL)
+    	   /* The records are contiguous; nobody is removed while the loop runs */
+    	   for (i = 0; i < clients->count; i++)
     	   {
-    		   client_pid = (pid_t*)(p->data);
+    		   client = &clients->clients[i];
 
-    		   if (compare_pidt(client_pid, &req.origin_pid) == 0) // Don't send back to sender
+    		   if (client->pid == req.origin_pid || client->closing) // Not to the sender or a leaving client
     		   {
-    			   p = p->next;
     			   continue;
     		   }
 
     		   printf("Sending global message to client PID: %s%ld%s \n",
-    				   T_C_YEL, (long)(*client_pid), T_RESET);
-
-    	       snprintf (client_fifo, CLIENT_FIFO_NAME_LEN, CLIENT_FIFO_TEMPLATE, (long)(*client_pid));
-    	       // printf ("Opening client FIFO %s \n", client_fifo);
+    				   T_C_YEL, (long)client->pid, T_RESET);
 
-    	       client_fd = open (client_fifo, O_WRONLY);
-    	       if (client_fd == -1)
-    	       {    /* Open failed on the client FIFO. Give up and move on. */
-    	           fprintf (stderr, "Error opening client fifo %s, removing unreachable client...\n", client_fifo);
-    	           client_remove(client_pids_list, client_pid); // Remove this client since it was unreachable
-    	           msg_success = false;
-    	           p = p->next;
-
-    	           continue;
-    	       }
-
-    	       /* Send the message to the destination PID and close FIFO */
+    	       /* Send the message through the destination's open FIFO */
 
     	       resp_format_msg(&resp, &req, seq_num);
 
-    	       if (write (client_fd, &resp, sizeof (struct response)) != sizeof (struct response))
+    	       /* A client that went away fails here with EPIPE; it is removed once
+    	        * epoll_wait() reports its FIFO */
+    	       if (!client_write (client, server.epoll_fd, &resp))
     	       {
-    	    	   fprintf (stderr, "Error writing to client FIFO %s \n", client_fifo);
     	    	   msg_success = false;
     	       }
 
-    	       // printf ("Closing client FIFO %s \n", client_fifo);
-
-    	       if (close (client_fd) == -1)
-    	       {
-    	           fprintf (stderr, "Error closing client FIFO %s \n", client_fifo);
-    	           msg_success = false;
-    	       }
-
     	       /* Update the sequence number */
     	       seq_num += req.seq_len;
-
-    		   p = p->next;
     	   }
 
     	   /* Send response to sender confirming message sent */
@@ -375,7 +641,7 @@ int main (int argc, char **argv)
 //	    	   strcpy(resp.message, "FAIL");
 	       }
 
-           send_sys_response(&resp, &req);
+           send_sys_response(clients, server.epoll_fd, &resp, &req);
 
            /* Update the sequence number */
            seq_num += req.seq_len;
@@ -383,13 +649,13 @@ int main (int argc, char **argv)
            continue;
 
        /* If destination is in list of clients */
-       } else if (list_contains(client_pids_list, &req.dest_pid)) {
+       } else if (client_connected(clients, req.dest_pid) != NULL) {
     	   msg_success = true;
 
            /* Send the message to the destination PID and close FIFO */
            resp_format_msg(&resp, &req, seq_num);
 
-           msg_success = send_msg(&resp, &req);
+           msg_success = send_msg(clients, server.epoll_fd, &resp, &req);
 
            /* Update the sequence number */
            seq_num += req.seq_len;
@@ -409,7 +675,7 @@ int main (int argc, char **argv)
 	    	   resp_format_FAIL(&resp, req.origin_pid, seq_num);
 	       }
 
-           send_sys_response(&resp, &req);
+           send_sys_response(clients, server.epoll_fd, &resp, &req);
 
            /* Update the sequence number */
            seq_num += req.seq_len;
@@ -419,7 +685,7 @@ int main (int argc, char **argv)
     	   fprintf (stderr, "dest_pid not in client PID list \n");
 
     	   resp_format_OK(&resp, req.origin_pid, seq_num);
-           send_sys_response(&resp, &req);
+           send_sys_response(clients, server.epoll_fd, &resp, &req);
 
            /* Update the sequence number */
            seq_num += req.seq_len;
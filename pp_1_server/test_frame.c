@@ -0,0 +1,183 @@
+/*
+ * 	Chat Room: frame reassembly test
+ *
+ *	Packs random requests into frames, pushes the byte stream through a pipe in
+ *	chunks of random size (down to a single byte, so that headers are split too) and
+ *	checks that frame_next_request() gives back every request unchanged. A header
+ *	with an impossible length must make the reader discard what it holds, and the
+ *	frames written after it must still come through.
+ *
+ *	usage: ./test_frame [num-frames]
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: William Anderson
+ */
+
+#include "chat.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, int frame)
+{
+	if (!ok)
+	{
+		printf("FAIL %s (frame %d) \n", what, frame);
+		failures++;
+	}
+}
+
+static void random_request(struct request* req)
+{
+	int length = rand() % (MESSAGE_LENGTH + 40);
+	int i;
+
+	req->seq_len = rand();
+	req->global = rand() % 2;
+	req->system = rand() % 2;
+	req->origin_pid = rand();
+	req->dest_pid = rand();
+
+	/* Longer messages are cut to MESSAGE_LENGTH - 1 bytes by frame_pack() */
+	for (i = 0; i < length && i < MESSAGE_LENGTH; i++)
+	{
+		req->message[i] = 'a' + rand() % 26;
+	}
+	if (length < MESSAGE_LENGTH)
+	{
+		req->message[length] = '\0';
+	}
+}
+
+static bool same_request(const struct request* sent, const struct request* got)
+{
+	const char* end = (const char*)memchr(sent->message, '\0', MESSAGE_LENGTH - 1);
+	size_t length = end ? (size_t)(end - sent->message) : MESSAGE_LENGTH - 1;
+
+	return sent->seq_len == got->seq_len && sent->global == got->global
+			&& sent->system == got->system && sent->origin_pid == got->origin_pid
+			&& sent->dest_pid == got->dest_pid && strlen(got->message) == length
+			&& memcmp(sent->message, got->message, length) == 0;
+}
+
+/* Split frames: the whole stream arrives in chunks of 1 .. 2 * FRAME_MAX_LEN bytes */
+static void test_split(int fds[2], int n)
+{
+	struct request* sent = (struct request*)malloc(n * sizeof(struct request));
+	char* stream = (char*)malloc(n * FRAME_MAX_LEN);
+	struct frame_reader reader;
+	struct request got;
+	size_t stream_len = 0, offset = 0, chunk;
+	int i, taken = 0;
+
+	if (sent == NULL || stream == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		random_request(&sent[i]);
+		stream_len += frame_pack_request(stream + stream_len, &sent[i]);
+	}
+
+	frame_reader_init(&reader);
+	while (offset < stream_len)
+	{
+		chunk = (rand() % 4 == 0) ? 1 + rand() % 20 : 1 + rand() % (2 * FRAME_MAX_LEN);
+		if (chunk > stream_len - offset)
+		{
+			chunk = stream_len - offset;
+		}
+		if (write(fds[1], stream + offset, chunk) != (ssize_t)chunk
+				|| frame_reader_fill(&reader, fds[0]) != (ssize_t)chunk)
+		{
+			perror("pipe");
+			exit(EXIT_FAILURE);
+		}
+		offset += chunk;
+
+		while (taken < n && frame_next_request(&reader, &got))
+		{
+			check(same_request(&sent[taken], &got), "split frame differs", taken);
+			taken++;
+		}
+	}
+
+	check(taken == n, "frames missing", taken);
+	check(reader.start == reader.len, "bytes left over", taken);
+	printf("split: %d frames in %lu bytes \n", taken, (unsigned long)stream_len);
+
+	free(sent);
+	free(stream);
+}
+
+/* Corrupted header: a frame, then a header claiming MESSAGE_LENGTH bytes of text */
+static void test_corrupt(int fds[2])
+{
+	struct frame_reader reader;
+	struct frame_header bad;
+	struct request sent, got;
+	char stream[2 * FRAME_MAX_LEN];
+	size_t stream_len;
+
+	random_request(&sent);
+	stream_len = frame_pack_request(stream, &sent);
+	memset(&bad, 0, sizeof (bad));
+	bad.length = MESSAGE_LENGTH;
+	memcpy(stream + stream_len, &bad, sizeof (bad));
+	stream_len += sizeof (bad);
+	memset(stream + stream_len, 'x', 10);
+	stream_len += 10;
+
+	frame_reader_init(&reader);
+	if (write(fds[1], stream, stream_len) != (ssize_t)stream_len
+			|| frame_reader_fill(&reader, fds[0]) != (ssize_t)stream_len)
+	{
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	check(frame_next_request(&reader, &got) && same_request(&sent, &got),
+			"frame before the bad header", 0);
+	check(!frame_next_request(&reader, &got), "bad header taken", 1);
+	check(reader.len == 0, "bad header not discarded", 1);
+
+	/* The stream continues with the frames that follow */
+	random_request(&sent);
+	stream_len = frame_pack_request(stream, &sent);
+	if (write(fds[1], stream, stream_len) != (ssize_t)stream_len
+			|| frame_reader_fill(&reader, fds[0]) != (ssize_t)stream_len)
+	{
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	check(frame_next_request(&reader, &got) && same_request(&sent, &got),
+			"frame after the bad header", 2);
+	printf("corrupt: bad header discarded \n");
+}
+
+int main(int argc, char** argv)
+{
+	int n = (argc > 1) ? atoi(argv[1]) : 20000;
+	int fds[2];
+
+	if (n < 1)
+	{
+		fprintf(stderr, "usage: %s [num-frames] \n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (pipe(fds) == -1)
+	{
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	srand(1);
+	test_split(fds, n);
+	test_corrupt(fds);
+
+	printf("%d failed \n", failures);
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,202 @@
+/* Cold-scan mode for mini_grep: O_DIRECT or fadvise-based reads that do not evict
+ * the page cache of other processes, with mincore() residency accounting.
+ *
+ * Author: William Anderson
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cold.h"
+
+typedef struct cold_stats_tag
+{
+	uint64_t files;
+	uint64_t pages;
+	uint64_t resident_before;
+	uint64_t resident_after;
+	uint64_t direct_fallbacks;
+} cold_stats_t;
+
+static cold_stats_t COLD_STATS;
+static pthread_mutex_t mutex_cold_stats = PTHREAD_MUTEX_INITIALIZER;
+
+/* Take a mincore() snapshot of the file. Returns the number of resident pages and,
+ * if vector is not NULL, stores the allocated per-page vector there. */
+static size_t
+sample_residency (int fd, size_t pages, unsigned char **vector)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned char *vec;
+	void *map;
+	size_t resident = 0, i;
+
+	if (vector != NULL)
+		*vector = NULL;
+	if (pages == 0)
+		return 0;
+
+	/* Mapping does not fault any pages in; mincore() only inspects the cache */
+	map = mmap(NULL, pages * page_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return 0;
+
+	vec = (unsigned char *)malloc(pages);
+	if (vec != NULL && mincore(map, pages * page_size, vec) == 0)
+	{
+		for (i = 0; i < pages; i++)
+			resident += vec[i] & 1;
+	} else
+	{
+		free(vec);
+		vec = NULL;
+	}
+	munmap(map, pages * page_size);
+
+	if (vector != NULL)
+		*vector = vec;
+	else
+		free(vec);
+
+	return resident;
+}
+
+int /* Open path for a scan in the given mode. Returns the descriptor, or -1. */
+cold_open (const char *path, cold_mode_t mode, cold_file_t *file)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct stat file_stats;
+
+	memset(file, 0, sizeof(cold_file_t));
+	file->mode = mode;
+
+	if (mode == COLD_DIRECT)
+	{
+		file->fd = open(path, O_RDONLY | O_DIRECT);
+		if (file->fd == -1 && errno == EINVAL)
+		{
+			/* The file system does not support O_DIRECT */
+			file->mode = COLD_FADVISE;
+			pthread_mutex_lock(&mutex_cold_stats);
+			COLD_STATS.direct_fallbacks++;
+			pthread_mutex_unlock(&mutex_cold_stats);
+		}
+	}
+
+	if (file->mode != COLD_DIRECT)
+		file->fd = open(path, O_RDONLY);
+
+	if (file->fd == -1 || mode == COLD_OFF)
+		return file->fd;
+
+	if (fstat(file->fd, &file_stats) == 0)
+	{
+		file->pages = (file_stats.st_size + page_size - 1) / page_size;
+		file->resident_before = sample_residency(file->fd, file->pages,
+				&file->resident);
+	}
+
+	if (file->mode == COLD_FADVISE)
+	{
+		/* Ask for aggressive readahead; the file is read front to back once */
+		posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+
+	return file->fd;
+}
+
+void /* Close the file, dropping the pages this scan brought into the cache. */
+cold_close (cold_file_t *file)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t resident_after, start, i;
+
+	if (file->fd == -1)
+		return;
+
+	if (file->mode == COLD_OFF)
+	{
+		close(file->fd);
+		return;
+	}
+
+	if (file->mode == COLD_FADVISE)
+	{
+		if (file->resident == NULL)
+		{
+			if (file->resident_before == 0)
+				posix_fadvise(file->fd, 0, 0, POSIX_FADV_DONTNEED);
+		} else
+		{
+			/* Only drop runs of pages that were not cached before, so pages other
+			 * processes were using stay resident */
+			i = 0;
+			while (i < file->pages)
+			{
+				if (file->resident[i] & 1)
+				{
+					i++;
+					continue;
+				}
+				start = i;
+				while (i < file->pages && !(file->resident[i] & 1))
+					i++;
+				posix_fadvise(file->fd, (off_t)start * page_size,
+						(off_t)(i - start) * page_size, POSIX_FADV_DONTNEED);
+			}
+		}
+	}
+
+	resident_after = sample_residency(file->fd, file->pages, NULL);
+
+	pthread_mutex_lock(&mutex_cold_stats);
+	COLD_STATS.files++;
+	COLD_STATS.pages += file->pages;
+	COLD_STATS.resident_before += file->resident_before;
+	COLD_STATS.resident_after += resident_after;
+	pthread_mutex_unlock(&mutex_cold_stats);
+
+	free(file->resident);
+	file->resident = NULL;
+	close(file->fd);
+	file->fd = -1;
+}
+
+void
+cold_reset_stats (void)
+{
+	pthread_mutex_lock(&mutex_cold_stats);
+	memset(&COLD_STATS, 0, sizeof(COLD_STATS));
+	pthread_mutex_unlock(&mutex_cold_stats);
+}
+
+void
+cold_print_stats (void)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	int64_t change;
+
+	pthread_mutex_lock(&mutex_cold_stats);
+	change = (int64_t)COLD_STATS.resident_after - (int64_t)COLD_STATS.resident_before;
+	printf("\n Page cache: %llu files, %llu pages; %llu resident before reading, %llu after (%+lld pages, %+.1f MiB).",
+			(unsigned long long)COLD_STATS.files,
+			(unsigned long long)COLD_STATS.pages,
+			(unsigned long long)COLD_STATS.resident_before,
+			(unsigned long long)COLD_STATS.resident_after, (long long)change,
+			(double)change * page_size / (1024.0 * 1024.0));
+	if (COLD_STATS.direct_fallbacks > 0)
+	{
+		printf("\n Page cache: O_DIRECT not supported for %llu files, used fadvise instead.",
+				(unsigned long long)COLD_STATS.direct_fallbacks);
+	}
+	pthread_mutex_unlock(&mutex_cold_stats);
+}
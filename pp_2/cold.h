@@ -0,0 +1,43 @@
+#ifndef _COLD_H
+#define _COLD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Cold-scan support: read files without leaving them in the page cache.
+ *
+ *   COLD_OFF      plain open() and read()
+ *   COLD_FADVISE  POSIX_FADV_SEQUENTIAL on open; on close, POSIX_FADV_DONTNEED for the
+ *                 pages that were not resident before the file was read
+ *   COLD_DIRECT   O_DIRECT reads, which bypass the page cache. Reads must be made into
+ *                 COLD_ALIGN aligned buffers in multiples of COLD_ALIGN. Falls back to
+ *                 COLD_FADVISE on file systems that do not support O_DIRECT.
+ *
+ * In the cold modes every file's page cache residency is sampled with mincore() before
+ * it is read and after it is closed; cold_print_stats() reports the totals.
+ */
+
+#define COLD_ALIGN 4096
+
+typedef enum cold_mode_tag{
+	COLD_OFF,
+	COLD_FADVISE,
+	COLD_DIRECT
+} cold_mode_t;
+
+/* An open file and its residency before reading. */
+typedef struct cold_file_tag{
+	int fd;
+	cold_mode_t mode;			/* Mode actually used for this file */
+	size_t pages;
+	unsigned char *resident;	/* mincore() vector taken at open, NULL if not sampled */
+	size_t resident_before;
+} cold_file_t;
+
+/* Function definitions. */
+int cold_open (const char *, cold_mode_t, cold_file_t *);
+void cold_close (cold_file_t *);
+void cold_reset_stats (void);
+void cold_print_stats (void);
+
+#endif
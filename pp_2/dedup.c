@@ -0,0 +1,399 @@
+/* Content-hash deduplication cache for mini_grep.
+ *
+ * Both tables use open addressing with linear probing and grow at a load factor of
+ * 1/2. Each is protected by its own mutex; lookups hold the lock only for the probe,
+ * never while a file is being read or hashed.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "dedup.h"
+#include "hash.h"
+
+#define DEDUP_MAGIC "MGDEDUP1"
+#define DEDUP_CHUNK (64 * 1024)
+#define DEDUP_ALIGN 4096
+#define DEDUP_INITIAL_SIZE 1024
+
+/* Persisted record: file identity -> content hash */
+typedef struct file_entry_tag
+{
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t hash;
+} file_entry_t;
+
+typedef struct content_entry_tag
+{
+	uint64_t hash;
+	uint64_t size;
+	long long count;
+	bool used;
+} content_entry_t;
+
+struct dedup_tag
+{
+	/* (dev, inode, size, mtime) -> hash; an entry with size == UINT64_MAX is empty */
+	file_entry_t *files;
+	size_t files_mask;
+	size_t num_files;
+	pthread_mutex_t files_mutex;
+
+	/* (hash, size) -> count */
+	content_entry_t *contents;
+	size_t contents_mask;
+	size_t num_contents;
+	pthread_mutex_t contents_mutex;
+
+	char *cache_file;
+	bool dirty;
+
+	/* Statistics, updated under the corresponding table mutex */
+	int files_hashed;
+	int hashes_cached;
+	int duplicates;
+};
+
+static void *
+dedup_calloc (size_t count, size_t size)
+{
+	void *p = calloc(count, size);
+	if (p == NULL)
+	{
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+static inline size_t
+mix (uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return (size_t)x;
+}
+
+static file_entry_t *
+create_file_table (size_t size)
+{
+	file_entry_t *table = (file_entry_t *)dedup_calloc(size, sizeof(file_entry_t));
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		table[i].size = UINT64_MAX;
+	return table;
+}
+
+static inline bool
+same_file (const file_entry_t *a, const file_entry_t *b)
+{
+	return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+			&& a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+/* Find the slot holding "entry" or the empty slot where it belongs. Caller holds files_mutex. */
+static file_entry_t *
+file_slot (file_entry_t *table, size_t mask, const file_entry_t *entry)
+{
+	size_t index = mix(entry->ino ^ (entry->dev << 32) ^ (uint64_t)entry->mtime_sec) & mask;
+
+	while (table[index].size != UINT64_MAX && !same_file(&table[index], entry))
+		index = (index + 1) & mask;
+	return &table[index];
+}
+
+static void
+file_insert (dedup_t *dedup, const file_entry_t *entry)
+{
+	file_entry_t *slot, *old;
+	size_t old_size, i;
+
+	if (2 * (dedup->num_files + 1) > dedup->files_mask + 1)
+	{
+		old = dedup->files;
+		old_size = dedup->files_mask + 1;
+		dedup->files_mask = 2 * old_size - 1;
+		dedup->files = create_file_table(2 * old_size);
+		for (i = 0; i < old_size; i++)
+		{
+			if (old[i].size != UINT64_MAX)
+				*file_slot(dedup->files, dedup->files_mask, &old[i]) = old[i];
+		}
+		free(old);
+	}
+
+	slot = file_slot(dedup->files, dedup->files_mask, entry);
+	if (slot->size == UINT64_MAX)
+		dedup->num_files++;
+	*slot = *entry;
+	dedup->dirty = true;
+}
+
+/* Caller holds contents_mutex. */
+static content_entry_t *
+content_slot (content_entry_t *table, size_t mask, const dedup_key_t *key)
+{
+	size_t index = mix(key->hash ^ key->size) & mask;
+
+	while (table[index].used
+			&& (table[index].hash != key->hash || table[index].size != key->size))
+		index = (index + 1) & mask;
+	return &table[index];
+}
+
+static void
+load_cache (dedup_t *dedup)
+{
+	FILE *file = fopen(dedup->cache_file, "rb");
+	char magic[sizeof(DEDUP_MAGIC) - 1];
+	file_entry_t entry;
+
+	if (file == NULL)
+		return; 	/* First run, nothing cached yet */
+
+	if (fread(magic, sizeof(magic), 1, file) != 1
+			|| memcmp(magic, DEDUP_MAGIC, sizeof(magic)) != 0)
+	{
+		printf("Ignoring unrecognised dedup cache %s \n", dedup->cache_file);
+		fclose(file);
+		return;
+	}
+
+	while (fread(&entry, sizeof(entry), 1, file) == 1)
+		file_insert(dedup, &entry);
+
+	fclose(file);
+	dedup->dirty = false;
+}
+
+dedup_t * /* Create the dedup tables, loading persisted file hashes from cache_file (may be NULL). */
+create_dedup (const char *cache_file)
+{
+	dedup_t *dedup = (dedup_t *)dedup_calloc(1, sizeof(dedup_t));
+
+	dedup->files = create_file_table(DEDUP_INITIAL_SIZE);
+	dedup->files_mask = DEDUP_INITIAL_SIZE - 1;
+	dedup->contents = (content_entry_t *)dedup_calloc(DEDUP_INITIAL_SIZE,
+			sizeof(content_entry_t));
+	dedup->contents_mask = DEDUP_INITIAL_SIZE - 1;
+	pthread_mutex_init(&dedup->files_mutex, NULL);
+	pthread_mutex_init(&dedup->contents_mutex, NULL);
+
+	if (cache_file != NULL)
+	{
+		dedup->cache_file = strdup(cache_file);
+		load_cache(dedup);
+	}
+
+	return dedup;
+}
+
+static bool /* Hash the whole file without disturbing its file offset. */
+hash_fd (int fd, uint64_t *hash)
+{
+	/* Aligned, so that descriptors opened with O_DIRECT can be read too */
+	unsigned char storage[DEDUP_CHUNK + DEDUP_ALIGN];
+	unsigned char *buffer = (unsigned char *)(((uintptr_t)storage + DEDUP_ALIGN - 1)
+			& ~(uintptr_t)(DEDUP_ALIGN - 1));
+	hash64_state_t state;
+	off_t offset = 0;
+	ssize_t n;
+
+	hash64_init(&state, 0);
+	while ((n = pread(fd, buffer, DEDUP_CHUNK, offset)) > 0)
+	{
+		hash64_update(&state, buffer, n);
+		offset += n;
+	}
+	if (n < 0)
+		return false;
+
+	*hash = hash64_final(&state);
+	return true;
+}
+
+/* Identify the contents of the open file fd. Returns true and sets *count if identical
+ * contents were already searched. Returns false if the file must be searched; when
+ * key->size is not UINT64_MAX the caller should then record the result with dedup_insert().
+ */
+bool
+dedup_lookup (dedup_t *dedup, int fd, dedup_key_t *key, long long *count)
+{
+	struct stat file_stats;
+	file_entry_t entry, *slot;
+	content_entry_t *content;
+	bool cached = false;
+	bool found = false;
+
+	key->size = UINT64_MAX;
+	if (fstat(fd, &file_stats) == -1)
+		return false;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.dev = file_stats.st_dev;
+	entry.ino = file_stats.st_ino;
+	entry.size = file_stats.st_size;
+	entry.mtime_sec = file_stats.st_mtim.tv_sec;
+	entry.mtime_nsec = file_stats.st_mtim.tv_nsec;
+
+	pthread_mutex_lock(&dedup->files_mutex);
+	slot = file_slot(dedup->files, dedup->files_mask, &entry);
+	if (slot->size != UINT64_MAX)
+	{
+		entry.hash = slot->hash;
+		cached = true;
+		dedup->hashes_cached++;
+	}
+	pthread_mutex_unlock(&dedup->files_mutex);
+
+	if (!cached)
+	{
+		if (!hash_fd(fd, &entry.hash))
+			return false;
+
+		pthread_mutex_lock(&dedup->files_mutex);
+		file_insert(dedup, &entry);
+		dedup->files_hashed++;
+		pthread_mutex_unlock(&dedup->files_mutex);
+	}
+
+	key->hash = entry.hash;
+	key->size = entry.size;
+
+	pthread_mutex_lock(&dedup->contents_mutex);
+	content = content_slot(dedup->contents, dedup->contents_mask, key);
+	if (content->used)
+	{
+		*count = content->count;
+		dedup->duplicates++;
+		found = true;
+	}
+	pthread_mutex_unlock(&dedup->contents_mutex);
+
+	return found;
+}
+
+void /* Record the count for searched contents. */
+dedup_insert (dedup_t *dedup, const dedup_key_t *key, long long count)
+{
+	content_entry_t *slot, *old;
+	size_t old_size, i;
+
+	if (key->size == UINT64_MAX)
+		return;
+
+	pthread_mutex_lock(&dedup->contents_mutex);
+
+	if (2 * (dedup->num_contents + 1) > dedup->contents_mask + 1)
+	{
+		old = dedup->contents;
+		old_size = dedup->contents_mask + 1;
+		dedup->contents_mask = 2 * old_size - 1;
+		dedup->contents = (content_entry_t *)dedup_calloc(2 * old_size,
+				sizeof(content_entry_t));
+		for (i = 0; i < old_size; i++)
+		{
+			if (old[i].used)
+			{
+				dedup_key_t old_key = { old[i].hash, old[i].size };
+				*content_slot(dedup->contents, dedup->contents_mask, &old_key) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	slot = content_slot(dedup->contents, dedup->contents_mask, key);
+	if (!slot->used)
+	{
+		slot->used = true;
+		slot->hash = key->hash;
+		slot->size = key->size;
+		slot->count = count;
+		dedup->num_contents++;
+	}
+
+	pthread_mutex_unlock(&dedup->contents_mutex);
+}
+
+void /* Forget the per-search counts (file hashes are kept) and zero the statistics. */
+dedup_reset (dedup_t *dedup)
+{
+	pthread_mutex_lock(&dedup->contents_mutex);
+	memset(dedup->contents, 0, sizeof(content_entry_t) * (dedup->contents_mask + 1));
+	dedup->num_contents = 0;
+	dedup->duplicates = 0;
+	pthread_mutex_unlock(&dedup->contents_mutex);
+
+	pthread_mutex_lock(&dedup->files_mutex);
+	dedup->files_hashed = 0;
+	dedup->hashes_cached = 0;
+	pthread_mutex_unlock(&dedup->files_mutex);
+}
+
+void
+dedup_print_stats (const dedup_t *dedup)
+{
+	printf("\n Dedup: %d files hashed, %d hashes reused from cache, %d duplicate files not searched.",
+			dedup->files_hashed, dedup->hashes_cached, dedup->duplicates);
+}
+
+int /* Write the file hashes to the cache file. Returns -1 on error. */
+dedup_save (dedup_t *dedup)
+{
+	char tmp_name[4096];
+	FILE *file;
+	size_t i;
+
+	if (dedup->cache_file == NULL || !dedup->dirty)
+		return 0;
+
+	snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", dedup->cache_file);
+	file = fopen(tmp_name, "wb");
+	if (file == NULL)
+		return -1;
+
+	fwrite(DEDUP_MAGIC, sizeof(DEDUP_MAGIC) - 1, 1, file);
+	for (i = 0; i <= dedup->files_mask; i++)
+	{
+		if (dedup->files[i].size != UINT64_MAX)
+			fwrite(&dedup->files[i], sizeof(file_entry_t), 1, file);
+	}
+
+	/* Replace the old cache atomically */
+	if (fclose(file) != 0 || rename(tmp_name, dedup->cache_file) != 0)
+	{
+		unlink(tmp_name);
+		return -1;
+	}
+
+	dedup->dirty = false;
+	return 0;
+}
+
+void
+free_dedup (dedup_t *dedup)
+{
+	if (dedup == NULL)
+		return;
+
+	pthread_mutex_destroy(&dedup->files_mutex);
+	pthread_mutex_destroy(&dedup->contents_mutex);
+	free(dedup->files);
+	free(dedup->contents);
+	free(dedup->cache_file);
+	free(dedup);
+}
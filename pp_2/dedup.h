@@ -0,0 +1,33 @@
+#ifndef _DEDUP_H
+#define _DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Content-hash deduplication for mini_grep. Files with identical contents produce
+ * identical counts, so each distinct content is searched once and the count reused.
+ *
+ * Two tables are kept, each guarded by its own mutex:
+ *   content: (hash, size) -> count, valid for one search and cleared by dedup_reset()
+ *   file:    (dev, inode, size, mtime) -> hash, optionally persisted to a cache file
+ *            so that unchanged files are not even hashed on later runs
+ */
+
+typedef struct dedup_tag dedup_t;
+
+/* Identifies the contents of one file. */
+typedef struct dedup_key_tag{
+	uint64_t hash;
+	uint64_t size;
+} dedup_key_t;
+
+/* Function definitions. */
+dedup_t *create_dedup (const char *);
+bool dedup_lookup (dedup_t *, int, dedup_key_t *, long long *);
+void dedup_insert (dedup_t *, const dedup_key_t *, long long);
+void dedup_reset (dedup_t *);
+void dedup_print_stats (const dedup_t *);
+int dedup_save (dedup_t *);
+void free_dedup (dedup_t *);
+
+#endif
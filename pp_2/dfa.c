@@ -0,0 +1,872 @@
+/* Regular expression search for mini_grep: a Thompson NFA, run as a lazily built DFA.
+ *
+ * A DFA state is the set of NFA states (character and match states only) the NFA can
+ * be in. States and transitions are created the first time the input needs them and
+ * cached in dfa->transitions, which all threads share:
+ *
+ *   - a cached transition is read with an acquire load and no lock;
+ *   - on a miss the thread takes dfa->mutex, computes the target set, finds or adds
+ *     its state, fills in the state's flags and only then publishes the transition
+ *     with a release store, so readers never see a half-built state.
+ *
+ * The table has room for DFA_MAX_STATES states. If a pathological pattern needs more,
+ * the token being matched falls back to simulating the NFA directly.
+ *
+ * Before the DFA runs, the longest literal every match must contain (e.g. "error" in
+ * "(fatal|)error[0-9]+") is looked for with memmem(); only the tokens containing it
+ * are given to the DFA.
+ *
+ * Author: William Anderson
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "dfa.h"
+#include "match.h"
+
+#define NFA_CHAR 0 		/* Consumes a byte in set, then goes to out */
+#define NFA_SPLIT 1 	/* Empty moves to out and, unless it is -1, out1 */
+#define NFA_MATCH 2
+
+typedef struct nfa_state_tag
+{
+	int type;
+	int out;
+	int out1;
+	unsigned char set[32]; 	/* NFA_CHAR: bitmap of the accepted bytes */
+} nfa_state_t;
+
+/* A piece of NFA under construction. end is an NFA_SPLIT whose out is still -1. */
+typedef struct fragment_tag
+{
+	int start;
+	int end;
+} fragment_t;
+
+struct dfa_tag
+{
+	nfa_state_t *nfa;
+	int num_nfa;
+	int max_nfa;
+	bool out_of_memory; 		/* The NFA could not grow; create_dfa() fails */
+	int nfa_start;
+	bool anchored_start;
+	bool anchored_end;
+
+	/* Prefilter: a literal every match contains, or NULL */
+	char *literal;
+	size_t literal_length;
+
+	/* transitions[state * 256 + byte] holds the next state + 1, or 0 if not built */
+	int32_t *transitions;
+	bool *accepting;
+	bool *dead;
+	int **sets;
+	int *set_sizes;
+	int num_states;
+
+	/* Set -> state hash table and build scratch space, used under mutex */
+	int *table;
+	size_t table_mask;
+	int *seeds;
+	int *closure;
+	int *stack;
+	unsigned char *mark;
+	pthread_mutex_t mutex;
+
+	unsigned long long nfa_fallbacks;
+};
+
+typedef struct parser_tag
+{
+	dfa_t *dfa;
+	const char *pattern;
+	const char *p;
+	int depth;
+	bool ignore_case;
+	bool alternation; 	/* A '|' outside any group: no literal is required */
+	char *run; 			/* Literal run being collected, and the longest so far */
+	size_t run_length;
+	char *best;
+	size_t best_length;
+	char *error;
+	size_t error_size;
+	bool failed;
+} parser_t;
+
+static inline void
+set_add (unsigned char *set, int c)
+{
+	set[c >> 3] |= 1 << (c & 7);
+}
+
+static inline bool
+set_has (const unsigned char *set, int c)
+{
+	return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+/* Add the other case of every ASCII letter in set */
+static void
+set_fold (unsigned char *set)
+{
+	int c;
+
+	for (c = 'a'; c <= 'z'; c++)
+	{
+		if (set_has(set, c) || set_has(set, c - 0x20))
+		{
+			set_add(set, c);
+			set_add(set, c - 0x20);
+		}
+	}
+}
+
+static int
+new_state (dfa_t *dfa, int type, int out, int out1)
+{
+	nfa_state_t *state;
+
+	if (dfa->num_nfa == dfa->max_nfa)
+	{
+		state = (nfa_state_t *)realloc(dfa->nfa, 2 * dfa->max_nfa * sizeof(nfa_state_t));
+		if (state == NULL)
+		{
+			/* Let the parse run on into state 0; create_dfa() throws the result away */
+			dfa->out_of_memory = true;
+			return 0;
+		}
+		dfa->nfa = state;
+		dfa->max_nfa *= 2;
+	}
+
+	state = &dfa->nfa[dfa->num_nfa];
+	memset(state, 0, sizeof(nfa_state_t));
+	state->type = type;
+	state->out = out;
+	state->out1 = out1;
+	return dfa->num_nfa++;
+}
+
+static fragment_t
+empty_fragment (dfa_t *dfa)
+{
+	fragment_t f;
+
+	f.start = f.end = new_state(dfa, NFA_SPLIT, -1, -1);
+	return f;
+}
+
+static fragment_t
+set_fragment (parser_t *ps, const unsigned char *set)
+{
+	fragment_t f;
+
+	f.end = new_state(ps->dfa, NFA_SPLIT, -1, -1);
+	f.start = new_state(ps->dfa, NFA_CHAR, f.end, -1);
+	memcpy(ps->dfa->nfa[f.start].set, set, 32);
+	if (ps->ignore_case)
+		set_fold(ps->dfa->nfa[f.start].set);
+	return f;
+}
+
+static void
+parse_error (parser_t *ps, const char *message)
+{
+	if (!ps->failed)
+	{
+		snprintf(ps->error, ps->error_size, "%s at offset %d", message,
+				(int)(ps->p - ps->pattern));
+		ps->failed = true;
+	}
+}
+
+/* \d, \w, \s and their complements; returns false for other escapes */
+static bool
+escape_class (char c, unsigned char *set)
+{
+	bool negate = (c == 'D' || c == 'W' || c == 'S');
+	int i;
+
+	memset(set, 0, 32);
+	switch (c)
+	{
+	case 'd': case 'D':
+		for (i = '0'; i <= '9'; i++)
+			set_add(set, i);
+		break;
+	case 'w': case 'W':
+		for (i = 0; i < 256; i++)
+		{
+			if ((i >= '0' && i <= '9') || (i >= 'a' && i <= 'z')
+					|| (i >= 'A' && i <= 'Z') || i == '_')
+				set_add(set, i);
+		}
+		break;
+	case 's': case 'S':
+		set_add(set, ' ');
+		set_add(set, '\t');
+		set_add(set, '\n');
+		set_add(set, '\r');
+		set_add(set, '\f');
+		set_add(set, '\v');
+		break;
+	default:
+		return false;
+	}
+
+	if (negate)
+	{
+		for (i = 0; i < 32; i++)
+			set[i] = ~set[i];
+	}
+	return true;
+}
+
+/* [...] class; ps->p is just past the '[' */
+static fragment_t
+parse_class (parser_t *ps)
+{
+	unsigned char set[32], escaped[32];
+	bool negate = false;
+	bool first = true;
+	int c, last, i;
+
+	memset(set, 0, sizeof(set));
+	if (*ps->p == '^')
+	{
+		negate = true;
+		ps->p++;
+	}
+
+	while (*ps->p != '\0' && (*ps->p != ']' || first))
+	{
+		first = false;
+		c = (unsigned char)*ps->p++;
+		if (c == '\\' && *ps->p != '\0')
+		{
+			if (escape_class(*ps->p, escaped))
+			{
+				ps->p++;
+				for (i = 0; i < 32; i++)
+					set[i] |= escaped[i];
+				continue;
+			}
+			c = (unsigned char)*ps->p++;
+		}
+
+		last = c;
+		if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0')
+		{
+			last = (unsigned char)ps->p[1];
+			ps->p += 2;
+			if (last == '\\' && *ps->p != '\0')
+				last = (unsigned char)*ps->p++;
+			if (last < c)
+			{
+				parse_error(ps, "invalid range in character class");
+				return empty_fragment(ps->dfa);
+			}
+		}
+		for (i = c; i <= last; i++)
+			set_add(set, i);
+	}
+
+	if (*ps->p != ']')
+	{
+		parse_error(ps, "missing ]");
+		return empty_fragment(ps->dfa);
+	}
+	ps->p++;
+
+	if (ps->ignore_case)
+		set_fold(set);
+	if (negate)
+	{
+		for (i = 0; i < 32; i++)
+			set[i] = ~set[i];
+	}
+	return set_fragment(ps, set);
+}
+
+static fragment_t parse_alternation (parser_t *);
+
+/* A single atom. Sets *literal to its byte if it matches exactly one byte, else -1. */
+static fragment_t
+parse_atom (parser_t *ps, int *literal)
+{
+	unsigned char set[32];
+	fragment_t f;
+	int c = (unsigned char)*ps->p;
+
+	*literal = -1;
+	memset(set, 0, sizeof(set));
+
+	switch (c)
+	{
+	case '(':
+		ps->p++;
+		ps->depth++;
+		f = parse_alternation(ps);
+		ps->depth--;
+		if (*ps->p != ')')
+		{
+			parse_error(ps, "missing )");
+			return f;
+		}
+		ps->p++;
+		return f;
+
+	case '[':
+		ps->p++;
+		return parse_class(ps);
+
+	case '.':
+		ps->p++;
+		memset(set, 0xff, sizeof(set));
+		return set_fragment(ps, set);
+
+	case '*': case '+': case '?':
+		parse_error(ps, "nothing to repeat");
+		return empty_fragment(ps->dfa);
+
+	case '\\':
+		ps->p++;
+		if (*ps->p == '\0')
+		{
+			parse_error(ps, "trailing backslash");
+			return empty_fragment(ps->dfa);
+		}
+		if (escape_class(*ps->p, set))
+		{
+			ps->p++;
+			return set_fragment(ps, set);
+		}
+		c = (unsigned char)*ps->p;
+		break;
+	}
+
+	ps->p++;
+	set_add(set, c);
+	*literal = c;
+	return set_fragment(ps, set);
+}
+
+/* An atom followed by any number of *, + and ? */
+static fragment_t
+parse_repeat (parser_t *ps, int *literal, bool *optional, bool *repeated)
+{
+	fragment_t f = parse_atom(ps, literal);
+	int split, end;
+
+	*optional = false;
+	*repeated = false;
+
+	while (!ps->failed && (*ps->p == '*' || *ps->p == '+' || *ps->p == '?'))
+	{
+		end = new_state(ps->dfa, NFA_SPLIT, -1, -1);
+		split = new_state(ps->dfa, NFA_SPLIT, f.start, end);
+
+		switch (*ps->p)
+		{
+		case '*':
+			ps->dfa->nfa[f.end].out = split;
+			f.start = split;
+			*optional = *repeated = true;
+			break;
+		case '+':
+			ps->dfa->nfa[f.end].out = split;
+			*repeated = true;
+			break;
+		case '?':
+			ps->dfa->nfa[f.end].out = end;
+			f.start = split;
+			*optional = true;
+			break;
+		}
+		f.end = end;
+		ps->p++;
+	}
+
+	return f;
+}
+
+/* End the current literal run, keeping it if it is the longest so far */
+static void
+end_run (parser_t *ps)
+{
+	if (ps->run_length > ps->best_length)
+	{
+		memcpy(ps->best, ps->run, ps->run_length);
+		ps->best_length = ps->run_length;
+	}
+	ps->run_length = 0;
+}
+
+static fragment_t
+parse_concatenation (parser_t *ps)
+{
+	fragment_t f = empty_fragment(ps->dfa);
+	fragment_t g;
+	bool optional, repeated;
+	int literal;
+
+	while (!ps->failed && *ps->p != '\0' && *ps->p != '|' && *ps->p != ')')
+	{
+		if (ps->depth == 0 && *ps->p == '^' && ps->p == ps->pattern)
+		{
+			ps->dfa->anchored_start = true;
+			ps->p++;
+			continue;
+		}
+		if (ps->depth == 0 && *ps->p == '$' && ps->p[1] == '\0')
+		{
+			ps->dfa->anchored_end = true;
+			ps->p++;
+			continue;
+		}
+
+		g = parse_repeat(ps, &literal, &optional, &repeated);
+		ps->dfa->nfa[f.end].out = g.start;
+		f.end = g.end;
+
+		/* Collect runs of mandatory literal bytes outside groups */
+		if (ps->depth > 0)
+			continue;
+		if (literal >= 0 && !optional)
+		{
+			ps->run[ps->run_length++] = (char)literal;
+			if (repeated)
+				end_run(ps);
+		} else
+		{
+			end_run(ps);
+		}
+	}
+
+	if (ps->depth == 0)
+		end_run(ps);
+	return f;
+}
+
+static fragment_t
+parse_alternation (parser_t *ps)
+{
+	fragment_t f = parse_concatenation(ps);
+	fragment_t g;
+	int split, end;
+
+	while (!ps->failed && *ps->p == '|')
+	{
+		if (ps->depth == 0)
+			ps->alternation = true;
+		ps->p++;
+		g = parse_concatenation(ps);
+
+		end = new_state(ps->dfa, NFA_SPLIT, -1, -1);
+		split = new_state(ps->dfa, NFA_SPLIT, f.start, g.start);
+		ps->dfa->nfa[f.end].out = end;
+		ps->dfa->nfa[g.end].out = end;
+		f.start = split;
+		f.end = end;
+	}
+
+	return f;
+}
+
+/* Follow the empty moves from seeds. Stores the reachable character and match states
+ * in out and returns their number. mark and stack need room for num_nfa entries. */
+static int
+nfa_closure (const dfa_t *dfa, const int *seeds, int num_seeds, int *out,
+		unsigned char *mark, int *stack)
+{
+	const nfa_state_t *state;
+	int depth = 0, count = 0, s, i;
+
+	memset(mark, 0, dfa->num_nfa);
+	for (i = 0; i < num_seeds; i++)
+	{
+		if (!mark[seeds[i]])
+		{
+			mark[seeds[i]] = 1;
+			stack[depth++] = seeds[i];
+		}
+	}
+
+	while (depth > 0)
+	{
+		s = stack[--depth];
+		state = &dfa->nfa[s];
+		if (state->type != NFA_SPLIT)
+		{
+			out[count++] = s;
+			continue;
+		}
+		if (state->out >= 0 && !mark[state->out])
+		{
+			mark[state->out] = 1;
+			stack[depth++] = state->out;
+		}
+		if (state->out1 >= 0 && !mark[state->out1])
+		{
+			mark[state->out1] = 1;
+			stack[depth++] = state->out1;
+		}
+	}
+
+	return count;
+}
+
+/* The states reached from set on byte c, as seeds for nfa_closure() */
+static int
+nfa_step (const dfa_t *dfa, const int *set, int size, int c, int *seeds)
+{
+	int num_seeds = 0, i;
+
+	for (i = 0; i < size; i++)
+	{
+		if (dfa->nfa[set[i]].type == NFA_CHAR && set_has(dfa->nfa[set[i]].set, c))
+			seeds[num_seeds++] = dfa->nfa[set[i]].out;
+	}
+	/* Unanchored: a match may start at any byte of the token */
+	if (!dfa->anchored_start)
+		seeds[num_seeds++] = dfa->nfa_start;
+
+	return num_seeds;
+}
+
+static bool
+nfa_accepts (const dfa_t *dfa, const int *set, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+	{
+		if (dfa->nfa[set[i]].type == NFA_MATCH)
+			return true;
+	}
+	return false;
+}
+
+static int
+compare_int (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static size_t
+hash_set (const int *set, int size)
+{
+	uint64_t h = 14695981039346656037ULL;
+	int i;
+
+	for (i = 0; i < size; i++)
+		h = (h ^ (uint64_t)set[i]) * 1099511628211ULL;
+	return (size_t)(h ^ (h >> 29));
+}
+
+/* Find or add the DFA state for set. Returns -1 if the table is full, or if there is
+ * no memory for the state; either way the caller falls back to the NFA. Caller holds
+ * mutex (or is create_dfa()). */
+static int
+dfa_state (dfa_t *dfa, int *set, int size)
+{
+	size_t index;
+	int id;
+
+	qsort(set, size, sizeof(int), compare_int);
+
+	index = hash_set(set, size) & dfa->table_mask;
+	while ((id = dfa->table[index]) != -1)
+	{
+		if (dfa->set_sizes[id] == size
+				&& memcmp(dfa->sets[id], set, size * sizeof(int)) == 0)
+			return id;
+		index = (index + 1) & dfa->table_mask;
+	}
+
+	if (dfa->num_states == DFA_MAX_STATES)
+		return -1;
+
+	id = dfa->num_states;
+	dfa->sets[id] = (int *)malloc((size + 1) * sizeof(int));
+	if (dfa->sets[id] == NULL)
+		return -1;
+	memcpy(dfa->sets[id], set, size * sizeof(int));
+	dfa->set_sizes[id] = size;
+	dfa->accepting[id] = nfa_accepts(dfa, set, size);
+	dfa->dead[id] = (size == 0);
+	dfa->table[index] = id;
+	dfa->num_states++;
+	return id;
+}
+
+/* Next state from state on byte c, building it if needed. Returns -1 if the table is full. */
+static inline int
+dfa_next (dfa_t *dfa, int state, unsigned char c)
+{
+	int32_t *slot = &dfa->transitions[(size_t)state * 256 + c];
+	int32_t next = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	int num_seeds, size;
+
+	if (next != 0)
+		return next - 1;
+
+	pthread_mutex_lock(&dfa->mutex);
+	next = *slot;
+	if (next == 0)
+	{
+		num_seeds = nfa_step(dfa, dfa->sets[state], dfa->set_sizes[state], c, dfa->seeds);
+		size = nfa_closure(dfa, dfa->seeds, num_seeds, dfa->closure, dfa->mark,
+				dfa->stack);
+		next = dfa_state(dfa, dfa->closure, size) + 1;
+		if (next != 0)
+			__atomic_store_n(slot, next, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&dfa->mutex);
+
+	return next - 1;
+}
+
+/* Slow path when the DFA table is full: simulate the NFA over the token */
+static bool
+nfa_match_token (dfa_t *dfa, const char *p, const char *end)
+{
+	int current[dfa->num_nfa + 1], seeds[dfa->num_nfa + 1], stack[dfa->num_nfa];
+	unsigned char mark[dfa->num_nfa];
+	int size, num_seeds;
+
+	__atomic_add_fetch(&dfa->nfa_fallbacks, 1, __ATOMIC_RELAXED);
+
+	size = nfa_closure(dfa, &dfa->nfa_start, 1, current, mark, stack);
+	for (; p < end; p++)
+	{
+		if (!dfa->anchored_end && nfa_accepts(dfa, current, size))
+			return true;
+		num_seeds = nfa_step(dfa, current, size, (unsigned char)*p, seeds);
+		if (num_seeds == 0)
+			return false;
+		size = nfa_closure(dfa, seeds, num_seeds, current, mark, stack);
+	}
+
+	return nfa_accepts(dfa, current, size);
+}
+
+static bool /* True if the token [p .. end) contains a match. */
+dfa_match_token (dfa_t *dfa, const char *p, const char *end)
+{
+	const char *token = p;
+	int state = 0;
+
+	if (!dfa->anchored_end && dfa->accepting[0])
+		return true;
+
+	for (; p < end; p++)
+	{
+		state = dfa_next(dfa, state, (unsigned char)*p);
+		if (state < 0)
+			return nfa_match_token(dfa, token, end);
+		if (dfa->dead[state])
+			return false;
+		if (!dfa->anchored_end && dfa->accepting[state])
+			return true;
+	}
+
+	return dfa->accepting[state];
+}
+
+/* Compile pattern. Returns NULL and describes the problem in error on a syntax error,
+ * or if memory runs out. */
+dfa_t *
+create_dfa (const char *pattern, bool ignore_case, char *error, size_t error_size)
+{
+	dfa_t *dfa = (dfa_t *)calloc(1, sizeof(dfa_t));
+	size_t pattern_length = strlen(pattern);
+	parser_t ps;
+	fragment_t f;
+	int start;
+
+	if (dfa == NULL)
+	{
+		snprintf(error, error_size, "out of memory");
+		return NULL;
+	}
+	pthread_mutex_init(&dfa->mutex, NULL);
+
+	memset(&ps, 0, sizeof(ps));
+	ps.dfa = dfa;
+	ps.pattern = ps.p = pattern;
+	ps.ignore_case = ignore_case;
+	ps.error = error;
+	ps.error_size = error_size;
+
+	dfa->max_nfa = 16;
+	dfa->nfa = (nfa_state_t *)malloc(dfa->max_nfa * sizeof(nfa_state_t));
+	ps.run = (char *)malloc(pattern_length + 1);
+	ps.best = (char *)malloc(pattern_length + 1);
+	if (dfa->nfa == NULL || ps.run == NULL || ps.best == NULL)
+		goto out_of_memory;
+
+	f = parse_alternation(&ps);
+	if (!ps.failed && *ps.p != '\0')
+		parse_error(&ps, "unmatched )");
+
+	if (ps.failed && !dfa->out_of_memory)
+	{
+		free(ps.run);
+		free(ps.best);
+		free_dfa(dfa);
+		return NULL;
+	}
+
+	/* new_state() may move dfa->nfa, so do not index it in the same expression */
+	start = new_state(dfa, NFA_MATCH, -1, -1);
+	if (dfa->out_of_memory)
+		goto out_of_memory;
+	dfa->nfa[f.end].out = start;
+	dfa->nfa_start = f.start;
+
+	/* With case folding the literal could appear in any case; skip the prefilter */
+	if (!ps.alternation && !ignore_case && ps.best_length > 0)
+	{
+		ps.best[ps.best_length] = '\0';
+		dfa->literal = ps.best;
+		dfa->literal_length = ps.best_length;
+	} else
+	{
+		free(ps.best);
+	}
+	free(ps.run);
+	ps.run = ps.best = NULL;
+
+	dfa->transitions = (int32_t *)calloc((size_t)DFA_MAX_STATES * 256, sizeof(int32_t));
+	dfa->accepting = (bool *)calloc(DFA_MAX_STATES, sizeof(bool));
+	dfa->dead = (bool *)calloc(DFA_MAX_STATES, sizeof(bool));
+	dfa->sets = (int **)calloc(DFA_MAX_STATES, sizeof(int *));
+	dfa->set_sizes = (int *)calloc(DFA_MAX_STATES, sizeof(int));
+	dfa->table_mask = 2 * DFA_MAX_STATES - 1;
+	dfa->table = (int *)malloc((dfa->table_mask + 1) * sizeof(int));
+	dfa->seeds = (int *)malloc((dfa->num_nfa + 1) * sizeof(int));
+	dfa->closure = (int *)malloc((dfa->num_nfa + 1) * sizeof(int));
+	dfa->stack = (int *)malloc(dfa->num_nfa * sizeof(int));
+	dfa->mark = (unsigned char *)malloc(dfa->num_nfa);
+	if (dfa->transitions == NULL || dfa->accepting == NULL || dfa->dead == NULL
+			|| dfa->sets == NULL || dfa->set_sizes == NULL || dfa->table == NULL
+			|| dfa->seeds == NULL || dfa->closure == NULL || dfa->stack == NULL
+			|| dfa->mark == NULL)
+		goto out_of_memory;
+	memset(dfa->table, 0xff, (dfa->table_mask + 1) * sizeof(int));
+
+	/* State 0 is the start state */
+	start = dfa->nfa_start;
+	if (dfa_state(dfa, dfa->closure, nfa_closure(dfa, &start, 1, dfa->closure, dfa->mark,
+			dfa->stack)) != 0)
+		goto out_of_memory;
+
+	return dfa;
+
+out_of_memory:
+	free(ps.run);
+	free(ps.best);
+	free_dfa(dfa);
+	snprintf(error, error_size, "out of memory");
+	return NULL;
+}
+
+int /* Number of tokens in buffer[0 .. length) containing a match. */
+dfa_count (dfa_t *dfa, const match_delimiters_t *delimiters, const char *buffer,
+		size_t length)
+{
+	return dfa_tokens(dfa, delimiters, buffer, length, NULL, NULL);
+}
+
+/* As dfa_count(), also calling token_fn(arg, token, token_length) for each token
+ * counted, in buffer order. */
+int
+dfa_tokens (dfa_t *dfa, const match_delimiters_t *delimiters, const char *buffer,
+		size_t length, match_token_fn token_fn, void *arg)
+{
+	const char *end = buffer + length;
+	const char *p = buffer;
+	const char *token_end;
+	int count = 0;
+
+	while (p < end)
+	{
+		if (dfa->literal != NULL)
+		{
+			/* Jump to the start of the next token containing the literal */
+			token_end = memmem(p, end - p, dfa->literal, dfa->literal_length);
+			if (token_end == NULL)
+				break;
+			while (token_end > p && !match_is_delimiter(delimiters, token_end[-1]))
+				token_end--;
+			p = token_end;
+		}
+
+		while (p < end && match_is_delimiter(delimiters, *p))
+			p++;
+		token_end = match_next_delimiter(delimiters, p, end);
+
+		if (token_end > p && dfa_match_token(dfa, p, token_end))
+		{
+			count++;
+			if (token_fn != NULL)
+				token_fn(arg, p, token_end - p);
+		}
+		p = token_end;
+	}
+
+	return count;
+}
+
+void
+dfa_print_stats (dfa_t *dfa)
+{
+	pthread_mutex_lock(&dfa->mutex);
+	printf("\n Regex: %d NFA states, %d DFA states built (limit %d)", dfa->num_nfa,
+			dfa->num_states, DFA_MAX_STATES);
+	pthread_mutex_unlock(&dfa->mutex);
+	if (dfa->literal != NULL)
+		printf(", prefilter literal \"%s\"", dfa->literal);
+	printf(".");
+	if (dfa->nfa_fallbacks > 0)
+	{
+		printf("\n Regex: DFA table full, %llu tokens matched by NFA simulation.",
+				dfa->nfa_fallbacks);
+	}
+}
+
+void
+free_dfa (dfa_t *dfa)
+{
+	int i;
+
+	if (dfa == NULL)
+		return;
+
+	if (dfa->sets != NULL)
+	{
+		for (i = 0; i < dfa->num_states; i++)
+			free(dfa->sets[i]);
+	}
+	pthread_mutex_destroy(&dfa->mutex);
+	free(dfa->nfa);
+	free(dfa->literal);
+	free(dfa->transitions);
+	free(dfa->accepting);
+	free(dfa->dead);
+	free(dfa->sets);
+	free(dfa->set_sizes);
+	free(dfa->table);
+	free(dfa->seeds);
+	free(dfa->closure);
+	free(dfa->stack);
+	free(dfa->mark);
+	free(dfa);
+}
@@ -0,0 +1,37 @@
+#ifndef _DFA_H
+#define _DFA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "match.h"
+
+/* Regular expression search mode. The pattern is matched against each token (see
+ * match.h); a token is counted once if any part of it matches. Supported syntax:
+ *
+ *   c           literal character; \c escapes any of the characters below
+ *   .           any byte
+ *   [abc] [a-z] [^...]   character class
+ *   \d \w \s    digit, word character, white space (\D \W \S: complement)
+ *   ( )         grouping
+ *   * + ?       repetition (greedy or not makes no difference to a count)
+ *   a|b         alternation
+ *   ^ $         at the start (end) of the pattern: anchor to the start (end) of the token
+ *
+ * The pattern is compiled to an NFA; the DFA is built from it lazily, one transition
+ * at a time, as the input needs it. The state table is shared by all threads: cached
+ * transitions are read without locking, and only a miss takes a lock to add one.
+ */
+
+#define DFA_MAX_STATES 4096
+
+typedef struct dfa_tag dfa_t;
+
+/* Function definitions. */
+dfa_t *create_dfa (const char *, bool, char *, size_t);
+int dfa_count (dfa_t *, const match_delimiters_t *, const char *, size_t);
+int dfa_tokens (dfa_t *, const match_delimiters_t *, const char *, size_t, match_token_fn,
+		void *);
+void dfa_print_stats (dfa_t *);
+void free_dfa (dfa_t *);
+
+#endif
@@ -0,0 +1,443 @@
+/* Gitignore-style exclusion rules for pruning the directory traversal.
+ *
+ * Rules are kept in the order they were given. exclude_compile() sorts them into
+ * classes so that the common cases are cheap to test against every directory entry:
+ *
+ *   literal names ("node_modules", ".git/")  -> open-addressing hash table
+ *   "*<literal>" suffixes ("*.o")           -> memcmp against the end of the name
+ *   other globs                             -> fnmatch() on the name
+ *   patterns containing '/'                 -> fnmatch() on the trailing path components
+ *   anchored patterns ("/build")            -> fnmatch() on the path below the root
+ *
+ * After compilation the structure is never written again, so all threads may call
+ * exclude_match() concurrently without locking.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fnmatch.h>
+#include "exclude.h"
+#include "queue.h"
+
+typedef struct exclude_rule_tag
+{
+	char *pattern;
+	bool negate; 		// "!pattern", re-include
+	bool dir_only; 		// "pattern/", directories only
+	bool anchored; 		// "/pattern", matched from the root of the walk
+	int num_components; // Number of path components, for patterns containing '/'
+} exclude_rule_t;
+
+typedef struct literal_slot_tag
+{
+	const char *name; 	// NULL if the slot is empty
+	int any_rule; 		// Latest matching rule for any entry type, or -1
+	int dir_rule; 		// Latest matching rule for directories only, or -1
+} literal_slot_t;
+
+struct exclude_tag
+{
+	exclude_rule_t *rules;
+	int num_rules;
+	int max_rules;
+
+	literal_slot_t *literals;
+	size_t literal_mask;
+
+	int *suffix_rules;
+	int num_suffix;
+	int *glob_rules;
+	int num_glob;
+	int *path_rules;
+	int num_path;
+
+	bool has_negation;
+	bool has_dir_only;
+};
+
+static void *
+exclude_malloc (size_t size)
+{
+	void *p = malloc(size);
+	if (p == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+static uint32_t /* FNV-1a hash of a name. */
+hash_name (const char *name, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool
+is_literal (const char *pattern)
+{
+	return strpbrk(pattern, "*?[\\") == NULL;
+}
+
+exclude_t * /* Creates an empty rule set. */
+create_exclude (void)
+{
+	exclude_t *this_exclude = (exclude_t *)exclude_malloc(sizeof(exclude_t));
+	memset(this_exclude, 0, sizeof(exclude_t));
+	return this_exclude;
+}
+
+void /* Add a single gitignore-style pattern. Must be called before exclude_compile(). */
+exclude_add_pattern (exclude_t *exclude, const char *pattern)
+{
+	exclude_rule_t *rule;
+	char *copy, *p;
+	size_t length;
+
+	if (exclude->num_rules == exclude->max_rules)
+	{
+		exclude->max_rules = exclude->max_rules ? 2 * exclude->max_rules : 16;
+		exclude->rules = (exclude_rule_t *)realloc(exclude->rules,
+				sizeof(exclude_rule_t) * exclude->max_rules);
+		if (exclude->rules == NULL)
+		{
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	rule = &exclude->rules[exclude->num_rules];
+	memset(rule, 0, sizeof(exclude_rule_t));
+
+	if (pattern[0] == '!')
+	{
+		rule->negate = true;
+		pattern++;
+	}
+
+	copy = strdup(pattern);
+	if (copy == NULL)
+	{
+		perror("strdup");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Trailing slash: directories only */
+	length = strlen(copy);
+	while (length > 1 && copy[length - 1] == '/')
+	{
+		copy[--length] = '\0';
+		rule->dir_only = true;
+	}
+
+	/* A leading "/" anchors the pattern to the root of the walk. A leading "**\/"
+	 * matches at any depth, which is what a pattern without it does anyway. */
+	p = copy;
+	if (strncmp(p, "**/", 3) == 0)
+	{
+		p += 3;
+	} else if (p[0] == '/')
+	{
+		p++;
+		rule->anchored = true;
+	}
+	memmove(copy, p, strlen(p) + 1);
+
+	if (copy[0] == '\0')
+	{
+		free(copy);
+		return;
+	}
+
+	rule->pattern = copy;
+	if (rule->anchored || strchr(copy, '/') != NULL)
+	{
+		rule->num_components = 1;
+		for (p = copy; *p != '\0'; p++)
+		{
+			if (*p == '/')
+				rule->num_components++;
+		}
+	}
+
+	exclude->has_negation |= rule->negate;
+	exclude->has_dir_only |= rule->dir_only;
+	exclude->num_rules++;
+}
+
+int /* Add every pattern in an ignore file. Returns -1 if the file cannot be read. */
+exclude_add_file (exclude_t *exclude, const char *file_name)
+{
+	FILE *file = fopen(file_name, "r");
+	char line[MAX_LENGTH];
+	size_t length;
+
+	if (file == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'
+				|| line[length - 1] == ' ' || line[length - 1] == '\t'))
+		{
+			line[--length] = '\0';
+		}
+
+		if (length == 0 || line[0] == '#')
+			continue;
+
+		exclude_add_pattern(exclude, line);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static void
+literal_insert (exclude_t *exclude, int rule_index)
+{
+	exclude_rule_t *rule = &exclude->rules[rule_index];
+	size_t slot = hash_name(rule->pattern, strlen(rule->pattern)) & exclude->literal_mask;
+
+	while (exclude->literals[slot].name != NULL
+			&& strcmp(exclude->literals[slot].name, rule->pattern) != 0)
+	{
+		slot = (slot + 1) & exclude->literal_mask;
+	}
+
+	if (exclude->literals[slot].name == NULL)
+	{
+		exclude->literals[slot].name = rule->pattern;
+		exclude->literals[slot].any_rule = -1;
+		exclude->literals[slot].dir_rule = -1;
+	}
+
+	/* Rules are inserted in order, so the later rule always wins */
+	if (rule->dir_only)
+		exclude->literals[slot].dir_rule = rule_index;
+	else
+		exclude->literals[slot].any_rule = rule_index;
+}
+
+void /* Sort the rules into their match classes. The rule set is read-only afterwards. */
+exclude_compile (exclude_t *exclude)
+{
+	size_t table_size = 16;
+	int i, num_literals = 0;
+	exclude_rule_t *rule;
+
+	for (i = 0; i < exclude->num_rules; i++)
+	{
+		rule = &exclude->rules[i];
+		if (rule->num_components == 0 && is_literal(rule->pattern))
+			num_literals++;
+	}
+
+	/* Keep the load factor at or below 1/2 */
+	while (table_size < 2 * (size_t)num_literals)
+		table_size *= 2;
+
+	exclude->literals = (literal_slot_t *)exclude_malloc(
+			sizeof(literal_slot_t) * table_size);
+	memset(exclude->literals, 0, sizeof(literal_slot_t) * table_size);
+	exclude->literal_mask = table_size - 1;
+
+	exclude->suffix_rules = (int *)exclude_malloc(sizeof(int) * (exclude->num_rules + 1));
+	exclude->glob_rules = (int *)exclude_malloc(sizeof(int) * (exclude->num_rules + 1));
+	exclude->path_rules = (int *)exclude_malloc(sizeof(int) * (exclude->num_rules + 1));
+
+	for (i = 0; i < exclude->num_rules; i++)
+	{
+		rule = &exclude->rules[i];
+		if (rule->num_components > 0)
+		{
+			exclude->path_rules[exclude->num_path++] = i;
+		} else if (is_literal(rule->pattern))
+		{
+			literal_insert(exclude, i);
+		} else if (rule->pattern[0] == '*' && is_literal(rule->pattern + 1))
+		{
+			exclude->suffix_rules[exclude->num_suffix++] = i;
+		} else
+		{
+			exclude->glob_rules[exclude->num_glob++] = i;
+		}
+	}
+}
+
+bool
+exclude_is_empty (const exclude_t *exclude)
+{
+	return exclude == NULL || exclude->num_rules == 0;
+}
+
+bool /* True if some rule depends on whether the entry is a directory. */
+exclude_needs_type (const exclude_t *exclude)
+{
+	return exclude != NULL && exclude->has_dir_only;
+}
+
+/* The part of path below root, without a leading "/" or "./" */
+static const char *
+relative_path (const char *root, const char *path)
+{
+	size_t length = strlen(root);
+
+	if (strncmp(path, root, length) == 0)
+		path += length;
+
+	while (path[0] == '/' || (path[0] == '.' && (path[1] == '/' || path[1] == '\0')))
+		path++;
+	return path;
+}
+
+/* Record a matching rule; returns true when the search can stop early. */
+static bool
+consider (const exclude_t *exclude, int rule_index, bool is_dir, int *best)
+{
+	if (rule_index < 0)
+		return false;
+	if (exclude->rules[rule_index].dir_only && !is_dir)
+		return false;
+	if (rule_index > *best)
+		*best = rule_index;
+
+	/* Without negations the first match decides */
+	return !exclude->has_negation;
+}
+
+/* Test the entry "name" found in directory "parent" against the rules. parent is
+ * below root, the directory the walk started from, which anchored patterns are matched
+ * from; a NULL root means parent is relative to the root already. */
+bool
+exclude_match (const exclude_t *exclude, const char *root, const char *parent,
+		const char *name, bool is_dir)
+{
+	const literal_slot_t *slot;
+	const exclude_rule_t *rule;
+	size_t name_length, suffix_length, index;
+	int best = -1;
+	int i;
+
+	if (exclude_is_empty(exclude))
+		return false;
+
+	name_length = strlen(name);
+
+	/* Literal names */
+	index = hash_name(name, name_length) & exclude->literal_mask;
+	for (slot = &exclude->literals[index]; slot->name != NULL;
+			slot = &exclude->literals[index])
+	{
+		if (strcmp(slot->name, name) == 0)
+		{
+			if (consider(exclude, slot->any_rule, is_dir, &best)
+					|| consider(exclude, slot->dir_rule, is_dir, &best))
+				goto done;
+			break;
+		}
+		index = (index + 1) & exclude->literal_mask;
+	}
+
+	/* "*suffix" patterns */
+	for (i = 0; i < exclude->num_suffix; i++)
+	{
+		rule = &exclude->rules[exclude->suffix_rules[i]];
+		suffix_length = strlen(rule->pattern + 1);
+		if (suffix_length <= name_length
+				&& memcmp(name + name_length - suffix_length, rule->pattern + 1,
+						suffix_length) == 0)
+		{
+			if (consider(exclude, exclude->suffix_rules[i], is_dir, &best))
+				goto done;
+		}
+	}
+
+	/* General globs on the name */
+	for (i = 0; i < exclude->num_glob; i++)
+	{
+		rule = &exclude->rules[exclude->glob_rules[i]];
+		if (fnmatch(rule->pattern, name, 0) == 0)
+		{
+			if (consider(exclude, exclude->glob_rules[i], is_dir, &best))
+				goto done;
+		}
+	}
+
+	/* Patterns with a slash, matched against the trailing path components, and
+	 * anchored patterns, matched against the whole path below the root */
+	if (exclude->num_path > 0)
+	{
+		char path[2 * MAX_LENGTH];
+		const char *tail;
+		int components;
+
+		snprintf(path, sizeof(path), "%s/%s", parent, name);
+
+		for (i = 0; i < exclude->num_path; i++)
+		{
+			rule = &exclude->rules[exclude->path_rules[i]];
+
+			if (rule->anchored)
+			{
+				tail = relative_path((root != NULL) ? root : "", path);
+				if (fnmatch(rule->pattern, tail, FNM_PATHNAME) == 0
+						&& consider(exclude, exclude->path_rules[i], is_dir, &best))
+					goto done;
+				continue;
+			}
+
+			components = 1;
+			tail = path + strlen(path);
+			while (tail > path)
+			{
+				if (tail[-1] == '/' && components++ == rule->num_components)
+					break;
+				tail--;
+			}
+
+			if (fnmatch(rule->pattern, tail, FNM_PATHNAME) == 0)
+			{
+				if (consider(exclude, exclude->path_rules[i], is_dir, &best))
+					goto done;
+			}
+		}
+	}
+
+done:
+	return best >= 0 && !exclude->rules[best].negate;
+}
+
+void
+free_exclude (exclude_t *exclude)
+{
+	int i;
+
+	if (exclude == NULL)
+		return;
+
+	for (i = 0; i < exclude->num_rules; i++)
+		free(exclude->rules[i].pattern);
+
+	free(exclude->rules);
+	free(exclude->literals);
+	free(exclude->suffix_rules);
+	free(exclude->glob_rules);
+	free(exclude->path_rules);
+	free(exclude);
+}
@@ -0,0 +1,31 @@
+#ifndef _EXCLUDE_H
+#define _EXCLUDE_H
+
+#include <stdbool.h>
+
+/* Gitignore-style exclusion rules. Patterns are added while the command line is
+ * parsed, compiled once with exclude_compile(), and then shared read-only by all
+ * threads. Supported syntax:
+ *
+ *   name        literal file or directory name, matched against any path component
+ *   *.ext, ab*  glob (fnmatch) matched against the entry name
+ *   dir/        trailing slash: only matches directories
+ *   src/gen     pattern containing a slash: matched against the trailing path components
+ *   /build      leading slash: anchored, matched against the path below the search root
+ *   !pattern    re-include an entry excluded by an earlier rule (last match wins)
+ *   # comment   ignored (in ignore files), as are blank lines
+ */
+
+typedef struct exclude_tag exclude_t;
+
+/* Function definitions. */
+exclude_t *create_exclude (void);
+void exclude_add_pattern (exclude_t *, const char *);
+int exclude_add_file (exclude_t *, const char *);
+void exclude_compile (exclude_t *);
+bool exclude_is_empty (const exclude_t *);
+bool exclude_needs_type (const exclude_t *);
+bool exclude_match (const exclude_t *, const char *, const char *, const char *, bool);
+void free_exclude (exclude_t *);
+
+#endif
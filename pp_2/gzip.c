@@ -0,0 +1,112 @@
+/* Streaming gzip decompression for mini_grep.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "gzip.h"
+
+bool /* True if buffer starts with the gzip magic number and the deflate method */
+gzip_is_compressed (const char *buffer, size_t length)
+{
+	return length >= 3 && (unsigned char)buffer[0] == 0x1f
+			&& (unsigned char)buffer[1] == 0x8b && buffer[2] == 8;
+}
+
+/* Start decompressing fd, whose first head_length bytes were already read into head.
+ * Returns -1 if there is no memory for the reader. */
+int
+gzip_open (gzip_reader_t *gzip, int fd, const char *head, size_t head_length)
+{
+	memset(gzip, 0, sizeof(gzip_reader_t));
+	gzip->fd = fd;
+
+	/* Room for the head, and reads of whole GZIP_ALIGN blocks after it */
+	gzip->input_size = GZIP_INPUT_SIZE;
+	if (head_length > gzip->input_size)
+		gzip->input_size = (head_length + GZIP_ALIGN - 1) & ~(size_t)(GZIP_ALIGN - 1);
+	if (posix_memalign((void **)&gzip->input, GZIP_ALIGN, gzip->input_size) != 0)
+		return -1;
+	memcpy(gzip->input, head, head_length);
+	gzip->bytes_in = head_length;
+
+	/* 16 + MAX_WBITS: expect a gzip header and trailer */
+	if (inflateInit2(&gzip->stream, 16 + MAX_WBITS) != Z_OK)
+	{
+		free(gzip->input);
+		return -1;
+	}
+	gzip->stream.next_in = gzip->input;
+	gzip->stream.avail_in = head_length;
+	return 0;
+}
+
+/* Decompress up to size bytes into buffer. Returns the number of bytes, 0 at the end of
+ * the data, or -1 once the data turns out to be corrupt or truncated (after returning
+ * everything decompressed before that point). */
+ssize_t
+gzip_read (gzip_reader_t *gzip, char *buffer, size_t size)
+{
+	ssize_t n;
+	int status;
+
+	gzip->stream.next_out = (unsigned char *)buffer;
+	gzip->stream.avail_out = size;
+
+	while (gzip->stream.avail_out > 0 && !gzip->done && !gzip->error)
+	{
+		if (gzip->stream.avail_in == 0)
+		{
+			n = read(gzip->fd, gzip->input, gzip->input_size);
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n <= 0)
+			{
+				gzip->done = true;
+				gzip->error = (n == -1 || gzip->in_member);
+				break;
+			}
+			gzip->bytes_in += n;
+			gzip->stream.next_in = gzip->input;
+			gzip->stream.avail_in = n;
+		}
+
+		status = inflate(&gzip->stream, Z_NO_FLUSH);
+		if (status == Z_STREAM_END)
+		{
+			/* Another member may follow */
+			gzip->members++;
+			gzip->in_member = false;
+			inflateReset(&gzip->stream);
+		} else if (status == Z_OK || status == Z_BUF_ERROR)
+		{
+			gzip->in_member = true;
+		} else if (status == Z_DATA_ERROR && gzip->members > 0
+				&& gzip->stream.total_out == 0)
+		{
+			gzip->done = true; 	/* Not a member: trailing garbage */
+		} else
+		{
+			gzip->error = true;
+		}
+	}
+
+	n = size - gzip->stream.avail_out;
+	if (n == 0 && gzip->error)
+		return -1;
+	return n;
+}
+
+void
+gzip_close (gzip_reader_t *gzip)
+{
+	inflateEnd(&gzip->stream);
+	free(gzip->input);
+	gzip->input = NULL;
+}
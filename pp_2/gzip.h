@@ -0,0 +1,41 @@
+#ifndef _GZIP_H
+#define _GZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+/* Streaming gzip decompression with zlib. A reader is opened on a file descriptor with
+ * the bytes already read from it (the block that was sniffed), and gzip_read() then
+ * works like read(): it fills the caller's buffer with decompressed bytes, reading
+ * compressed input as needed, so a file is never decompressed as a whole. Files made
+ * of several gzip members (concatenated .gz files) are read through to the end;
+ * garbage after the last member is ignored, as gzip -d does.
+ *
+ * Compressed input is read into a GZIP_ALIGN aligned buffer in multiples of
+ * GZIP_ALIGN, so descriptors opened with O_DIRECT can be read too.
+ */
+
+#define GZIP_INPUT_SIZE (64 * 1024)
+#define GZIP_ALIGN 4096
+
+typedef struct gzip_reader_tag{
+	z_stream stream;
+	int fd;
+	unsigned char *input;
+	size_t input_size;
+	long long bytes_in; 		/* Compressed bytes read so far, including the head */
+	int members; 				/* Members decompressed completely */
+	bool in_member; 			/* A member has been started and not finished */
+	bool done;
+	bool error; 				/* Corrupt or truncated data */
+} gzip_reader_t;
+
+/* Function definitions. */
+bool gzip_is_compressed (const char *, size_t);
+int gzip_open (gzip_reader_t *, int, const char *, size_t);
+ssize_t gzip_read (gzip_reader_t *, char *, size_t);
+void gzip_close (gzip_reader_t *);
+
+#endif
@@ -0,0 +1,166 @@
+/* 64-bit content hash used to recognise files with identical contents.
+ *
+ * Implements the XXH64 algorithm (Yann Collet) in streaming form, so files can be
+ * hashed in fixed-size chunks. Inputs are read little-endian.
+ *
+ * Author: William Anderson
+ */
+
+#include <string.h>
+#include "hash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t
+rotl64 (uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+read64 (const unsigned char *p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16)
+			| ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+			| ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t
+read32 (const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+			| ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t
+round64 (uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t
+merge_round64 (uint64_t acc, uint64_t value)
+{
+	acc ^= round64(0, value);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+/* Consume one 32-byte stripe. */
+static inline void
+stripe64 (uint64_t v[4], const unsigned char *p)
+{
+	v[0] = round64(v[0], read64(p));
+	v[1] = round64(v[1], read64(p + 8));
+	v[2] = round64(v[2], read64(p + 16));
+	v[3] = round64(v[3], read64(p + 24));
+}
+
+void
+hash64_init (hash64_state_t *state, uint64_t seed)
+{
+	memset(state, 0, sizeof(hash64_state_t));
+	state->seed = seed;
+	state->v[0] = seed + PRIME64_1 + PRIME64_2;
+	state->v[1] = seed + PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - PRIME64_1;
+}
+
+void
+hash64_update (hash64_state_t *state, const void *input, size_t length)
+{
+	const unsigned char *p = (const unsigned char *)input;
+	const unsigned char *end = p + length;
+	size_t fill;
+
+	state->total_length += length;
+
+	/* Not enough for a stripe yet, keep it for later */
+	if (state->memory_size + length < 32)
+	{
+		memcpy(state->memory + state->memory_size, p, length);
+		state->memory_size += length;
+		return;
+	}
+
+	/* Complete the pending stripe */
+	if (state->memory_size > 0)
+	{
+		fill = 32 - state->memory_size;
+		memcpy(state->memory + state->memory_size, p, fill);
+		stripe64(state->v, state->memory);
+		p += fill;
+		state->memory_size = 0;
+	}
+
+	while (p + 32 <= end)
+	{
+		stripe64(state->v, p);
+		p += 32;
+	}
+
+	if (p < end)
+	{
+		memcpy(state->memory, p, end - p);
+		state->memory_size = end - p;
+	}
+}
+
+uint64_t
+hash64_final (const hash64_state_t *state)
+{
+	const unsigned char *p = state->memory;
+	const unsigned char *end = p + state->memory_size;
+	uint64_t h;
+
+	if (state->total_length >= 32)
+	{
+		h = rotl64(state->v[0], 1) + rotl64(state->v[1], 7)
+				+ rotl64(state->v[2], 12) + rotl64(state->v[3], 18);
+		h = merge_round64(h, state->v[0]);
+		h = merge_round64(h, state->v[1]);
+		h = merge_round64(h, state->v[2]);
+		h = merge_round64(h, state->v[3]);
+	} else
+	{
+		h = state->seed + PRIME64_5;
+	}
+
+	h += state->total_length;
+
+	while (p + 8 <= end)
+	{
+		h ^= round64(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+
+	if (p + 4 <= end)
+	{
+		h ^= (uint64_t)read32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	/* Avalanche */
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
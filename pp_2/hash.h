@@ -0,0 +1,21 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Streaming 64-bit non-cryptographic hash (XXH64 algorithm). */
+typedef struct hash64_state_tag{
+	uint64_t v[4];
+	uint64_t total_length;
+	uint64_t seed;
+	unsigned char memory[32];	/* Input not yet consumed as a full 32-byte stripe */
+	size_t memory_size;
+} hash64_state_t;
+
+/* Function definitions. */
+void hash64_init (hash64_state_t *, uint64_t);
+void hash64_update (hash64_state_t *, const void *, size_t);
+uint64_t hash64_final (const hash64_state_t *);
+
+#endif
@@ -0,0 +1,254 @@
+/* JSON Lines records formatted into per-thread buffers.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "json.h"
+
+/* Longest escape of one byte (\u00XX) */
+#define JSON_ESCAPE_MAX 6
+/* Room for a record's keys, numbers and punctuation besides its strings */
+#define JSON_RECORD_OVERHEAD 256
+
+static int OUTPUT_FD = 1;
+static pthread_mutex_t OUTPUT_MUTEX = PTHREAD_MUTEX_INITIALIZER; 	/* Serialises write() */
+static pthread_mutex_t WRITERS_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static json_writer_t *WRITERS = NULL;
+static __thread json_writer_t *MY_WRITER = NULL;
+
+static const char HEX[] = "0123456789abcdef";
+
+void /* Write records to fd from now on */
+json_init (int fd)
+{
+	OUTPUT_FD = fd;
+}
+
+json_writer_t * /* A writer for one thread, or for records written under a lock of the caller */
+create_json_writer (void)
+{
+	json_writer_t *writer = (json_writer_t *)malloc(sizeof(json_writer_t));
+
+	if (writer == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	writer->length = 0;
+
+	pthread_mutex_lock(&WRITERS_MUTEX);
+	writer->next = WRITERS;
+	WRITERS = writer;
+	pthread_mutex_unlock(&WRITERS_MUTEX);
+
+	return writer;
+}
+
+json_writer_t * /* The calling thread's writer, created on first use */
+json_thread_writer (void)
+{
+	if (MY_WRITER == NULL)
+		MY_WRITER = create_json_writer();
+	return MY_WRITER;
+}
+
+void /* Write out the records in the writer's buffer */
+json_flush (json_writer_t *writer)
+{
+	size_t written = 0;
+	ssize_t n;
+
+	if (writer->length == 0)
+		return;
+
+	pthread_mutex_lock(&OUTPUT_MUTEX);
+	while (written < writer->length)
+	{
+		n = write(OUTPUT_FD, writer->data + written, writer->length - written);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+		{
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		written += n;
+	}
+	pthread_mutex_unlock(&OUTPUT_MUTEX);
+
+	writer->length = 0;
+}
+
+static void /* Make room for a record of up to length bytes */
+reserve (json_writer_t *writer, size_t length)
+{
+	if (writer->length + length > JSON_BUFFER_SIZE)
+		json_flush(writer);
+}
+
+static void
+append (json_writer_t *writer, const char *text, size_t length)
+{
+	memcpy(writer->data + writer->length, text, length);
+	writer->length += length;
+}
+
+static void
+append_number (json_writer_t *writer, long long value)
+{
+	char digits[24];
+	int n = 0;
+	unsigned long long u = (value < 0) ? -(unsigned long long)value : (unsigned long long)value;
+
+	do
+	{
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	if (value < 0)
+		writer->data[writer->length++] = '-';
+	while (n > 0)
+		writer->data[writer->length++] = digits[--n];
+}
+
+static void /* Append text[0 .. length) as a quoted JSON string */
+append_string (json_writer_t *writer, const char *text, size_t length)
+{
+	char *out = writer->data + writer->length;
+	unsigned char c;
+	size_t i;
+
+	*out++ = '"';
+	for (i = 0; i < length; i++)
+	{
+		c = (unsigned char)text[i];
+		if (c == '"' || c == '\\')
+		{
+			*out++ = '\\';
+			*out++ = c;
+		} else if (c == '\n')
+		{
+			*out++ = '\\';
+			*out++ = 'n';
+		} else if (c == '\t')
+		{
+			*out++ = '\\';
+			*out++ = 't';
+		} else if (c < 0x20 || c == 0x7f)
+		{
+			memcpy(out, "\\u00", 4);
+			out[4] = HEX[c >> 4];
+			out[5] = HEX[c & 0xf];
+			out += 6;
+		} else
+		{
+			*out++ = c;
+		}
+	}
+	*out++ = '"';
+	writer->length = out - writer->data;
+}
+
+static size_t
+path_length (const char *path_name)
+{
+	size_t length = strlen(path_name);
+
+	return (length > JSON_MAX_PATH) ? JSON_MAX_PATH : length;
+}
+
+void /* Record a searched file and its number of matching tokens */
+json_file (json_writer_t *writer, const char *path_name, long long count)
+{
+	size_t length = path_length(path_name);
+
+	reserve(writer, JSON_ESCAPE_MAX * length + JSON_RECORD_OVERHEAD);
+	append(writer, "{\"type\":\"file\",\"path\":", 22);
+	append_string(writer, path_name, length);
+	append(writer, ",\"matches\":", 11);
+	append_number(writer, count);
+	append(writer, "}\n", 2);
+}
+
+void /* Record a matching token at byte offset in the file */
+json_match (json_writer_t *writer, const char *path_name, long long offset, const char *token,
+		size_t token_length)
+{
+	size_t length = path_length(path_name);
+	bool truncated = (token_length > JSON_MAX_TOKEN);
+
+	if (truncated)
+		token_length = JSON_MAX_TOKEN;
+
+	reserve(writer, JSON_ESCAPE_MAX * (length + token_length) + JSON_RECORD_OVERHEAD);
+	append(writer, "{\"type\":\"match\",\"path\":", 23);
+	append_string(writer, path_name, length);
+	append(writer, ",\"offset\":", 10);
+	append_number(writer, offset);
+	append(writer, ",\"token\":", 9);
+	append_string(writer, token, token_length);
+	if (truncated)
+		append(writer, ",\"truncated\":true", 17);
+	append(writer, "}\n", 2);
+}
+
+void /* Record the totals of a search */
+json_summary (json_writer_t *writer, const json_summary_t *summary)
+{
+	size_t length = path_length(summary->pattern);
+	char seconds[32];
+	int n;
+
+	n = snprintf(seconds, sizeof(seconds), "%.6f", summary->seconds);
+	reserve(writer, JSON_ESCAPE_MAX * length + JSON_RECORD_OVERHEAD);
+	append(writer, "{\"type\":\"summary\",\"pattern\":", 28);
+	append_string(writer, summary->pattern, length);
+	append(writer, ",\"matches\":", 11);
+	append_number(writer, summary->matches);
+	append(writer, ",\"files_searched\":", 18);
+	append_number(writer, summary->files_searched);
+	append(writer, ",\"files_matched\":", 17);
+	append_number(writer, summary->files_matched);
+	append(writer, ",\"bytes_searched\":", 18);
+	append_number(writer, summary->bytes_searched);
+	append(writer, ",\"seconds\":", 11);
+	append(writer, seconds, n);
+	append(writer, "}\n", 2);
+}
+
+void /* Write out every writer's records. The threads using them must be idle. */
+json_flush_all (void)
+{
+	json_writer_t *writer;
+
+	pthread_mutex_lock(&WRITERS_MUTEX);
+	for (writer = WRITERS; writer != NULL; writer = writer->next)
+		json_flush(writer);
+	pthread_mutex_unlock(&WRITERS_MUTEX);
+}
+
+void /* Flush and free every writer */
+json_finish (void)
+{
+	json_writer_t *writer;
+
+	json_flush_all();
+	pthread_mutex_lock(&WRITERS_MUTEX);
+	while (WRITERS != NULL)
+	{
+		writer = WRITERS;
+		WRITERS = writer->next;
+		free(writer);
+	}
+	pthread_mutex_unlock(&WRITERS_MUTEX);
+	MY_WRITER = NULL;
+}
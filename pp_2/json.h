@@ -0,0 +1,53 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stddef.h>
+
+/* JSON Lines output: one JSON object per line, for other programs to consume.
+ *
+ *   {"type":"match","path":"a/b.c","offset":1234,"token":"foo"}
+ *   {"type":"file","path":"a/b.c","matches":3}
+ *   {"type":"summary","pattern":"foo","matches":3,"files_searched":10,...}
+ *
+ * Records are formatted straight into the writer's fixed buffer; nothing is allocated
+ * per record. Each thread gets a writer of its own from json_thread_writer(), so
+ * threads format side by side without sharing anything. A full buffer is written out
+ * with one write() under the output lock, and only whole records are ever in a
+ * buffer, so the records of different threads never interleave within a line.
+ *
+ * Strings are escaped as JSON requires; bytes of 0x80 and above are copied as they
+ * are, so paths and tokens are valid UTF-8 only if they were in the files. Tokens
+ * longer than JSON_MAX_TOKEN bytes are cut and the record gets "truncated":true.
+ */
+
+#define JSON_BUFFER_SIZE (64 * 1024)
+#define JSON_MAX_PATH 4096
+#define JSON_MAX_TOKEN 1024
+
+typedef struct json_writer_tag{
+	char data[JSON_BUFFER_SIZE];
+	size_t length;
+	struct json_writer_tag *next; 	/* All writers, for json_flush_all() */
+} json_writer_t;
+
+typedef struct json_summary_tag{
+	const char *pattern;
+	long long matches;
+	long long files_searched;
+	long long files_matched;
+	long long bytes_searched;
+	double seconds;
+} json_summary_t;
+
+/* Function definitions. */
+void json_init (int);
+json_writer_t *create_json_writer (void);
+json_writer_t *json_thread_writer (void);
+void json_file (json_writer_t *, const char *, long long);
+void json_match (json_writer_t *, const char *, long long, const char *, size_t);
+void json_summary (json_writer_t *, const json_summary_t *);
+void json_flush (json_writer_t *);
+void json_flush_all (void);
+void json_finish (void);
+
+#endif
@@ -0,0 +1,518 @@
+/* libminigrep: search contexts with their own worker pool.
+ *
+ * The thread calling minigrep_search() walks the tree depth-first and puts each
+ * regular file on the context's bounded queue; the pool threads take files off it and
+ * search them with the match kernel (or the DFA). The pool is started by
+ * create_minigrep() and sleeps between searches. A search is over once the walk has
+ * finished, the queue is empty and no worker is busy.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "libminigrep.h"
+#include "queue.h"
+#include "match.h"
+#include "dfa.h"
+#include "gzip.h"
+
+/* Read buffer of each worker, and the room kept in front of it for a partial token
+ * carried over from the previous read (as in mini_grep's search_file()) */
+#define MINIGREP_BUFFER_SIZE (64 * 1024)
+#define MINIGREP_CARRY_SIZE (16 * 1024)
+
+struct minigrep_tag
+{
+	char *pattern;
+	minigrep_options_t options;
+	match_delimiters_t delimiters;
+	dfa_t *dfa; 					/* NULL unless options.regex */
+
+	/* Files waiting to be searched: a ring of MINIGREP_QUEUE_SIZE paths */
+	char *queue[MINIGREP_QUEUE_SIZE];
+	int head;
+	int num_queued;
+	int num_busy; 				/* Workers searching a file */
+	bool shutdown;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_not_empty;
+	pthread_cond_t cond_not_full;
+	pthread_cond_t cond_idle;
+
+	pthread_t *threads;
+	pthread_mutex_t search_mutex; /* Held for the whole of a minigrep_search() */
+	const char *root; 			/* Root of the current walk, for anchored exclusions */
+
+	/* Result of the current (or last) search, updated under mutex */
+	long long total;
+	minigrep_stats_t stats;
+	int error; 					/* First MINIGREP_E* error of the search, or 0 (atomic) */
+};
+
+/* Passed through match_tokens() to the on_match callback */
+typedef struct token_arg_tag
+{
+	minigrep_t *search;
+	const char *path_name;
+	const char *start; 		/* Start of the chunk being matched ... */
+	long long offset; 		/* ... and its offset in the file */
+} token_arg_t;
+
+void
+minigrep_default_options (minigrep_options_t *options)
+{
+	memset(options, 0, sizeof(minigrep_options_t));
+	options->num_threads = 1;
+	options->delimiters = MATCH_DELIMITERS;
+	options->max_size = -1;
+	options->newer = -1;
+	options->older = -1;
+}
+
+static void /* Record the first error of the search, which minigrep_search() returns */
+fail (minigrep_t *search, int error)
+{
+	int none = 0;
+
+	__atomic_compare_exchange_n(&search->error, &none, error, false, __ATOMIC_RELAXED,
+			__ATOMIC_RELAXED);
+}
+
+static bool
+failed (minigrep_t *search)
+{
+	return __atomic_load_n(&search->error, __ATOMIC_RELAXED) != 0;
+}
+
+static void
+count_stat (minigrep_t *search, long long *counter, long long value)
+{
+	pthread_mutex_lock(&search->mutex);
+	*counter += value;
+	pthread_mutex_unlock(&search->mutex);
+}
+
+static void
+report_token (void *this_arg, const char *token, size_t length)
+{
+	token_arg_t *arg = (token_arg_t *)this_arg;
+
+	arg->search->options.on_match(arg->search->options.arg, arg->path_name,
+			arg->offset + (token - arg->start), token, length);
+}
+
+static int /* Number of matching tokens in buffer[0 .. length) */
+count_chunk (minigrep_t *search, token_arg_t *arg, const char *buffer, size_t length)
+{
+	match_token_fn token_fn = (search->options.on_match != NULL) ? report_token : NULL;
+
+	if (search->dfa != NULL)
+		return dfa_tokens(search->dfa, &search->delimiters, buffer, length, token_fn, arg);
+
+	return match_tokens(&search->delimiters, buffer, length, search->pattern,
+			search->options.ignore_case, token_fn, arg);
+}
+
+/* Search one regular file, calling the callbacks. Runs on a pool thread. */
+static long long
+search_file (minigrep_t *search, const char *path_name)
+{
+	char storage[MINIGREP_CARRY_SIZE + MINIGREP_BUFFER_SIZE];
+	char *buffer = storage + MINIGREP_CARRY_SIZE;
+	char *start;
+	size_t carry = 0; 		/* Bytes of a partial token kept in front of buffer */
+	size_t length, split;
+	token_arg_t arg;
+	gzip_reader_t gzip;
+	bool compressed = false;
+	long long count = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open(path_name, O_RDONLY);
+	if (fd == -1)
+	{
+		count_stat(search, &search->stats.errors, 1);
+		return 0;
+	}
+
+	n = read(fd, buffer, MINIGREP_BUFFER_SIZE);
+	if (n > 0 && search->options.decompress && gzip_is_compressed(buffer, n))
+	{
+		if (gzip_open(&gzip, fd, buffer, n) == -1)
+		{
+			close(fd);
+			fail(search, MINIGREP_ENOMEM);
+			return 0;
+		}
+		compressed = true;
+		n = gzip_read(&gzip, buffer, MINIGREP_BUFFER_SIZE);
+	}
+	if (n > 0 && !search->options.search_binary && match_is_binary(buffer, n))
+	{
+		if (compressed)
+			gzip_close(&gzip);
+		close(fd);
+		count_stat(search, &search->stats.binary_skipped, 1);
+		return 0;
+	}
+
+	arg.search = search;
+	arg.path_name = path_name;
+	arg.offset = 0;
+
+	while (1)
+	{
+		if (n == -1)
+		{
+			count_stat(search, &search->stats.errors, 1);
+			break;
+		}
+
+		start = buffer - carry;
+		length = carry + n;
+		split = (n == 0) ? length : match_split(&search->delimiters, start, length);
+		if (length - split > MINIGREP_CARRY_SIZE)
+			split = length; 	/* Token longer than the carry room: split it */
+
+		arg.start = start;
+		count += count_chunk(search, &arg, start, split);
+		arg.offset += split;
+
+		if (n == 0)
+			break;
+
+		carry = length - split;
+		memmove(buffer - carry, start + split, carry);
+
+		if (compressed)
+			n = gzip_read(&gzip, buffer, MINIGREP_BUFFER_SIZE);
+		else
+			n = read(fd, buffer, MINIGREP_BUFFER_SIZE);
+	}
+
+	if (compressed)
+		gzip_close(&gzip);
+	close(fd);
+
+	pthread_mutex_lock(&search->mutex);
+	search->stats.files_searched++;
+	search->stats.bytes_searched += arg.offset;
+	pthread_mutex_unlock(&search->mutex);
+
+	if (search->options.on_file != NULL)
+		search->options.on_file(search->options.arg, path_name, count);
+
+	return count;
+}
+
+static void *
+pool_thread (void *this_arg)
+{
+	minigrep_t *search = (minigrep_t *)this_arg;
+	char *path_name;
+	long long count;
+
+	pthread_mutex_lock(&search->mutex);
+	while (1)
+	{
+		while (search->num_queued == 0 && !search->shutdown)
+			pthread_cond_wait(&search->cond_not_empty, &search->mutex);
+		if (search->num_queued == 0)
+			break; 	/* Shut down */
+
+		path_name = search->queue[search->head];
+		search->head = (search->head + 1) % MINIGREP_QUEUE_SIZE;
+		search->num_queued--;
+		search->num_busy++;
+		pthread_cond_signal(&search->cond_not_full);
+		pthread_mutex_unlock(&search->mutex);
+
+		/* After an error the rest of the queue is only drained */
+		count = failed(search) ? 0 : search_file(search, path_name);
+		free(path_name);
+
+		pthread_mutex_lock(&search->mutex);
+		search->total += count;
+		search->num_busy--;
+		if (search->num_busy == 0 && search->num_queued == 0)
+			pthread_cond_broadcast(&search->cond_idle);
+	}
+	pthread_mutex_unlock(&search->mutex);
+
+	return NULL;
+}
+
+static void /* Hand a file to the pool, waiting while the queue is full */
+post_file (minigrep_t *search, const char *path_name)
+{
+	char *copy = strdup(path_name);
+
+	if (copy == NULL)
+	{
+		fail(search, MINIGREP_ENOMEM);
+		return;
+	}
+
+	pthread_mutex_lock(&search->mutex);
+	while (search->num_queued == MINIGREP_QUEUE_SIZE)
+		pthread_cond_wait(&search->cond_not_full, &search->mutex);
+	search->queue[(search->head + search->num_queued) % MINIGREP_QUEUE_SIZE] = copy;
+	search->num_queued++;
+	pthread_cond_signal(&search->cond_not_empty);
+	pthread_mutex_unlock(&search->mutex);
+}
+
+/* Returns true if a directory entry is excluded. Only stats when d_type is missing
+ * and a rule needs to know whether the entry is a directory. */
+static bool
+excluded (const minigrep_t *search, const char *parent, const struct dirent *entry)
+{
+	const exclude_t *exclude = search->options.exclude;
+	char path[2 * MAX_LENGTH];
+	struct stat file_stats;
+	bool is_dir;
+
+	if (exclude == NULL || exclude_is_empty(exclude))
+		return false;
+
+	is_dir = (entry->d_type == DT_DIR);
+	if (entry->d_type == DT_UNKNOWN && exclude_needs_type(exclude))
+	{
+		snprintf(path, sizeof(path), "%s/%s", parent, entry->d_name);
+		is_dir = (lstat(path, &file_stats) == 0 && S_ISDIR(file_stats.st_mode));
+	}
+
+	return exclude_match(exclude, search->root, parent, entry->d_name, is_dir);
+}
+
+static bool /* True if name has one of the extensions in the options, or none are given */
+wanted (const minigrep_t *search, const char *name)
+{
+	const char *dot = strrchr(name, '.');
+	int i;
+
+	if (search->options.num_extensions == 0)
+		return true;
+	if (dot == NULL)
+		return false;
+
+	for (i = 0; i < search->options.num_extensions; i++)
+	{
+		if (strcmp(dot + 1, search->options.extensions[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Walk path_name depth-first, posting the regular files that pass the filters.
+ * file_stats are path_name's, from lstat(), so links are not followed. Stops early
+ * once the search has failed. */
+static void
+walk (minigrep_t *search, const char *path_name, const struct stat *file_stats)
+{
+	char child[MAX_LENGTH];
+	struct stat child_stats;
+	struct dirent *entry;
+	DIR *directory;
+
+	if (S_ISDIR(file_stats->st_mode))
+	{
+		directory = opendir(path_name);
+		if (directory == NULL)
+		{
+			count_stat(search, &search->stats.errors, 1);
+			return;
+		}
+
+		while ((entry = readdir(directory)) != NULL && !failed(search))
+		{
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+			if (excluded(search, path_name, entry))
+				continue;
+			if (snprintf(child, sizeof(child), "%s/%s", path_name, entry->d_name)
+					>= (int)sizeof(child))
+			{
+				count_stat(search, &search->stats.errors, 1);
+				continue;
+			}
+			if (lstat(child, &child_stats) == -1)
+			{
+				count_stat(search, &search->stats.errors, 1);
+				continue;
+			}
+			walk(search, child, &child_stats);
+		}
+
+		closedir(directory);
+	} else if (S_ISREG(file_stats->st_mode)
+			&& file_stats->st_size >= search->options.min_size
+			&& (search->options.max_size < 0
+					|| file_stats->st_size <= search->options.max_size)
+			&& (search->options.newer < 0 || file_stats->st_mtime >= search->options.newer)
+			&& (search->options.older < 0 || file_stats->st_mtime < search->options.older)
+			&& wanted(search, strrchr(path_name, '/') != NULL ?
+					strrchr(path_name, '/') + 1 : path_name))
+	{
+		post_file(search, path_name);
+	}
+}
+
+/* Create a search context for pattern and start its worker pool. Returns NULL, with a
+ * message in error, if the options or the regular expression are invalid, or if
+ * memory or threads run out. */
+minigrep_t *
+create_minigrep (const char *pattern, const minigrep_options_t *options, char *error,
+		size_t error_size)
+{
+	minigrep_t *search;
+	int i, status;
+
+	if (options->num_threads < 1)
+	{
+		snprintf(error, error_size, "the thread pool needs at least one thread");
+		return NULL;
+	}
+
+	search = (minigrep_t *)calloc(1, sizeof(minigrep_t));
+	if (search == NULL)
+	{
+		snprintf(error, error_size, "out of memory");
+		return NULL;
+	}
+	search->options = *options;
+	search->pattern = strdup(pattern);
+	if (search->pattern == NULL)
+	{
+		snprintf(error, error_size, "out of memory");
+		free(search);
+		return NULL;
+	}
+	match_init_delimiters(&search->delimiters,
+			options->delimiters != NULL ? options->delimiters : MATCH_DELIMITERS);
+	search->options.delimiters = NULL; 	/* Not needed, and not ours to keep */
+
+	if (options->regex)
+	{
+		search->dfa = create_dfa(pattern, options->ignore_case, error, error_size);
+		if (search->dfa == NULL)
+		{
+			free(search->pattern);
+			free(search);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&search->mutex, NULL);
+	pthread_mutex_init(&search->search_mutex, NULL);
+	pthread_cond_init(&search->cond_not_empty, NULL);
+	pthread_cond_init(&search->cond_not_full, NULL);
+	pthread_cond_init(&search->cond_idle, NULL);
+
+	search->threads = (pthread_t *)malloc(options->num_threads * sizeof(pthread_t));
+	if (search->threads == NULL)
+	{
+		snprintf(error, error_size, "out of memory");
+		search->options.num_threads = 0;
+		free_minigrep(search);
+		return NULL;
+	}
+	for (i = 0; i < options->num_threads; i++)
+	{
+		status = pthread_create(&search->threads[i], NULL, pool_thread, (void *)search);
+		if (status != 0)
+		{
+			snprintf(error, error_size, "cannot start worker thread %d: %s", i,
+					strerror(status));
+			search->options.num_threads = i; 	/* free_minigrep() stops these */
+			free_minigrep(search);
+			return NULL;
+		}
+	}
+
+	return search;
+}
+
+/* Search path_name, a file or a directory tree, and return the number of matching
+ * tokens, or a MINIGREP_E* error. Blocks until every file is searched. The walk does
+ * not follow symbolic links, so a path_name that is one is refused rather than
+ * skipped without a word. */
+long long
+minigrep_search (minigrep_t *search, const char *path_name)
+{
+	struct stat file_stats;
+	long long total;
+
+	if (lstat(path_name, &file_stats) == -1)
+		return MINIGREP_ENOENT;
+	if (S_ISLNK(file_stats.st_mode))
+		return MINIGREP_ELINK;
+
+	pthread_mutex_lock(&search->search_mutex);
+
+	pthread_mutex_lock(&search->mutex);
+	search->total = 0;
+	memset(&search->stats, 0, sizeof(minigrep_stats_t));
+	search->error = 0;
+	pthread_mutex_unlock(&search->mutex);
+
+	search->root = path_name;
+	walk(search, path_name, &file_stats);
+
+	pthread_mutex_lock(&search->mutex);
+	while (search->num_queued > 0 || search->num_busy > 0)
+		pthread_cond_wait(&search->cond_idle, &search->mutex);
+	total = (search->error != 0) ? search->error : search->total;
+	pthread_mutex_unlock(&search->mutex);
+
+	pthread_mutex_unlock(&search->search_mutex);
+
+	return total;
+}
+
+void /* Statistics of the last search */
+minigrep_get_stats (minigrep_t *search, minigrep_stats_t *stats)
+{
+	pthread_mutex_lock(&search->mutex);
+	*stats = search->stats;
+	pthread_mutex_unlock(&search->mutex);
+}
+
+void /* Stop the pool and free the context. No search may be running. */
+free_minigrep (minigrep_t *search)
+{
+	int i;
+
+	if (search == NULL)
+		return;
+
+	pthread_mutex_lock(&search->mutex);
+	search->shutdown = true;
+	pthread_cond_broadcast(&search->cond_not_empty);
+	pthread_mutex_unlock(&search->mutex);
+
+	for (i = 0; i < search->options.num_threads; i++)
+		pthread_join(search->threads[i], NULL);
+
+	pthread_mutex_destroy(&search->mutex);
+	pthread_mutex_destroy(&search->search_mutex);
+	pthread_cond_destroy(&search->cond_not_empty);
+	pthread_cond_destroy(&search->cond_not_full);
+	pthread_cond_destroy(&search->cond_idle);
+	free_dfa(search->dfa);
+	free(search->threads);
+	free(search->pattern);
+	free(search);
+}
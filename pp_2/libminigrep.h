@@ -0,0 +1,86 @@
+#ifndef _LIBMINIGREP_H
+#define _LIBMINIGREP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "exclude.h"
+
+/* libminigrep: the search engine of mini_grep as a library.
+ *
+ * A search context holds everything one search needs: the compiled pattern, its
+ * delimiters, the filters, the callbacks and a pool of worker threads. Nothing is kept
+ * in globals, so any number of contexts can search at the same time in one process.
+ * A context runs one search at a time; minigrep_search() calls on the same context
+ * from several threads are serialised.
+ *
+ *   minigrep_options_t options;
+ *   minigrep_default_options(&options);
+ *   options.num_threads = 8;
+ *   options.on_file = print_count;
+ *   minigrep_t *search = create_minigrep("foo", &options, error, sizeof(error));
+ *   total = minigrep_search(search, "/usr/include");
+ *   free_minigrep(search);
+ *
+ * Nothing in the library exits the process: create_minigrep() returns NULL with a
+ * message, and minigrep_search() a negative MINIGREP_E* code, when something fails.
+ *
+ * The callbacks run on the worker threads, concurrently, and must be thread-safe.
+ * on_match gets each matching token of a file in order; on_file is called once per
+ * searched file, after its last on_match, with the number of matching tokens.
+ */
+
+/* Bounded queue of files waiting for the pool; the walk blocks while it is full */
+#define MINIGREP_QUEUE_SIZE 1024
+
+/* Errors returned by minigrep_search() */
+#define MINIGREP_ENOENT (-1) 		/* The path does not exist */
+#define MINIGREP_ENOMEM (-2) 		/* Out of memory; the search was abandoned */
+#define MINIGREP_ELINK (-3) 		/* The path is a symbolic link; links are not followed */
+
+typedef struct minigrep_tag minigrep_t;
+
+/* arg, path, byte offset of the token in the file, the token and its length. The
+ * token is not NUL-terminated and is only valid during the call. */
+typedef void (*minigrep_match_fn)(void *, const char *, long long, const char *, size_t);
+
+/* arg, path, number of matching tokens (also called for files without a match) */
+typedef void (*minigrep_file_fn)(void *, const char *, long long);
+
+typedef struct minigrep_options_tag
+{
+	int num_threads; 			/* Worker threads in the pool */
+	bool ignore_case; 		/* Ignore the case of ASCII letters */
+	bool regex; 				/* The pattern is a regular expression (see dfa.h) */
+	bool search_binary; 		/* Search files that look binary too */
+	bool decompress; 			/* Search inside gzip files (see gzip.h) */
+	const char *delimiters; 	/* Token delimiters; newline and NUL always are */
+	long long min_size; 		/* Only search files of min_size .. max_size bytes; */
+	long long max_size; 		/* -1 = no upper limit */
+	time_t newer; 				/* Only search files modified at or after newer and */
+	time_t older; 				/* before older; -1 = no limit */
+	char *const *extensions; 	/* Only search files with these extensions (no dot, */
+	int num_extensions; 		/* not copied); 0 = any file */
+	const exclude_t *exclude; /* Compiled exclusion rules, or NULL; not copied, so it
+										 * must outlive the context */
+	minigrep_match_fn on_match;
+	minigrep_file_fn on_file;
+	void *arg; 					/* Passed to the callbacks */
+} minigrep_options_t;
+
+typedef struct minigrep_stats_tag
+{
+	long long files_searched;
+	long long bytes_searched;
+	long long binary_skipped;
+	long long errors; 			/* Entries that could not be stat'ed, opened or read */
+} minigrep_stats_t;
+
+/* Function definitions. */
+void minigrep_default_options (minigrep_options_t *);
+minigrep_t *create_minigrep (const char *, const minigrep_options_t *, char *, size_t);
+long long minigrep_search (minigrep_t *, const char *);
+void minigrep_get_stats (minigrep_t *, minigrep_stats_t *);
+void free_minigrep (minigrep_t *);
+
+#endif
@@ -0,0 +1,421 @@
+/* Match kernel: counts the tokens of a buffer that contain the search string.
+ *
+ * Tokens are maximal runs of bytes that are not delimiters (MATCH_DELIMITERS or the
+ * set given to match_init_delimiters(), plus newline and NUL). Instead of splitting
+ * every token and calling strstr() on it, the buffer is scanned with memmem() for the
+ * search string; each hit is counted and the scan resumes after the end of the token
+ * that contains it, so a token is never counted twice.
+ *
+ * Token ends are found 32 bytes at a time. A byte b is classified as a delimiter with
+ * two 16-entry tables: it is one exactly when lo[b & 0xf] & hi[b >> 4] is nonzero.
+ * Each distinct set of low nibbles that occurs among the delimiters gets a bit; hi[h]
+ * holds the bit of the set belonging to high nibble h, and lo[l] the bits of all the
+ * sets containing l. With PSHUFB the two lookups cover 16 (SSSE3) or 32 (AVX2) bytes
+ * per instruction, and the result comes out of PMOVMSKB as a bitmask with one bit
+ * per byte. Delimiter sets needing more than 8 bits, and CPUs without SSSE3, use the
+ * 256-entry table instead.
+ *
+ * Author: William Anderson
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdbool.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATCH_X86
+#include <immintrin.h>
+#endif
+#include "match.h"
+
+static uint32_t /* Bit i set if p[i] is a delimiter, for 32 bytes */
+classify_table (const match_delimiters_t *delimiters, const char *p)
+{
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < 32; i++)
+		mask |= (uint32_t)delimiters->table[(unsigned char)p[i]] << i;
+	return mask;
+}
+
+#ifdef MATCH_X86
+__attribute__((target("ssse3"))) static uint32_t
+classify_ssse3 (const match_delimiters_t *delimiters, const char *p)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)delimiters->lo);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)delimiters->hi);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_loadu_si128((const __m128i *)p);
+	__m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+
+	a = _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(a, nibble)),
+			_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(a, 4), nibble)));
+	b = _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(b, nibble)),
+			_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(b, 4), nibble)));
+
+	return ~((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero))
+			| (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, zero)) << 16);
+}
+
+__attribute__((target("avx2"))) static uint32_t
+classify_avx2 (const match_delimiters_t *delimiters, const char *p)
+{
+	const __m256i lo = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *)delimiters->lo));
+	const __m256i hi = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *)delimiters->hi));
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i a = _mm256_loadu_si256((const __m256i *)p);
+
+	a = _mm256_and_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(a, nibble)),
+			_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(a, 4), nibble)));
+
+	return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, _mm256_setzero_si256()));
+}
+#endif
+
+/* Fill in delimiters to separate tokens at each character of chars (plus newline and
+ * NUL), and pick the fastest classifier the CPU supports. */
+void
+match_init_delimiters (match_delimiters_t *delimiters, const char *chars)
+{
+	uint16_t low_sets[8];
+	uint16_t low_set;
+	int num_sets = 0;
+	int c, h, i;
+
+	memset(delimiters, 0, sizeof(match_delimiters_t));
+	delimiters->table['\0'] = 1;
+	delimiters->table['\n'] = 1;
+	for (; *chars != '\0'; chars++)
+		delimiters->table[(unsigned char)*chars] = 1;
+	delimiters->classify = classify_table;
+	delimiters->classifier_name = "table";
+
+	/* Build the nibble tables, one bit per distinct set of low nibbles */
+	for (h = 0; h < 16; h++)
+	{
+		low_set = 0;
+		for (c = 0; c < 16; c++)
+		{
+			if (delimiters->table[h << 4 | c])
+				low_set |= 1 << c;
+		}
+		if (low_set == 0)
+			continue;
+
+		for (i = 0; i < num_sets && low_sets[i] != low_set; i++)
+			;
+		if (i == num_sets)
+		{
+			if (num_sets == 8)
+				return;
+			low_sets[num_sets++] = low_set;
+			for (c = 0; c < 16; c++)
+			{
+				if (low_set & (1 << c))
+					delimiters->lo[c] |= 1 << i;
+			}
+		}
+		delimiters->hi[h] = 1 << i;
+	}
+
+#ifdef MATCH_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		delimiters->classify = classify_avx2;
+		delimiters->classifier_name = "avx2";
+	} else if (__builtin_cpu_supports("ssse3"))
+	{
+		delimiters->classify = classify_ssse3;
+		delimiters->classifier_name = "ssse3";
+	}
+#endif
+}
+
+const char * /* "avx2", "ssse3" or "table" */
+match_classifier_name (const match_delimiters_t *delimiters)
+{
+	return delimiters->classifier_name;
+}
+
+const char * /* The first delimiter in [p .. end), or end. */
+match_next_delimiter (const match_delimiters_t *delimiters, const char *p,
+		const char *end)
+{
+	uint32_t mask;
+
+	while (end - p >= 32)
+	{
+		mask = delimiters->classify(delimiters, p);
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 32;
+	}
+
+	while (p < end && !match_is_delimiter(delimiters, *p))
+		p++;
+	return p;
+}
+
+/* The first byte in [p .. end) that is not a delimiter, or end */
+static const char *
+next_token (const match_delimiters_t *delimiters, const char *p, const char *end)
+{
+	uint32_t mask;
+
+	while (end - p >= 32)
+	{
+		mask = ~delimiters->classify(delimiters, p);
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		p += 32;
+	}
+
+	while (p < end && match_is_delimiter(delimiters, *p))
+		p++;
+	return p;
+}
+
+/* Case-insensitive search.
+ *
+ * Upper and lower case ASCII letters differ only in bit 0x20, and OR-ing 0x20 into a
+ * byte maps only 'A'..'Z' onto 'a'..'z'. So the search string is folded to lower case
+ * once, with fold[i] = 0x20 where it holds a letter and 0 elsewhere, and a byte c of
+ * the buffer matches position i exactly when (c | fold[i]) == folded[i]. The SSE2 loop
+ * applies this to the first and last byte of the search string at 16 candidate
+ * positions per step, and only verifies the candidates whose first and last bytes
+ * both match; the buffer itself is never lower-cased. */
+
+static inline bool
+equal_nocase (const char *s, const unsigned char *folded, const unsigned char *fold,
+		size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		if (((unsigned char)s[i] | fold[i]) != folded[i])
+			return false;
+	}
+	return true;
+}
+
+static const char * /* First case-insensitive occurrence of the folded string in [p .. end). */
+find_nocase (const char *p, const char *end, const unsigned char *folded,
+		const unsigned char *fold, size_t length)
+{
+#ifdef __SSE2__
+	const __m128i first = _mm_set1_epi8((char)folded[0]);
+	const __m128i first_fold = _mm_set1_epi8((char)fold[0]);
+	const __m128i last = _mm_set1_epi8((char)folded[length - 1]);
+	const __m128i last_fold = _mm_set1_epi8((char)fold[length - 1]);
+	__m128i a, b;
+	unsigned int mask;
+	int bit;
+
+	while (end - p >= (ptrdiff_t)(length - 1 + 16))
+	{
+		a = _mm_loadu_si128((const __m128i *)p);
+		b = _mm_loadu_si128((const __m128i *)(p + length - 1));
+		a = _mm_cmpeq_epi8(_mm_or_si128(a, first_fold), first);
+		b = _mm_cmpeq_epi8(_mm_or_si128(b, last_fold), last);
+		mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+
+		while (mask != 0)
+		{
+			bit = __builtin_ctz(mask);
+			if (length <= 2
+					|| equal_nocase(p + bit + 1, folded + 1, fold + 1, length - 2))
+				return p + bit;
+			mask &= mask - 1;
+		}
+		p += 16;
+	}
+#endif
+
+	for (; end - p >= (ptrdiff_t)length; p++)
+	{
+		if (equal_nocase(p, folded, fold, length))
+			return p;
+	}
+	return NULL;
+}
+
+/* Shared by match_count(), match_count_nocase() and match_tokens(). Inlined into each,
+ * so the plain counts pay nothing for the callback. */
+static inline __attribute__((always_inline)) int
+count_tokens (const match_delimiters_t *delimiters, const char *buffer, size_t length,
+		const char *search_string, bool ignore_case, match_token_fn token_fn, void *arg)
+{
+	size_t search_length = strlen(search_string);
+	const char *end = buffer + length;
+	const char *p = buffer;
+	const char *start;
+	int count = 0;
+	size_t i;
+
+	if (search_length == 0)
+	{
+		/* The empty string is found in every token */
+		while (p < end)
+		{
+			p = next_token(delimiters, p, end);
+			if (p == end)
+				break;
+			count++;
+			start = p;
+			p = match_next_delimiter(delimiters, p, end);
+			if (token_fn != NULL)
+				token_fn(arg, start, p - start);
+		}
+		return count;
+	}
+
+	unsigned char folded[search_length], fold[search_length];
+
+	/* A token never contains a delimiter, so neither can a match. Ignoring case, a
+	 * letter whose other case is a delimiter only matches in the case that is not */
+	for (i = 0; i < search_length; i++)
+	{
+		folded[i] = (unsigned char)search_string[i];
+		fold[i] = 0;
+		if (ignore_case && (folded[i] | 0x20) >= 'a' && (folded[i] | 0x20) <= 'z')
+		{
+			if (match_is_delimiter(delimiters, (char)(folded[i] | 0x20)))
+				folded[i] &= ~0x20;
+			else if (match_is_delimiter(delimiters, (char)(folded[i] & ~0x20)))
+				folded[i] |= 0x20;
+			else
+			{
+				folded[i] |= 0x20;
+				fold[i] = 0x20;
+			}
+		}
+
+		if (match_is_delimiter(delimiters, (char)folded[i]))
+			return 0;
+	}
+
+	while (p < end)
+	{
+		if (ignore_case)
+			p = find_nocase(p, end, folded, fold, search_length);
+		else
+			p = memmem(p, end - p, search_string, search_length);
+		if (p == NULL)
+			break;
+		count++;
+
+		/* Skip the rest of this token */
+		start = p;
+		p = match_next_delimiter(delimiters, p + search_length, end);
+
+		if (token_fn != NULL)
+		{
+			while (start > buffer && !match_is_delimiter(delimiters, start[-1]))
+				start--;
+			token_fn(arg, start, p - start);
+		}
+	}
+
+	return count;
+}
+
+int /* Number of tokens in buffer[0 .. length) containing search_string. */
+match_count (const match_delimiters_t *delimiters, const char *buffer, size_t length,
+		const char *search_string)
+{
+	return count_tokens(delimiters, buffer, length, search_string, false, NULL, NULL);
+}
+
+int /* As match_count(), ignoring the case of ASCII letters. */
+match_count_nocase (const match_delimiters_t *delimiters, const char *buffer,
+		size_t length, const char *search_string)
+{
+	return count_tokens(delimiters, buffer, length, search_string, true, NULL, NULL);
+}
+
+/* As match_count() (match_count_nocase() if ignore_case), also calling
+ * token_fn(arg, token, token_length) for each token counted, in buffer order. */
+int
+match_tokens (const match_delimiters_t *delimiters, const char *buffer, size_t length,
+		const char *search_string, bool ignore_case, match_token_fn token_fn, void *arg)
+{
+	return count_tokens(delimiters, buffer, length, search_string, ignore_case,
+			token_fn, arg);
+}
+
+/* Returns true if the first block of a file looks binary: it starts with the magic
+ * number of a common binary format, or has a NUL byte in its first MATCH_SNIFF_SIZE
+ * bytes (the heuristic used by grep and git). */
+bool
+match_is_binary (const char *buffer, size_t length)
+{
+	static const struct
+	{
+		const char *magic;
+		size_t length;
+	} formats[] = {
+		{ "\x7f" "ELF", 4 }, 			/* ELF executables and objects */
+		{ "\x89" "PNG", 4 },
+		{ "\xff\xd8\xff", 3 }, 		/* JPEG */
+		{ "GIF8", 4 },
+		{ "%PDF-", 5 },
+		{ "PK\x03\x04", 4 }, 			/* Zip, jar, docx */
+		{ "\x1f\x8b", 2 }, 				/* gzip */
+		{ "\xfd" "7zXZ", 5 }, 			/* xz */
+		{ "\x28\xb5\x2f\xfd", 4 }, 	/* zstd */
+		{ "7z\xbc\xaf\x27\x1c", 6 },
+		{ "!<arch>\n", 8 }, 				/* ar archives, static libraries */
+		{ "\xca\xfe\xba\xbe", 4 }, 	/* Java class, Mach-O universal */
+		{ "\xcf\xfa\xed\xfe", 4 }, 	/* Mach-O 64-bit */
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+	{
+		if (length >= formats[i].length
+				&& memcmp(buffer, formats[i].magic, formats[i].length) == 0)
+			return true;
+	}
+
+	if (length > MATCH_SNIFF_SIZE)
+		length = MATCH_SNIFF_SIZE;
+
+	return memchr(buffer, '\0', length) != NULL;
+}
+
+/* Length of the longest prefix of buffer that ends on a token boundary. The remaining
+ * bytes hold a token that may continue in the next chunk of the file and should be
+ * carried over. Returns length if no delimiter is found (the token is split). */
+size_t
+match_split (const match_delimiters_t *delimiters, const char *buffer, size_t length)
+{
+	size_t i = length;
+	uint32_t mask;
+
+	/* The last delimiter of each 32-byte block is its highest mask bit */
+	while (i >= 32)
+	{
+		mask = delimiters->classify(delimiters, buffer + i - 32);
+		if (mask != 0)
+			return i - 32 + (32 - __builtin_clz(mask));
+		i -= 32;
+	}
+
+	while (i > 0)
+	{
+		if (match_is_delimiter(delimiters, buffer[i - 1]))
+			return i;
+		i--;
+	}
+
+	return length;
+}
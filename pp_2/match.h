@@ -0,0 +1,48 @@
+#ifndef _MATCH_H
+#define _MATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Default characters that separate tokens. A token is counted once if it contains the
+ * search string, as with the original strtok()/strstr() loop over fgets() lines.
+ * Newline and NUL always separate tokens as well. */
+#define MATCH_DELIMITERS " ,.-"
+
+/* A set of delimiters and the classifier chosen for it, filled in by
+ * match_init_delimiters(). It is only read while searching, so one set can be shared
+ * by any number of threads, and searches with different sets can run side by side. */
+typedef struct match_delimiters_tag
+{
+	unsigned char table[256]; 	/* Nonzero for the bytes that end a token */
+	unsigned char lo[16]; 			/* Nibble tables for the PSHUFB classifiers */
+	unsigned char hi[16];
+	uint32_t (*classify)(const struct match_delimiters_tag *, const char *);
+	const char *classifier_name;
+} match_delimiters_t;
+
+static inline bool
+match_is_delimiter (const match_delimiters_t *delimiters, char c)
+{
+	return delimiters->table[(unsigned char)c];
+}
+
+/* Called by match_tokens() with each token that contains a match */
+typedef void (*match_token_fn)(void *, const char *, size_t);
+
+/* Number of leading bytes checked for NUL by match_is_binary() */
+#define MATCH_SNIFF_SIZE 8192
+
+/* Function definitions. */
+void match_init_delimiters (match_delimiters_t *, const char *);
+const char *match_classifier_name (const match_delimiters_t *);
+const char *match_next_delimiter (const match_delimiters_t *, const char *, const char *);
+int match_count (const match_delimiters_t *, const char *, size_t, const char *);
+int match_count_nocase (const match_delimiters_t *, const char *, size_t, const char *);
+int match_tokens (const match_delimiters_t *, const char *, size_t, const char *, bool,
+		match_token_fn, void *);
+size_t match_split (const match_delimiters_t *, const char *, size_t);
+bool match_is_binary (const char *, size_t);
+
+#endif
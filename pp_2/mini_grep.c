@@ -16,53 +16,335 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <sys/types.h>
+#include <sys/sysmacros.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <string.h>
 #include <semaphore.h>
 #include <pthread.h>
 #include <signal.h>
+#include <errno.h>
 #include "queue.h"
-
-/* Max elements for elements[] array in to add to each thread, would use another queue instead,
- * in future */
-#define MAX_ELEMENTS_Q 4096
+#include "exclude.h"
+#include "dedup.h"
+#include "match.h"
+#include "dfa.h"
+#include "libminigrep.h"
+#include "shard.h"
+#include "gzip.h"
+#include "reorder.h"
+#include "cold.h"
+#include "throttle.h"
+#include "tune.h"
+#include "json.h"
+
+/* Default cap on the entries held by each breadth-first traversal queue (--max-frontier) */
+#define DEFAULT_MAX_FRONTIER 16384
+
+/* Size of the read buffer used by search_file(), and the room kept in front of it for
+ * a partial token carried over from the previous read. Reads always go to an aligned
+ * address so the same loop works with O_DIRECT. */
+#define SEARCH_BUFFER_SIZE (64 * 1024)
+#define SEARCH_CARRY_SIZE (16 * 1024)
+
+/* Per-thread result blocks are padded to this size so that no two share a cache line */
+#define CACHE_LINE_SIZE 64
+
+/* Pipeline mode buffer pool: buffer size and carry room, as for search_file() */
+#define PIPELINE_BUFFER_SIZE (1024 * 1024)
+#define PIPELINE_CARRY_SIZE (16 * 1024)
+
+/* Burst allowance of the throttles, in seconds worth of their rate */
+#define THROTTLE_BURST_SECONDS 0.05
+
+/* Linux I/O priority, see ioprio_set(2); glibc has no wrapper */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+/* Max files waiting in the shared queue when paths are streamed in; bounds memory use.
+ * With per-device queues the bound applies to each device. */
+#define MAX_QUEUED_FILES 4096
+
+/* Devices with their own queue in the shared scheduler; further devices share the last */
+#define MAX_DEVICES 64
 
 typedef struct args_for_thread_t
 {
 	int threadID; // thread ID
-	queue_element_t* elements[MAX_ELEMENTS_Q];
+	queue_element_t** elements;	// num_elements seed entries, freed by the thread
 	int num_elements;
 	char* search_string;
 } ARGS_FOR_THREAD;
 
-typedef struct SHARED_t
+/* Files waiting in the shared scheduler for one device (st_dev) */
+typedef struct DEVICE_t
 {
+	dev_t dev;
 	queue_t* queue_files;
-	int count;
+	int num_files;
+	int active;				// Files taken from this device and not yet released
+	int peak_active;
+	long long files_taken;
+	pthread_cond_t cond_not_full;
+} DEVICE_t;
 
+typedef struct SHARED_t
+{
+	queue_t* queue_files;	// Used by dynamic load balancing, through SHARED_insert_*
+	int count;
+	int num_files;			// Files queued (maintained by the SHARED_* functions)
+	bool done;				// No more files will be inserted
+	long long next_seq;		// Sequence number of the next file removed
+	pthread_cond_t cond_not_empty;
+	pthread_cond_t cond_not_full;
+
+	/* SHARED_put and SHARED_get queue files per device when by_device is set, and
+	 * take them round-robin from the devices with fewer than DEVICE_LIMIT files being
+	 * searched; otherwise everything goes through devices[0] in FIFO order. */
+	bool by_device;
+	DEVICE_t devices[MAX_DEVICES];
+	int num_devices;
+	int next_device;		// Where the round-robin resumes
 } SHARED_t;
 
-int serial_search(char **);
-int parallel_search_static(char **);
-int parallel_search_dynamic(char **);
+/* --json: per-match and per-file records, or per-file records only (--json=files) */
+typedef enum JSON_MODE_t
+{
+	JSON_OFF,
+	JSON_FILES,
+	JSON_MATCHES
+} JSON_MODE_t;
+
+/* Passed through match_tokens() and dfa_tokens() to json_match_token() */
+typedef struct JSON_MATCH_t
+{
+	json_writer_t* writer;
+	const char* path_name;
+	const char* buffer;
+	long long offset;		// Position of buffer in the file
+} JSON_MATCH_t;
+
+/* Workers of the streaming mode. With num-threads "auto" the tuner thread starts more
+ * of them while the main thread walks; without it all are started up front. */
+typedef struct STREAM_t
+{
+	pthread_t* threads;
+	ARGS_FOR_THREAD** args;
+	int num_started;		// Workers created so far; only ever grows
+	bool done;				// The walk has finished (atomic)
+	char* search_string;
+} STREAM_t;
+
+/* A file being read by the pipeline mode; freed when its last buffer is searched */
+typedef struct PIPELINE_FILE_t
+{
+	char path_name[MAX_LENGTH];
+	dedup_key_t key;
+	long long count;		// Matches found so far
+	int refs;				// Buffers in flight, plus one while the file is being read
+	long long seq;			// Traversal order, for --ordered
+} PIPELINE_FILE_t;
+
+typedef struct PIPELINE_BUFFER_t
+{
+	char* data;				// PIPELINE_BUFFER_SIZE bytes, COLD_ALIGN aligned, preceded
+							// by PIPELINE_CARRY_SIZE bytes of carry room
+	char* start;			// Start of the bytes to search (data minus the carry)
+	size_t length;
+	long long offset;		// Position of start in the file, for --json
+	PIPELINE_FILE_t* file;
+	struct PIPELINE_BUFFER_t* next;
+} PIPELINE_BUFFER_t;
+
+typedef struct PIPELINE_t
+{
+	PIPELINE_BUFFER_t* buffers;
+	int num_buffers;
+	PIPELINE_BUFFER_t* free_list;
+	PIPELINE_BUFFER_t* filled_head;
+	PIPELINE_BUFFER_t* filled_tail;
+	int io_running;			// I/O threads that have not finished yet
+	int num_filled;			// Buffers waiting for a search thread
+	const char* search_string;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_free;
+	pthread_cond_t cond_filled;
+} PIPELINE_t;
+
+/* Coverage counters, updated atomically by all threads */
+typedef struct PROGRESS_t
+{
+	long long files_searched;
+	long long bytes_searched;
+	long long files_skipped;	// Regular files not searched because of the deadline
+	long long bytes_skipped;
+	long long dirs_skipped;		// Directories not visited because of the deadline
+	long long binary_skipped;	// Files skipped as binary
+	long long depth_first;		// Entries walked depth-first because a queue was full
+	long long mtime_skipped;	// Files outside the --newer/--older range
+	long long files_found;		// Files accepted by a walk, searched or not yet
+	long long bytes_found;
+	long long decompressed;		// gzip files searched with --decompress
+	long long compressed_bytes;	// and their size on disk
+	long long files_matched;	// Files with at least one match
+	long long max_file_count;	// Most matches in a single file
+} PROGRESS_t;
+
+/* Results of one worker thread, on cache lines of its own so that threads counting
+ * side by side never write to the same line. Only the owner writes its block, with
+ * relaxed atomic stores (plain moves); the progress reporter reads the blocks
+ * lock-free, and they are merged into PROGRESS once, after the threads are joined. */
+typedef struct THREAD_STATS_t
+{
+	long long occurrences;
+	long long files_searched;
+	long long bytes_searched;
+	long long files_matched;
+	long long max_file_count;
+} __attribute__((aligned(CACHE_LINE_SIZE))) THREAD_STATS_t;
+
+long long serial_search(char **);
+long long parallel_search_static(char **);
+long long parallel_search_dynamic(char **);
+long long parallel_search_stream(char **);
+long long parallel_search_pipeline(char **);
 
 /* Set VERBOSE to "true" to enable verbose output, or use last command line argument*/
 static volatile bool VERBOSE = true;
 
-static int* RESULTS;
+/* Result blocks of the worker threads of the current search, and the calling
+ * thread's own block (NULL outside worker threads) */
+static THREAD_STATS_t* THREAD_STATS = NULL;
+static int NUM_THREAD_STATS = 0;
+static __thread THREAD_STATS_t* MY_STATS = NULL;
+/* Blocks of earlier searches, kept until search_cleanup() */
+static THREAD_STATS_t** RETIRED_STATS = NULL;
+static int NUM_RETIRED_STATS = 0;
 pthread_mutex_t mutex_shared = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t mutex_file = PTHREAD_MUTEX_INITIALIZER;
 static SHARED_t SHARED;
 
+/* Exclusion rules, compiled once in main() and read-only while searching */
+static exclude_t* EXCLUDE = NULL;
+
+/* Content-hash deduplication, enabled by --dedup or --dedup-cache */
+static dedup_t* DEDUP = NULL;
+
+/* Cold-scan mode, set by --cold */
+static cold_mode_t COLD_MODE = COLD_OFF;
+
+/* Read bandwidth and file rate limits shared by all threads, set by --max-bytes-per-sec
+ * and --max-files-per-sec. They cover the modes that search in this process's threads;
+ * pool and sharded refuse them. */
+static throttle_t THROTTLE_BYTES;
+static throttle_t THROTTLE_FILES;
+
+/* --deadline: seconds allowed per search (0 = none), and when the current one ends */
+static double DEADLINE = 0;
+static struct timespec DEADLINE_AT;
+static volatile bool DEADLINE_EXPIRED = false;
+static PROGRESS_t PROGRESS;
+
+/* Progress reports: every PROGRESS_INTERVAL seconds with --progress (0 = only on
+ * SIGUSR1), measured from PROGRESS_START_NS, the start of the current search */
+static double PROGRESS_INTERVAL = 0;
+static long long PROGRESS_START_NS = 0;
+
+/* Match kernel: match_count, match_count_nocase with --ignore-case, or regex_count
+ * with --regex, which uses the DFA compiled from the search string. DELIMITERS holds
+ * the token delimiters (--delimiters). */
+static int (*MATCH_COUNT)(const match_delimiters_t*, const char*, size_t, const char*)
+		= match_count;
+static dfa_t* DFA = NULL;
+static match_delimiters_t DELIMITERS;
+
+/* Options for the libminigrep context of the pool mode, filled in from the command line */
+static minigrep_options_t LIBRARY_OPTIONS;
+
+/* Sharded mode: in a worker process, the connection files are reported on (NULL in
+ * the coordinator and the other modes); --shard-fail-after, for testing reassignment */
+static shard_worker_t* SHARD_WORKER = NULL;
+static int SHARD_FAIL_AFTER = 0;
+static shard_stats_t SHARD_STATS;
+
+/* File filters: search binary files too (--binary), only files with these extensions
+ * (--ext), and only files within a size range (--min-size, --max-size; -1 = no limit) */
+static bool SEARCH_BINARY = false;
+
+/* --decompress: search inside gzip files, decompressing them as they are read */
+static bool DECOMPRESS = false;
+static char** EXTENSIONS = NULL;
+static int NUM_EXTENSIONS = 0;
+static long long MIN_SIZE = 0;
+static long long MAX_SIZE = -1;
+
+/* --newer, --older: only search files modified at or after NEWER and before OLDER
+ * (-1 = no limit). When either is given, dynamic mode searches the newest files first. */
+static time_t NEWER = -1;
+static time_t OLDER = -1;
+
+/* Pipeline mode: number of I/O threads and pool buffers (0 selects a default) */
+static int IO_THREADS = 2;
+static int NUM_BUFFERS = 0;
+static PIPELINE_t PIPELINE;
+
+/* Bounded traversal: entries each breadth-first queue may hold (0 = no limit) */
+static int MAX_FRONTIER = DEFAULT_MAX_FRONTIER;
+
+/* num-threads "auto": the streaming workers are tuned by TUNE while they search (see
+ * tune.h); AUTO_TUNING is set while a search uses it. The pool and sharded modes cannot
+ * change their thread count and get AUTO_THREADS_ARG, one per online CPU, as
+ * num-threads instead (AUTO_FIXED). --pin pins the worker threads to cores or NUMA
+ * nodes. */
+static bool AUTO_THREADS = false;
+static bool AUTO_TUNING = false;
+static bool AUTO_FIXED = false;
+static tune_t TUNE;
+static char AUTO_THREADS_ARG[16];
+static tune_pin_t PIN_MODE = TUNE_PIN_NONE;
+
+/* Roots of the search: the path argument, then each --root. With several roots, or
+ * with --per-device, the shared scheduler keeps a queue per device and searches at
+ * most DEVICE_LIMIT files of one device at a time (0 = no limit). */
+static char** ROOTS = NULL;
+static int NUM_ROOTS = 0;
+static int DEVICE_LIMIT = 0;
+
+/* --ordered: per-file results are printed in traversal order through REORDER */
+static bool ORDERED = false;
+static reorder_t REORDER;
+
+/* --json: records go to the original stdout through per-thread writers (see json.h),
+ * and everything else is printed to stderr. With --ordered the reorder buffer writes
+ * the file records through ORDERED_JSON, under its lock. */
+static JSON_MODE_t JSON_MODE = JSON_OFF;
+static json_writer_t* ORDERED_JSON = NULL;
+
 void SHARED_init()
 {
 	pthread_mutex_lock(&mutex_shared);
 
 	SHARED.queue_files = create_queue();
+	SHARED.num_files = 0;
+	SHARED.done = false;
+	SHARED.next_seq = 0;
+	pthread_cond_init(&SHARED.cond_not_empty, NULL);
+	pthread_cond_init(&SHARED.cond_not_full, NULL);
+
+	/* --ordered needs the files in traversal order, so it keeps a single queue */
+	SHARED.by_device = !ORDERED && (NUM_ROOTS > 1 || DEVICE_LIMIT > 0);
+	SHARED.num_devices = 0;
+	SHARED.next_device = 0;
 
 	pthread_mutex_unlock(&mutex_shared);
 }
@@ -71,644 +353,1175 @@ void SHARED_insert_file_element(queue_element_t* el)
 {
 	pthread_mutex_lock(&mutex_shared);
 	insert_element(SHARED.queue_files, el);
+	SHARED.num_files++;
 	pthread_mutex_unlock(&mutex_shared);
 }
 
-int /* Serial search of the file system starting from the specified path name. */
-serial_search(char **argv)
+/* Index of the device queue for dev, created on first use. Call with mutex_shared held. */
+int SHARED_device(dev_t dev)
 {
-	int num_occurrences = 0;
-	queue_element_t *element, *new_element;
-	struct stat file_stats;
-	int status;
-	DIR *directory = NULL;
-	struct dirent *result = NULL;
-	struct dirent *entry = (struct dirent *)malloc(
-			sizeof(struct dirent) + MAX_LENGTH);
+	DEVICE_t* device;
+	int d;
 
-	queue_t *queue = create_queue(); /* Create and initialize the queue data structure. */
-	element = (queue_element_t *)malloc(sizeof(queue_element_t));
-	if (element == NULL)
+	if (!SHARED.by_device)
+		dev = 0;
+	for (d = 0; d < SHARED.num_devices; d++)
 	{
-		perror("malloc");
-		exit( EXIT_FAILURE);
+		if (SHARED.devices[d].dev == dev)
+			return d;
 	}
+	if (SHARED.num_devices == MAX_DEVICES)
+		return MAX_DEVICES - 1;
+
+	device = &SHARED.devices[SHARED.num_devices];
+	device->dev = dev;
+	device->queue_files = create_queue();
+	device->num_files = 0;
+	device->active = 0;
+	device->peak_active = 0;
+	device->files_taken = 0;
+	pthread_cond_init(&device->cond_not_full, NULL);
+	return SHARED.num_devices++;
+}
 
-	strcpy(element->path_name, argv[2]); /* Copy the initial path name */
-	element->next = NULL;
-	insert_element(queue, element); /* Insert the initial path name into the queue. */
-
-	while (queue->head != NULL)
-	{ /* While there is work in the queue, process it. */
-		queue_element_t *element = remove_element(queue);
-
-		/* Obtain information about the file. */
-		status = lstat(element->path_name, &file_stats);
-		if (status == -1)
-		{
-			printf("Error obtaining stats for %s \n", element->path_name);
-			free((void *)element);
-			continue;
-		}
-
-		if (S_ISLNK(file_stats.st_mode))
-		{ 	/* Ignore symbolic links. */
-		} else if (S_ISDIR(file_stats.st_mode))
-		{ 	/* If directory, descend in and post work to queue. */
-			if (VERBOSE)
-			{
-				printf("%s is a directory. \n", element->path_name);
-			}
-			directory = opendir(element->path_name);
-			if (directory == NULL)
-			{
-				printf("Unable to open directory %s \n", element->path_name);
-				continue;
-			}
-
-			while (1)
-			{
-				status = readdir_r(directory, entry, &result); /* Read directory entry. */
-				if (status != 0)
-				{
-					printf("Unable to read directory %s \n",
-							element->path_name);
-					break;
-				}
-				if (result == NULL) /* End of directory. */
-					break;
+/* Insert a file, blocking while its device queue holds MAX_QUEUED_FILES elements. A
+ * walk stuck behind a slow device holds up only its own device. */
+void SHARED_put_file_element(queue_element_t* el)
+{
+	DEVICE_t* device;
 
-				if (strcmp(entry->d_name, ".") == 0) /* Ignore the "." and ".." entries. */
-					continue;
+	pthread_mutex_lock(&mutex_shared);
+	device = &SHARED.devices[SHARED_device(el->dev)];
+	while (device->num_files >= MAX_QUEUED_FILES)
+		pthread_cond_wait(&device->cond_not_full, &mutex_shared);
+
+	insert_element(device->queue_files, el);
+	device->num_files++;
+	SHARED.num_files++;
+	pthread_cond_signal(&SHARED.cond_not_empty);
+	pthread_mutex_unlock(&mutex_shared);
+}
 
-				if (strcmp(entry->d_name, "..") == 0)
-					continue;
+/* Let go of the device of the caller's last file. Call with mutex_shared held. */
+void SHARED_release_device_locked(int* device)
+{
+	if (*device < 0)
+		return;
 
-				/* Insert this directory entry in the queue. */
-				new_element = (queue_element_t *)malloc(
-						sizeof(queue_element_t));
-				if (new_element == NULL)
-				{
-					perror("malloc");
-					exit(EXIT_FAILURE);
-				}
+	SHARED.devices[*device].active--;
+	if (SHARED.devices[*device].num_files > 0)
+		pthread_cond_signal(&SHARED.cond_not_empty); /* A slot opened up */
+	*device = -1;
+}
 
-				/* Construct the full path name for the directory item stored in entry. */
-				strcpy(new_element->path_name, element->path_name);
-				strcat(new_element->path_name, "/");
-				strcat(new_element->path_name, entry->d_name);
-				insert_element(queue, new_element);
-			}
+/* Let go of the device of the last file taken, when no more files will be taken */
+void SHARED_release_device(int* device)
+{
+	pthread_mutex_lock(&mutex_shared);
+	SHARED_release_device_locked(device);
+	pthread_mutex_unlock(&mutex_shared);
+}
 
-			closedir(directory);
-		} else if (S_ISREG(file_stats.st_mode))
-		{ 	/* Directory entry is a regular file. */
-			if (VERBOSE)
-			{
-				printf("%s is a regular file. \n", element->path_name);
-			}
-			FILE *file_to_search;
-			char buffer[MAX_LENGTH];
-			char *bufptr, *searchptr, *tokenptr;
+/* Remove a file, blocking while no device has both a file waiting and room under
+ * DEVICE_LIMIT, and store its sequence number in seq. *device is the device of the
+ * caller's previous file, or -1; it is released first and set to the device of the
+ * file returned. Returns NULL once the queue is empty and SHARED_finish() has been
+ * called. */
+queue_element_t* SHARED_get_file_element(long long* seq, int* device)
+{
+	queue_element_t* el = NULL;
+	DEVICE_t* from;
+	int d = 0, i;
 
-			/* Search the file for the search string provided as the command-line argument. */
-			file_to_search = fopen(element->path_name, "r");
-			if (file_to_search == NULL)
-			{
-				printf("Unable to open file %s \n", element->path_name);
-				continue;
-			} else
-			{
-				while (1)
-				{
-					bufptr = fgets(buffer, sizeof(buffer), file_to_search); /* Read in a line from the file. */
-					if (bufptr == NULL)
-					{
-						if (feof(file_to_search))
-							break;
-						if (ferror(file_to_search))
-						{
-							printf("Error reading file %s \n",
-									element->path_name);
-							break;
-						}
-					}
-					/* Break up line into tokens and search each token. */
-					tokenptr = strtok(buffer, " ,.-");
-					while (tokenptr != NULL)
-					{
-						searchptr = strstr(tokenptr, argv[1]);
-						if (searchptr != NULL)
-						{
-							if (VERBOSE)
-							{
-								printf(
-										"Found string %s within \
-                                    file %s. \n",
-										argv[1], element->path_name);
-							}
-							num_occurrences++;
-						}
-						tokenptr = strtok(NULL, " ,.-"); /* Get next token from the line. */
-					}
-				}
-			}
+	pthread_mutex_lock(&mutex_shared);
+	SHARED_release_device_locked(device);
 
-			fclose(file_to_search);
-		} else
+	while (1)
+	{
+		for (i = 0; i < SHARED.num_devices; i++)
 		{
-			if (VERBOSE)
-			{
-				printf("%s is of type other. \n", element->path_name);
-			}
+			d = (SHARED.next_device + i) % SHARED.num_devices;
+			if (SHARED.devices[d].num_files > 0
+					&& (DEVICE_LIMIT == 0 || !SHARED.by_device
+							|| SHARED.devices[d].active < DEVICE_LIMIT))
+				break;
 		}
+		if (i < SHARED.num_devices || (SHARED.num_files == 0 && SHARED.done))
+			break;
+		pthread_cond_wait(&SHARED.cond_not_empty, &mutex_shared);
+	}
 
-		free((void *)element);
+	if (i < SHARED.num_devices)
+	{
+		from = &SHARED.devices[d];
+		el = remove_element(from->queue_files);
+		from->num_files--;
+		from->files_taken++;
+		if (++from->active > from->peak_active)
+			from->peak_active = from->active;
+		SHARED.num_files--;
+		SHARED.next_device = (d + 1) % SHARED.num_devices;
+		*seq = SHARED.next_seq++;
+		*device = d;
+		pthread_cond_signal(&from->cond_not_full);
+
+		/* Workers held back by DEVICE_LIMIT after SHARED_finish() can now exit */
+		if (SHARED.num_files == 0 && SHARED.done)
+			pthread_cond_broadcast(&SHARED.cond_not_empty);
 	}
+	pthread_mutex_unlock(&mutex_shared);
 
-	return num_occurrences;
+	return el;
 }
 
-unsigned int round_up(unsigned int dividend, unsigned int divisor)
+/* Print how the files were spread over the devices */
+void SHARED_print_stats()
 {
-	return (dividend + (divisor - 1)) / divisor;
+	int d;
+
+	if (DEVICE_LIMIT > 0)
+	{
+		printf("\n Devices: %d, each limited to %d files searched at a time.",
+				SHARED.num_devices, DEVICE_LIMIT);
+	} else
+	{
+		printf("\n Devices: %d, searched side by side.", SHARED.num_devices);
+	}
+	for (d = 0; d < SHARED.num_devices; d++)
+	{
+		printf("\n   device %u:%u%s: %lld files, at most %d at once.",
+				major(SHARED.devices[d].dev), minor(SHARED.devices[d].dev),
+				(d == MAX_DEVICES - 1) ? " and later devices" : "",
+				SHARED.devices[d].files_taken, SHARED.devices[d].peak_active);
+	}
 }
 
-void* parallel_search_static_thread(void* this_arg)
+/* Number of files queued and not yet taken by a worker */
+int SHARED_files_waiting()
 {
-	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg; // Typecast the argument passed to this function to the appropriate type
+	int num_files;
 
-	int thread_id = args_for_me->threadID;
-	int num_elements = args_for_me->num_elements;
-	char* search_string = args_for_me->search_string;
-	queue_t* queue;
-	queue_element_t** input_elements = args_for_me->elements;
-	queue_element_t* element, *new_element;
-	struct stat file_stats;
-	int status;
-	DIR* directory = NULL;
-	struct dirent* result = NULL;
-	struct dirent* entry = (struct dirent*)malloc(
-			sizeof(struct dirent) + MAX_LENGTH);
+	pthread_mutex_lock(&mutex_shared);
+	num_files = SHARED.num_files;
+	pthread_mutex_unlock(&mutex_shared);
+
+	return num_files;
+}
+
+/* Signal that no more files will be inserted, waking up all waiting workers */
+void SHARED_finish()
+{
+	pthread_mutex_lock(&mutex_shared);
+	SHARED.done = true;
+	pthread_cond_broadcast(&SHARED.cond_not_empty);
+	pthread_mutex_unlock(&mutex_shared);
+}
+
+/* Returns true if the file name has none of the --ext extensions */
+bool filter_extension(const char* name)
+{
+	const char* dot = strrchr(name, '.');
 	int i;
-	int num_occurrences = 0;
 
-	/* internal queue */
-	queue = create_queue(); /* Create and initialize the queue data structure. */
-	element = (queue_element_t *)malloc(sizeof(queue_element_t));
-	if (element == NULL)
-	{
-		perror("malloc");
-		exit( EXIT_FAILURE);
-	}
+	if (NUM_EXTENSIONS == 0)
+		return false;
+	if (dot == NULL)
+		return true;
 
-	/* Add input elements to queue */
-	for (i = 0; i < num_elements; i++)
+	for (i = 0; i < NUM_EXTENSIONS; i++)
 	{
-		insert_element(queue, input_elements[i]);
+		if (strcmp(dot + 1, EXTENSIONS[i]) == 0)
+			return false;
 	}
 
-	while (queue->head != NULL)
-	{ /* While there is work in the queue, process it. */
+	return true;
+}
 
-		element = remove_element(queue);
+/* The root whose walk reached parent: the longest root that is a leading part of it.
+ * Anchored exclusion rules are matched against the path below it. */
+const char* root_of(const char* parent)
+{
+	const char* root = "";
+	size_t length, best = 0;
+	int i;
 
-		/* Obtain information about the file. */
-		status = lstat(element->path_name, &file_stats);
-		if (status == -1)
+	for (i = 0; i < NUM_ROOTS; i++)
+	{
+		length = strlen(ROOTS[i]);
+		if (length > best && strncmp(parent, ROOTS[i], length) == 0
+				&& (parent[length] == '\0' || parent[length] == '/' || ROOTS[i][length - 1] == '/'))
 		{
-			printf("Thread %d: Error obtaining stats for %s \n", thread_id,
-					element->path_name);
-			free((void*)element);
-			continue;
+			root = ROOTS[i];
+			best = length;
 		}
+	}
 
-		if (S_ISLNK(file_stats.st_mode))
-		{ /* Ignore symbolic links. */
-		} else if (S_ISDIR(file_stats.st_mode))
-		{ /* If directory, descend in and post work to queue. */
-			if (VERBOSE)
-			{
-				printf("Thread %d: %s is a directory. \n", thread_id,
-						element->path_name);
-			}
-			directory = opendir(element->path_name);
-			if (directory == NULL)
-			{
-				printf("Thread %d: Unable to open directory %s \n", thread_id,
-						element->path_name);
-				continue;
-			}
+	return root;
+}
 
-			while (1)
-			{
-				status = readdir_r(directory, entry, &result); /* Read directory entry. */
-				if (status != 0)
-				{
-					printf("Thread %d: Unable to read directory %s \n",
-							thread_id, element->path_name);
-					break;
-				}
-				if (result == NULL) /* End of directory. */
-					break;
+/* Returns true if the directory entry matches an exclusion rule, or is a regular file
+ * without one of the --ext extensions. Called before the entry is queued, so excluded
+ * directories are never opened or descended into, and filtered files never stat'ed. */
+bool filter_dirent(const char* parent, struct dirent* entry)
+{
+	char path[2 * MAX_LENGTH];
+	struct stat file_stats;
+	bool is_dir;
 
-				if (strcmp(entry->d_name, ".") == 0) /* Ignore the "." and ".." entries. */
-					continue;
+	if (entry->d_type == DT_REG && filter_extension(entry->d_name))
+		return true;
 
-				if (strcmp(entry->d_name, "..") == 0)
-					continue;
+	if (exclude_is_empty(EXCLUDE))
+		return false;
 
-				/* Insert this directory entry in the queue. */
-				new_element = (queue_element_t *)malloc(
-						sizeof(queue_element_t));
-				if (new_element == NULL)
-				{
-					perror("malloc");
-					exit(EXIT_FAILURE);
-				}
+	is_dir = (entry->d_type == DT_DIR);
 
-				/* Construct the full path name for the directory item stored in entry. */
-				strcpy(new_element->path_name, element->path_name);
-				strcat(new_element->path_name, "/");
-				strcat(new_element->path_name, entry->d_name);
-				insert_element(queue, new_element);
-			}
+	/* Some file systems do not fill in d_type; only stat when a rule needs it */
+	if (entry->d_type == DT_UNKNOWN && exclude_needs_type(EXCLUDE))
+	{
+		snprintf(path, sizeof(path), "%s/%s", parent, entry->d_name);
+		is_dir = (lstat(path, &file_stats) == 0 && S_ISDIR(file_stats.st_mode));
+	}
 
-			closedir(directory);
-		} else if (S_ISREG(file_stats.st_mode))
-		{ 	/* Directory entry is a regular file. */
+	return exclude_match(EXCLUDE, root_of(parent), parent, entry->d_name, is_dir);
+}
 
-			if (VERBOSE)
-			{
-				printf("Thread %d: %s is a regular file. \n", thread_id,
-						element->path_name);
-			}
+/* Returns true if a path read from stdin matches an exclusion rule, or lies in a
+ * directory that does, as the walk would have pruned it. The path is taken as given,
+ * relative to the working directory, which anchored rules match from. */
+bool filter_listed_path(const char* path_name)
+{
+	char parent[MAX_LENGTH], name[MAX_LENGTH];
+	const char* start = path_name;
+	const char* slash;
+	size_t length;
 
-			FILE *file_to_search;
-			char buffer[MAX_LENGTH];
-			char *bufptr, *searchptr, *tokenptr;
+	if (exclude_is_empty(EXCLUDE))
+		return false;
 
-			/* Search the file for the search string provided as the command-line argument. */
-			file_to_search = fopen(element->path_name, "r");
-
-			if (file_to_search == NULL)
-			{
-				printf("Thread %d: Unable to open file %s \n", thread_id,
-						element->path_name);
-				continue;
-			} else
-			{
-				/* Note: strtok() is not thread safe:
-				 * strtok() is prone to data races when used in concurrent threads. This causes
-				 * inaccurate counts when run on xunil. The remediation is to use strtok_r(), this
-				 * solves the issue and provides a similar syntax.
-				 */
-				while (1)
-				{
-					bufptr = fgets(buffer, sizeof(buffer), file_to_search); /* Read in a line from the file. */
-					if (bufptr == NULL)
-					{
-						if (feof(file_to_search))
-							break;
-						if (ferror(file_to_search))
-						{
-							printf("Thread %d: Error reading file %s \n",
-									thread_id, element->path_name);
-							break;
-						}
-					}
-
-					/* Break up line into tokens and search each token. */
-					char* saveptr;	// save pointer for strtok_r()
-					tokenptr = strtok_r(buffer, " ,.-", &saveptr);
-					while (tokenptr != NULL)
-					{
-						searchptr = strstr(tokenptr, search_string);
-						if (searchptr != NULL)
-						{
-							if (VERBOSE)
-							{
-								printf(
-										"Thread %d: Found string %s within \
-									file %s. \n",
-										thread_id, search_string,
-										element->path_name);
-							}
-
-							num_occurrences++;
-						}
-						tokenptr = strtok_r(NULL, " ,.-", &saveptr);
-					}
-				}
-			}
-
-			fclose(file_to_search);
+	while (1)
+	{
+		slash = strchr(start, '/');
+		length = (slash != NULL) ? (size_t)(slash - start) : strlen(start);
+		memcpy(name, start, length);
+		name[length] = '\0';
 
+		if (start == path_name)
+		{
+			strcpy(parent, ".");
 		} else
 		{
-			if (VERBOSE)
-			{
-				printf("Thread %d: %s is of type other. \n", thread_id,
-						element->path_name);
-			}
+			/* Everything before the slash in front of name; "/" for the file system root */
+			length = (start - 1 > path_name) ? (size_t)(start - 1 - path_name) : 1;
+			memcpy(parent, path_name, length);
+			parent[length] = '\0';
 		}
 
-		free((void *)element);
+		if (name[0] != '\0' && strcmp(name, ".") != 0
+				&& exclude_match(EXCLUDE, NULL, parent, name, slash != NULL))
+			return true;
 
+		if (slash == NULL)
+			return false;
+		start = slash + 1;
 	}
+}
+
+/* Returns true if a regular file must not be searched because of its size, its
+ * modification time, or its extension (when that could not be checked at the directory
+ * entry stage). Called with the lstat() the walk needs anyway, so filtered files are
+ * never opened. */
+bool filter_file(const char* path_name, const struct stat* file_stats)
+{
+	const char* name = strrchr(path_name, '/');
 
-	RESULTS[thread_id] = num_occurrences;
+	if (file_stats->st_size < MIN_SIZE
+			|| (MAX_SIZE >= 0 && file_stats->st_size > MAX_SIZE))
+		return true;
 
-	return ((void *)0);
+	/* Directories are not pruned by mtime: theirs only changes when entries are added,
+	 * removed or renamed, not when a file below is rewritten, so it bounds nothing. */
+	if ((NEWER >= 0 && file_stats->st_mtime < NEWER)
+			|| (OLDER >= 0 && file_stats->st_mtime >= OLDER))
+	{
+		__atomic_add_fetch(&PROGRESS.mtime_skipped, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	return filter_extension(name != NULL ? name + 1 : path_name);
 }
 
-int /* Parallel search with static load balancing accross threads. */
-parallel_search_static(char** argv)
+/* True once the --deadline of the current search has passed */
+bool deadline_expired()
 {
-	int num_occurrences = 0;
+	struct timespec now;
 
-	const int NUM_THREADS = atoi(argv[3]);
-	pthread_t worker_thread[NUM_THREADS];
-	RESULTS = (int*)malloc(sizeof(int) * NUM_THREADS);
-	int* RESULTS_original = RESULTS;
-	ARGS_FOR_THREAD* args_for_thread;
-	queue_element_t* element, *new_element;
-	struct stat file_stats;
-	int status;
-	DIR* directory = NULL;
-	struct dirent *result = NULL;
-	struct dirent *entry = (struct dirent *)malloc(
-			sizeof(struct dirent) + MAX_LENGTH);
-	int i;
+	if (DEADLINE <= 0)
+		return false;
+	if (DEADLINE_EXPIRED)
+		return true;
 
-	queue_t *queue = create_queue(); /* Create and initialize the queue data structure. */
-	element = (queue_element_t*)malloc(sizeof(queue_element_t));
-	if (element == NULL)
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec > DEADLINE_AT.tv_sec
+			|| (now.tv_sec == DEADLINE_AT.tv_sec && now.tv_nsec >= DEADLINE_AT.tv_nsec))
 	{
-		perror("malloc");
-		exit( EXIT_FAILURE);
+		DEADLINE_EXPIRED = true;
 	}
 
-	strcpy(element->path_name, argv[2]); /* Copy the initial path name */
-	element->next = NULL;
-	insert_element(queue, element); /* Insert the initial path name into the queue. */
+	return DEADLINE_EXPIRED;
+}
 
-	element = remove_element(queue);
+/* Called for each entry taken from a queue. Once the deadline has expired, the entry is
+ * only counted as skipped and true is returned; the caller drops it. Workers therefore
+ * stop at the next file boundary and the remaining queues drain quickly. */
+bool deadline_skip(const struct stat* file_stats)
+{
+	if (!deadline_expired())
+		return false;
 
-	/* Obtain information about the file. */
-	status = lstat(element->path_name, &file_stats);
-	if (status == -1)
+	if (S_ISDIR(file_stats->st_mode))
 	{
-		printf("Error obtaining stats for %s \n", element->path_name);
-		free((void *)element);
+		__atomic_add_fetch(&PROGRESS.dirs_skipped, 1, __ATOMIC_RELAXED);
+	} else if (S_ISREG(file_stats->st_mode))
+	{
+		__atomic_add_fetch(&PROGRESS.files_skipped, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&PROGRESS.bytes_skipped, (long long)file_stats->st_size,
+				__ATOMIC_RELAXED);
 	}
 
-	/* Add all items in directory to queue */
-	if (S_ISDIR(file_stats.st_mode))
+	return true;
+}
+
+/* Record a file that a walk has accepted for searching */
+void progress_found(const struct stat* file_stats)
+{
+	__atomic_add_fetch(&PROGRESS.files_found, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&PROGRESS.bytes_found, (long long)file_stats->st_size,
+			__ATOMIC_RELAXED);
+}
+
+/* Set up a zeroed result block for each of num_threads worker threads */
+void thread_stats_begin(int num_threads)
+{
+	THREAD_STATS_t** retired;
+
+	/* A block replaced here may still be read by the progress reporter, so it is
+	 * retired rather than freed; search_cleanup() frees it */
+	__atomic_store_n(&NUM_THREAD_STATS, 0, __ATOMIC_RELAXED);
+	if (THREAD_STATS != NULL)
 	{
-		/* If directory, descend in and post work to queue. */
-		if (VERBOSE)
+		retired = (THREAD_STATS_t**)realloc(RETIRED_STATS,
+				sizeof(THREAD_STATS_t*) * (NUM_RETIRED_STATS + 1));
+		if (retired == NULL)
 		{
-			printf("%s is a directory. \n", element->path_name);
+			perror("realloc");
+			exit(EXIT_FAILURE);
 		}
+		RETIRED_STATS = retired;
+		RETIRED_STATS[NUM_RETIRED_STATS++] = THREAD_STATS;
+	}
+	if (posix_memalign((void**)&THREAD_STATS, CACHE_LINE_SIZE,
+			sizeof(THREAD_STATS_t) * num_threads) != 0)
+	{
+		perror("posix_memalign");
+		exit(EXIT_FAILURE);
+	}
+	memset(THREAD_STATS, 0, sizeof(THREAD_STATS_t) * num_threads);
+	__atomic_store_n(&NUM_THREAD_STATS, num_threads, __ATOMIC_RELEASE);
+}
 
-		directory = opendir(element->path_name);
-		if (directory == NULL)
-		{
-			printf("Unable to open directory %s \n", element->path_name);
-		}
+/* Make block slot the calling thread's own; call first thing in a worker thread */
+void thread_stats_attach(int slot)
+{
+	MY_STATS = &THREAD_STATS[slot];
+}
 
-		while (1)
-		{
-			status = readdir_r(directory, entry, &result); /* Read directory entry. */
-			if (status != 0)
-			{
-				printf("Unable to read directory %s \n", element->path_name);
-				break;
-			}
-			if (result == NULL) /* End of directory. */
-				break;
+/* Fold the blocks into PROGRESS once the worker threads have been joined, and return
+ * the total number of matches they found */
+long long thread_stats_merge()
+{
+	long long occurrences = 0;
+	int i, n = NUM_THREAD_STATS;
 
-			if (strcmp(entry->d_name, ".") == 0) /* Ignore the "." and ".." entries. */
-				continue;
+	__atomic_store_n(&NUM_THREAD_STATS, 0, __ATOMIC_RELAXED);
+	for (i = 0; i < n; i++)
+	{
+		occurrences += THREAD_STATS[i].occurrences;
+		PROGRESS.files_searched += THREAD_STATS[i].files_searched;
+		PROGRESS.bytes_searched += THREAD_STATS[i].bytes_searched;
+		PROGRESS.files_matched += THREAD_STATS[i].files_matched;
+		if (THREAD_STATS[i].max_file_count > PROGRESS.max_file_count)
+			PROGRESS.max_file_count = THREAD_STATS[i].max_file_count;
+	}
 
-			if (strcmp(entry->d_name, "..") == 0)
-				continue;
+	return occurrences;
+}
 
-			/* Insert this directory entry in the queue. */
-			new_element = (queue_element_t *)malloc(sizeof(queue_element_t));
-			if (new_element == NULL)
-			{
-				perror("malloc");
-				exit(EXIT_FAILURE);
-			}
+/* Sum of a PROGRESS counter and the matching counter of every block, read lock-free;
+ * the counters are given by their offsets in PROGRESS_t and THREAD_STATS_t */
+long long thread_stats_sum(size_t progress_offset, size_t block_offset)
+{
+	int i, n = __atomic_load_n(&NUM_THREAD_STATS, __ATOMIC_ACQUIRE);
+	long long sum = __atomic_load_n((long long*)((char*)&PROGRESS + progress_offset),
+			__ATOMIC_RELAXED);
 
-			/* Construct the full path name for the directory item stored in entry. */
-			strcpy(new_element->path_name, element->path_name);
-			strcat(new_element->path_name, "/");
-			strcat(new_element->path_name, entry->d_name);
-			insert_element(queue, new_element);
-		}
+	for (i = 0; i < n; i++)
+		sum += __atomic_load_n((long long*)((char*)&THREAD_STATS[i] + block_offset),
+				__ATOMIC_RELAXED);
 
-		closedir(directory);
+	return sum;
+}
+
+/* Files and bytes searched so far in the current search, from any thread */
+long long progress_files_searched()
+{
+	return thread_stats_sum(offsetof(PROGRESS_t, files_searched),
+			offsetof(THREAD_STATS_t, files_searched));
+}
+
+long long progress_bytes_searched()
+{
+	return thread_stats_sum(offsetof(PROGRESS_t, bytes_searched),
+			offsetof(THREAD_STATS_t, bytes_searched));
+}
+
+/* Record a file that has been searched */
+void progress_searched(long long bytes)
+{
+	if (MY_STATS != NULL)
+	{
+		__atomic_store_n(&MY_STATS->files_searched, MY_STATS->files_searched + 1,
+				__ATOMIC_RELAXED);
+		__atomic_store_n(&MY_STATS->bytes_searched, MY_STATS->bytes_searched + bytes,
+				__ATOMIC_RELAXED);
+		return;
 	}
 
-	int num_el = num_elements(queue);
-	int items_per_thread = round_up(num_el, NUM_THREADS);
-	if (VERBOSE)
+	__atomic_add_fetch(&PROGRESS.files_searched, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&PROGRESS.bytes_searched, bytes, __ATOMIC_RELAXED);
+}
+
+/* Record the number of matches in a searched file. In a worker thread they count
+ * towards the search total; elsewhere the caller adds up the counts itself. */
+void progress_matched(long long count)
+{
+	if (MY_STATS != NULL)
 	{
-		printf("Items per thread = %d\n", items_per_thread);
+		__atomic_store_n(&MY_STATS->occurrences, MY_STATS->occurrences + count,
+				__ATOMIC_RELAXED);
+		if (count > 0)
+			__atomic_store_n(&MY_STATS->files_matched, MY_STATS->files_matched + 1,
+					__ATOMIC_RELAXED);
+		if (count > MY_STATS->max_file_count)
+			__atomic_store_n(&MY_STATS->max_file_count, count, __ATOMIC_RELAXED);
+		return;
 	}
-	int num_el_to_threads = 0;
-	int num_el_to_thread = 0;
-	int j;
 
-	if (VERBOSE)
+	if (count > 0)
 	{
-		printf("Main thread: creating %d worker threads \n", NUM_THREADS);
+		__atomic_add_fetch(&PROGRESS.files_matched, 1, __ATOMIC_RELAXED);
+	}
+	long long max = __atomic_load_n(&PROGRESS.max_file_count, __ATOMIC_RELAXED);
+	while (count > max && !__atomic_compare_exchange_n(&PROGRESS.max_file_count, &max,
+			count, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/* Record a gzip file that has been read through, and close its reader */
+void progress_decompressed(gzip_reader_t* gzip)
+{
+	__atomic_add_fetch(&PROGRESS.decompressed, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&PROGRESS.compressed_bytes, gzip->bytes_in, __ATOMIC_RELAXED);
+	gzip_close(gzip);
+}
+
+/* Write the JSON record of a searched file; files without matches get none */
+void json_file_searched(const char* path_name, long long count)
+{
+	if (JSON_MODE != JSON_OFF && !ORDERED && count > 0)
+	{
+		json_file(json_thread_writer(), path_name, count);
 	}
+}
 
-	for (i = 0; i < NUM_THREADS; i++)
+/* reorder_print_fn for --json --ordered */
+void json_file_ordered(void* arg, const char* path_name, long long count)
+{
+	json_file((json_writer_t*)arg, path_name, count);
+}
+
+void json_match_token(void* arg, const char* token, size_t length)
+{
+	JSON_MATCH_t* match = (JSON_MATCH_t*)arg;
+
+	json_match(match->writer, match->path_name, match->offset + (token - match->buffer),
+			token, length);
+}
+
+/* As MATCH_COUNT(), also writing a JSON record for every matching token. offset is
+ * the position of buffer in the file. */
+long long json_match_count(const char* path_name, const char* buffer, size_t length,
+		long long offset, const char* search_string)
+{
+	JSON_MATCH_t match = { json_thread_writer(), path_name, buffer, offset };
+
+	if (DFA != NULL)
 	{
-		num_el_to_thread = 0; 	// Number of elements added to this thread
-		/* Allocate memory for the structure that will be used to pack the arguments */
-		args_for_thread = (ARGS_FOR_THREAD *)malloc(sizeof(ARGS_FOR_THREAD));
-		args_for_thread->search_string = (char*)malloc(sizeof(char) * 128);
-		args_for_thread->threadID = i;
+		return dfa_tokens(DFA, &DELIMITERS, buffer, length, json_match_token, &match);
+	}
+	return match_tokens(&DELIMITERS, buffer, length, search_string,
+			LIBRARY_OPTIONS.ignore_case, json_match_token, &match);
+}
 
-		/* Add calculated "num_el" elements to each thread */
-		for (j = 0; j < items_per_thread; j++)
+/* Search a regular file for search_string and return the number of matching tokens.
+ * thread_id is used to label messages; pass -1 from the serial search.
+ */
+long long search_file(const char* path_name, const char* search_string, int thread_id)
+{
+	int fd;
+	cold_file_t cold_file;
+	char storage[SEARCH_CARRY_SIZE + SEARCH_BUFFER_SIZE + COLD_ALIGN];
+	char* buffer = (char*)(((uintptr_t)storage + SEARCH_CARRY_SIZE + COLD_ALIGN - 1)
+			& ~(uintptr_t)(COLD_ALIGN - 1));
+	char* start;
+	size_t carry = 0;	// Bytes of a partial token kept in front of buffer
+	size_t length, split;
+	ssize_t n;
+	char prefix[32] = "";
+	long long num_occurrences = 0;
+	long long bytes_read = 0;
+	gzip_reader_t gzip;
+	bool compressed = false;
+	long long compressed_read = 0;
+
+	if (thread_id >= 0)
+	{
+		snprintf(prefix, sizeof(prefix), "Thread %d: ", thread_id);
+	}
+
+	/* Search the file for the search string provided as the command-line argument. */
+	throttle_acquire(&THROTTLE_FILES, 1);
+	fd = cold_open(path_name, COLD_MODE, &cold_file);
+	if (fd == -1)
+	{
+		printf("%sUnable to open file %s \n", prefix, path_name);
+		return 0;
+	}
+
+	/* Sniff the first block: binary files are skipped unless --binary is given. With
+	 * --decompress, a gzip file is read through zlib from here on and the sniff looks
+	 * at its decompressed contents. */
+	n = read(fd, buffer, SEARCH_BUFFER_SIZE);
+	if (n > 0 && DECOMPRESS && gzip_is_compressed(buffer, n))
+	{
+		if (gzip_open(&gzip, fd, buffer, n) == -1)
 		{
-			if (num_el_to_threads < num_el)
-			{
-				args_for_thread->elements[j] = remove_element(queue);
-				num_el_to_thread++;
-				num_el_to_threads++;
-			} else
-			{
-				break;
-			}
+			printf("%sUnable to start decompressing %s \n", prefix, path_name);
+			exit(EXIT_FAILURE);
 		}
+		compressed = true;
+		n = gzip_read(&gzip, buffer, SEARCH_BUFFER_SIZE);
+	}
+	if (n > 0 && !SEARCH_BINARY && match_is_binary(buffer, n))
+	{
+		if (VERBOSE)
+		{
+			printf("%s%s is a binary file, skipping. \n", prefix, path_name);
+		}
+		__atomic_add_fetch(&PROGRESS.binary_skipped, 1, __ATOMIC_RELAXED);
+		if (compressed)
+		{
+			gzip_close(&gzip);
+		}
+		cold_close(&cold_file);
+		return 0;
+	}
 
-		args_for_thread->num_elements = num_el_to_thread;
-
-		/* Copy the search string into the struct */
-		strcpy(args_for_thread->search_string, argv[1]);
+	/* Identical contents were already searched: reuse the count */
+	dedup_key_t key;
+	if (DEDUP != NULL && dedup_lookup(DEDUP, fd, &key, &num_occurrences))
+	{
 		if (VERBOSE)
 		{
-			printf("creating thread #%d... \n", i);
+			printf("%s%s has the same contents as a file already searched. \n",
+					prefix, path_name);
 		}
-		if ((pthread_create(&worker_thread[i], NULL,
-				parallel_search_static_thread, (void *)args_for_thread)) != 0)
+		progress_searched(key.size);
+		progress_matched(num_occurrences);
+		json_file_searched(path_name, num_occurrences);
+		if (compressed)
 		{
-			printf("Cannot create thread \n");
-			exit(0);
+			gzip_close(&gzip);
 		}
+		cold_close(&cold_file);
+		return num_occurrences;
 	}
 
-	/* Wait for all the worker threads to finish */
-	for (i = 0; i < NUM_THREADS; i++)
-		pthread_join(worker_thread[i], NULL);
+	/* Read the file in large chunks and hand each chunk to the match kernel. A chunk
+	 * is cut at its last token boundary and the partial token is moved in front of
+	 * the buffer, to be searched together with the next chunk. */
+	while (1)
+	{
+		if (n == -1)
+		{
+			printf("%sError reading file %s \n", prefix, path_name);
+			break;
+		}
+		if (compressed)
+		{
+			/* The throttle limits reads from disk, i.e. compressed bytes */
+			throttle_acquire(&THROTTLE_BYTES, gzip.bytes_in - compressed_read);
+			compressed_read = gzip.bytes_in;
+		} else
+		{
+			throttle_acquire(&THROTTLE_BYTES, n);
+		}
+		bytes_read += n;
+
+		start = buffer - carry;
+		length = carry + n;
+		split = (n == 0) ? length : match_split(&DELIMITERS, start, length);
+		if (length - split > SEARCH_CARRY_SIZE)
+			split = length; /* Token longer than the carry room: split it */
+		if (JSON_MODE == JSON_MATCHES)
+			num_occurrences += json_match_count(path_name, start, split,
+					bytes_read - length, search_string);
+		else
+			num_occurrences += MATCH_COUNT(&DELIMITERS, start, split, search_string);
+
+		if (n == 0)
+			break;
+
+		carry = length - split;
+		memmove(buffer - carry, start + split, carry);
+
+		if (compressed)
+			n = gzip_read(&gzip, buffer, SEARCH_BUFFER_SIZE);
+		else
+			n = read(fd, buffer, SEARCH_BUFFER_SIZE);
+	}
 
-	/* Sum occurrences */
-	for (i = 0; i < NUM_THREADS; i++)
+	if (compressed)
 	{
-		num_occurrences = num_occurrences + RESULTS[i];
+		progress_decompressed(&gzip);
 	}
+	cold_close(&cold_file);
+	progress_searched(bytes_read);
+	progress_matched(num_occurrences);
+	json_file_searched(path_name, num_occurrences);
 
-	free(RESULTS_original);
+	if (VERBOSE && !ORDERED && num_occurrences > 0)
+	{
+		printf("%sFound string %s %lld times within file %s. \n", prefix,
+				search_string, num_occurrences, path_name);
+	}
+
+	if (DEDUP != NULL)
+	{
+		dedup_insert(DEDUP, &key, num_occurrences);
+	}
 
 	return num_occurrences;
 }
 
-/* For each file in the shared queue, search for search_string */
-void* parallel_search_dynamic_search_thread(void* this_arg)
+/* State of one tree walk: what to do with the regular files it finds */
+typedef struct WALK_t
+{
+	int thread_id;					// -1 outside worker threads
+	const char* search_string;		// Regular files are searched for search_string,
+	void (*post)(queue_element_t*);	// unless post is set: then they are handed to it
+	long long num_occurrences;		// Matches in the files searched by this walk
+	long long seq;					// Next sequence number, for --ordered
+} WALK_t;
+
+/* Handle a regular file found by a walk */
+void WALK_file(WALK_t* walk, const char* path_name, const struct stat* file_stats)
 {
-	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg; // Typecast the argument passed to this function to the appropriate type
-	int thread_id = args_for_me->threadID;
-	int num_elements = args_for_me->num_elements;
-	char* search_string = args_for_me->search_string;
-	queue_t* queue;
-	queue_element_t** input_elements = args_for_me->elements;
 	queue_element_t* element;
-	struct stat file_stats;
-	int status;
-	int i;
-	int num_occurrences = 0;
+	long long count;
 
-	/* internal queue */
-	queue = create_queue(); /* Create and initialize the queue data structure. */
+	progress_found(file_stats);
 
-	/* Add (seed) input elements into queue */
-	for (i = 0; i < num_elements; i++)
+	if (walk->post != NULL)
 	{
-		insert_element(queue, input_elements[i]);
+		element = (queue_element_t *)malloc(sizeof(queue_element_t));
+		if (element == NULL)
+		{
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		strcpy(element->path_name, path_name);
+		element->mtime = file_stats->st_mtime;
+		element->dev = file_stats->st_dev;
+		walk->post(element);
+		return;
 	}
 
-	while (queue->head != NULL)
-	{ /* While there is work in the queue, process it. */
+	count = search_file(path_name, walk->search_string, walk->thread_id);
+	if (ORDERED)
+	{
+		reorder_put(&REORDER, walk->seq++, path_name, count);
+	}
+	if (SHARD_WORKER != NULL)
+	{
+		shard_report_file(SHARD_WORKER, path_name, count);
+	}
+	walk->num_occurrences += count;
+}
 
-		element = remove_element(queue);
+/* Walk path_name depth-first. Memory use grows with the depth of the tree only: one
+ * open directory and one path per level. */
+void WALK_depth_first(WALK_t* walk, const char* path_name)
+{
+	char child[MAX_LENGTH];
+	struct stat file_stats;
+	struct dirent* entry;
+	DIR* directory;
 
-		/* Obtain information about the file. */
-		status = lstat(element->path_name, &file_stats);
-		if (status == -1)
-		{
-			printf("Thread %d: Error obtaining stats for %s \n", thread_id,
-					element->path_name);
-			free((void *)element);
-			continue;
-		}
+	__atomic_add_fetch(&PROGRESS.depth_first, 1, __ATOMIC_RELAXED);
 
-		if (S_ISREG(file_stats.st_mode))
-		{ /* Directory entry is a regular file. */
-			if (VERBOSE)
-			{
-				printf("Thread %d: %s is a regular file. \n", thread_id,
-						element->path_name);
-			}
+	if (lstat(path_name, &file_stats) == -1)
+	{
+		printf("Error obtaining stats for %s \n", path_name);
+		return;
+	}
 
-			FILE *file_to_search;
-			char buffer[MAX_LENGTH];
-			char *bufptr, *searchptr, *tokenptr;
+	if (deadline_skip(&file_stats)) /* Out of time: account for the entry, don't search it */
+		return;
 
-			/* Search the file for the search string provided as the command-line argument. */
-			file_to_search = fopen(element->path_name, "r");
-			if (file_to_search == NULL)
+	if (S_ISDIR(file_stats.st_mode))
+	{
+		directory = opendir(path_name);
+		if (directory == NULL)
+		{
+			printf("Unable to open directory %s \n", path_name);
+			return;
+		}
+
+		/* readdir() is safe here: each thread reads its own directory streams */
+		while ((entry = readdir(directory)) != NULL)
+		{
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+
+			if (filter_dirent(path_name, entry))
+				continue;
+
+			if (snprintf(child, sizeof(child), "%s/%s", path_name, entry->d_name)
+					>= (int)sizeof(child))
 			{
-				printf("Thread %d: Unable to open file %s \n", thread_id,
-						element->path_name);
+				printf("Path too long, skipping: %s/%s \n", path_name, entry->d_name);
 				continue;
-			} else
+			}
+			WALK_depth_first(walk, child);
+		}
+
+		closedir(directory);
+	} else if (S_ISREG(file_stats.st_mode) && !filter_file(path_name, &file_stats))
+	{
+		WALK_file(walk, path_name, &file_stats);
+	}
+}
+
+/* Add an entry to a breadth-first queue holding *frontier entries. When the queue is
+ * at MAX_FRONTIER the entry is walked depth-first right away instead, so the queue
+ * stays bounded however wide the tree is, yet still holds enough directories to share
+ * out among threads. */
+void WALK_enqueue(WALK_t* walk, queue_t* queue, int* frontier, queue_element_t* element)
+{
+	if (MAX_FRONTIER > 0 && *frontier >= MAX_FRONTIER)
+	{
+		WALK_depth_first(walk, element->path_name);
+		free((void *)element);
+		return;
+	}
+
+	insert_element(queue, element);
+	(*frontier)++;
+}
+
+/* Print a progress report to stderr. The counters, most of them in the per-thread
+ * blocks, are read with relaxed atomic loads, never under a lock, so the workers are
+ * not held up; a report may mix values from a few microseconds apart. *last_ns and
+ * *last_bytes hold the previous report, for the current throughput. */
+void progress_report(long long* last_ns, long long* last_bytes)
+{
+	struct timespec now;
+	long long now_ns, start_ns;
+	long long files = progress_files_searched();
+	long long bytes = progress_bytes_searched();
+	long long files_found = __atomic_load_n(&PROGRESS.files_found, __ATOMIC_RELAXED);
+	long long bytes_found = __atomic_load_n(&PROGRESS.bytes_found, __ATOMIC_RELAXED);
+	int queued = __atomic_load_n(&SHARED.num_files, __ATOMIC_RELAXED);
+	int filled = __atomic_load_n(&PIPELINE.num_filled, __ATOMIC_RELAXED);
+	double elapsed, rate, current;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+	start_ns = __atomic_load_n(&PROGRESS_START_NS, __ATOMIC_RELAXED);
+
+	/* A new search has started since the last report */
+	if (*last_ns < start_ns || bytes < *last_bytes)
+	{
+		*last_ns = start_ns;
+		*last_bytes = 0;
+	}
+
+	elapsed = (now_ns - start_ns) / 1e9;
+	rate = (elapsed > 0) ? bytes / elapsed : 0;
+	current = (now_ns > *last_ns) ? (bytes - *last_bytes) / ((now_ns - *last_ns) / 1e9) : 0;
+	*last_ns = now_ns;
+	*last_bytes = bytes;
+
+	fprintf(stderr, "[progress %.1fs] searched %lld files, %.2f MiB (%.2f MiB/s now, %.2f MiB/s average)",
+			elapsed, files, bytes / (1024.0 * 1024.0), current / (1024.0 * 1024.0),
+			rate / (1024.0 * 1024.0));
+	if (files_found > 0)
+	{
+		fprintf(stderr, "; found %lld files, %.2f MiB", files_found,
+				bytes_found / (1024.0 * 1024.0));
+	}
+	if (queued > 0 || filled > 0)
+	{
+		fprintf(stderr, "; queued %d files, %d buffers", queued, filled);
+	}
+	if (bytes_found > bytes && rate > 0)
+	{
+		/* Only the files found so far are known; the walk may find more */
+		fprintf(stderr, "; ETA %.0fs for the files found so far",
+				(bytes_found - bytes) / rate);
+	}
+	fprintf(stderr, "\n");
+}
+
+/* Reporter thread: sleeps in sigwait() until SIGUSR1 arrives, or, with --progress,
+ * wakes up every PROGRESS_INTERVAL seconds too. All other threads block SIGUSR1, so
+ * the signal is always taken here and never interrupts a worker. */
+void* progress_thread(void* this_arg)
+{
+	long long last_ns = 0, last_bytes = 0;
+	struct timespec interval;
+	sigset_t signals;
+	int signal;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	interval.tv_sec = (time_t)PROGRESS_INTERVAL;
+	interval.tv_nsec = (long)((PROGRESS_INTERVAL - (double)interval.tv_sec) * 1e9);
+
+	while (1)
+	{
+		if (PROGRESS_INTERVAL > 0)
+		{
+			/* EAGAIN: the interval passed without a signal */
+			if (sigtimedwait(&signals, NULL, &interval) == -1 && errno != EAGAIN)
+				continue;
+		} else if (sigwait(&signals, &signal) != 0)
+		{
+			continue;
+		}
+
+		progress_report(&last_ns, &last_bytes);
+	}
+
+	return ((void*)0);
+}
+
+/* Block SIGUSR1 and start the reporter. Call before any other thread is created, so
+ * that they all inherit the blocked signal. */
+void progress_start()
+{
+	pthread_t thread;
+	sigset_t signals;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	if (pthread_create(&thread, NULL, progress_thread, NULL) != 0)
+	{
+		printf("Cannot create thread \n");
+		exit(EXIT_FAILURE);
+	}
+	pthread_detach(thread);
+}
+
+/* Reset per-search state before a timed search */
+void stats_begin()
+{
+	struct timespec now;
+
+	memset(&PROGRESS, 0, sizeof(PROGRESS));
+	memset(&SHARD_STATS, 0, sizeof(SHARD_STATS));
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	__atomic_store_n(&PROGRESS_START_NS, now.tv_sec * 1000000000LL + now.tv_nsec,
+			__ATOMIC_RELAXED);
+	AUTO_TUNING = false;
+	AUTO_FIXED = false;
+	if (AUTO_THREADS)
+	{
+		tune_reset(&TUNE, now.tv_sec * 1000000000LL + now.tv_nsec);
+	}
+	tune_reset_affinity_stats();
+	DEADLINE_EXPIRED = false;
+	if (DEADLINE > 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &DEADLINE_AT);
+		DEADLINE_AT.tv_sec += (time_t)DEADLINE;
+		DEADLINE_AT.tv_nsec += (long)((DEADLINE - (double)(time_t)DEADLINE) * 1e9);
+		if (DEADLINE_AT.tv_nsec >= 1000000000L)
+		{
+			DEADLINE_AT.tv_sec++;
+			DEADLINE_AT.tv_nsec -= 1000000000L;
+		}
+	}
+
+	throttle_reset(&THROTTLE_BYTES);
+	throttle_reset(&THROTTLE_FILES);
+
+	if (COLD_MODE != COLD_OFF)
+	{
+		cold_reset_stats();
+	}
+	if (DEDUP != NULL)
+	{
+		dedup_reset(DEDUP);
+	}
+	if (ORDERED)
+	{
+		reorder_reset(&REORDER);
+	}
+}
+
+/* Print per-search statistics after a timed search */
+void stats_report()
+{
+	if (AUTO_TUNING)
+	{
+		tune_print_stats(&TUNE);
+	} else if (AUTO_FIXED)
+	{
+		printf("\n Threads: auto, %s (one per online CPU).", AUTO_THREADS_ARG);
+	}
+	tune_print_affinity();
+
+	if (DEADLINE > 0)
+	{
+		printf("\n Coverage: searched %lld files (%.2f MiB)", PROGRESS.files_searched,
+				PROGRESS.bytes_searched / (1024.0 * 1024.0));
+		if (DEADLINE_EXPIRED)
+		{
+			printf("; deadline of %.3fs expired, counts are partial: skipped %lld files (%.2f MiB), %lld directories not visited.",
+					DEADLINE, PROGRESS.files_skipped,
+					PROGRESS.bytes_skipped / (1024.0 * 1024.0), PROGRESS.dirs_skipped);
+		} else
+		{
+			printf(", completed within the deadline of %.3fs.", DEADLINE);
+		}
+	}
+
+	if (PROGRESS.files_matched > 0)
+	{
+		printf("\n Matches in %lld of %lld files searched (at most %lld in one file).",
+				PROGRESS.files_matched, PROGRESS.files_searched, PROGRESS.max_file_count);
+	}
+	if (PROGRESS.binary_skipped > 0)
+	{
+		printf("\n Skipped %lld binary files.", PROGRESS.binary_skipped);
+	}
+	if (PROGRESS.decompressed > 0)
+	{
+		printf("\n Decompressed %lld gzip files (%.2f MiB on disk).", PROGRESS.decompressed,
+				PROGRESS.compressed_bytes / (1024.0 * 1024.0));
+	}
+	if (PROGRESS.mtime_skipped > 0)
+	{
+		printf("\n Skipped %lld files modified outside the --newer/--older range.",
+				PROGRESS.mtime_skipped);
+	}
+	if (PROGRESS.depth_first > 0)
+	{
+		printf("\n Traversal: %lld entries walked depth-first (frontier limit %d).",
+				PROGRESS.depth_first, MAX_FRONTIER);
+	}
+
+	if (SHARD_STATS.shards > 0)
+	{
+		shard_print_stats(&SHARD_STATS);
+	}
+	if (SHARED.by_device && SHARED.num_devices > 0)
+	{
+		SHARED_print_stats();
+	}
+
+	if (throttle_enabled(&THROTTLE_BYTES))
+	{
+		printf("\n Throttle: read %.2f MiB/s (limit %.2f MiB/s).",
+				throttle_observed_rate(&THROTTLE_BYTES) / (1024.0 * 1024.0),
+				THROTTLE_BYTES.rate / (1024.0 * 1024.0));
+	}
+	if (throttle_enabled(&THROTTLE_FILES))
+	{
+		printf("\n Throttle: opened %.1f files/s (limit %.1f files/s).",
+				throttle_observed_rate(&THROTTLE_FILES), THROTTLE_FILES.rate);
+	}
+	if (COLD_MODE != COLD_OFF)
+	{
+		cold_print_stats();
+	}
+	if (DEDUP != NULL)
+	{
+		dedup_print_stats(DEDUP);
+	}
+	if (DFA != NULL)
+	{
+		dfa_print_stats(DFA);
+	}
+	if (ORDERED && REORDER.waits > 0)
+	{
+		printf("\n Ordered output: workers waited %lld times for the reorder window of %d files.",
+				REORDER.waits, REORDER.window);
+	}
+}
+
+long long /* Serial search of the file system starting from the specified path name. */
+serial_search(char **argv)
+{
+	WALK_t walk = { -1, argv[1], NULL, 0, 0 };
+	int frontier = 0;
+	queue_element_t *element, *new_element;
+	struct stat file_stats;
+	int status, i;
+	DIR *directory = NULL;
+	struct dirent *result = NULL;
+	struct dirent *entry = (struct dirent *)malloc(
+			sizeof(struct dirent) + MAX_LENGTH);
+
+	queue_t *queue = create_queue(); /* Create and initialize the queue data structure. */
+	for (i = 0; i < NUM_ROOTS; i++)
+	{
+		element = (queue_element_t *)malloc(sizeof(queue_element_t));
+		if (element == NULL)
+		{
+			perror("malloc");
+			exit( EXIT_FAILURE);
+		}
+
+		strcpy(element->path_name, ROOTS[i]); /* Copy the initial path names */
+		element->next = NULL;
+		insert_element(queue, element); /* Insert the initial path names into the queue. */
+		frontier++;
+	}
+
+	while (queue->head != NULL)
+	{ /* While there is work in the queue, process it. */
+		queue_element_t *element = remove_element(queue);
+		frontier--;
+
+		/* Obtain information about the file. */
+		status = lstat(element->path_name, &file_stats);
+		if (status == -1)
+		{
+			printf("Error obtaining stats for %s \n", element->path_name);
+			free((void *)element);
+			continue;
+		}
+
+		if (deadline_skip(&file_stats)) /* Out of time: account for the entry, don't search it */
+		{
+			free((void *)element);
+			continue;
+		}
+
+		if (S_ISLNK(file_stats.st_mode))
+		{ 	/* Ignore symbolic links. */
+		} else if (S_ISDIR(file_stats.st_mode))
+		{ 	/* If directory, descend in and post work to queue. */
+			if (VERBOSE)
+			{
+				printf("%s is a directory. \n", element->path_name);
+			}
+			directory = opendir(element->path_name);
+			if (directory == NULL)
+			{
+				printf("Unable to open directory %s \n", element->path_name);
+				continue;
+			}
+
+			while (1)
 			{
-				while (1)
+				status = readdir_r(directory, entry, &result); /* Read directory entry. */
+				if (status != 0)
+				{
+					printf("Unable to read directory %s \n",
+							element->path_name);
+					break;
+				}
+				if (result == NULL) /* End of directory. */
+					break;
+
+				if (strcmp(entry->d_name, ".") == 0) /* Ignore the "." and ".." entries. */
+					continue;
+
+				if (strcmp(entry->d_name, "..") == 0)
+					continue;
+
+				if (filter_dirent(element->path_name, entry)) /* Prune excluded entries before they are queued. */
+					continue;
+
+				/* Insert this directory entry in the queue. */
+				new_element = (queue_element_t *)malloc(
+						sizeof(queue_element_t));
+				if (new_element == NULL)
 				{
-					bufptr = fgets(buffer, sizeof(buffer), file_to_search); /* Read in a line from the file. */
-					if (bufptr == NULL)
-					{
-						if (feof(file_to_search))
-							break;
-						if (ferror(file_to_search))
-						{
-							printf("Thread %d: Error reading file %s \n",
-									thread_id, element->path_name);
-							break;
-						}
-					}
-					/* Break up line into tokens and search each token. */
-					char* saveptr;
-					tokenptr = strtok_r(buffer, " ,.-", &saveptr);
-					while (tokenptr != NULL)
-					{
-						searchptr = strstr(tokenptr, search_string);
-						if (searchptr != NULL)
-						{
-							if (VERBOSE)
-							{
-								printf(
-										"Thread %d: Found string %s within \
-									file %s. \n",
-										thread_id, search_string,
-										element->path_name);
-							}
-
-							num_occurrences++;
-						}
-						tokenptr = strtok_r(NULL, " ,.-", &saveptr);
-					}
+					perror("malloc");
+					exit(EXIT_FAILURE);
 				}
+
+				/* Construct the full path name for the directory item stored in entry. */
+				strcpy(new_element->path_name, element->path_name);
+				strcat(new_element->path_name, "/");
+				strcat(new_element->path_name, entry->d_name);
+				WALK_enqueue(&walk, queue, &frontier, new_element);
 			}
 
-			fclose(file_to_search);
+			closedir(directory);
+		} else if (S_ISREG(file_stats.st_mode)
+				&& filter_file(element->path_name, &file_stats))
+		{ 	/* Filtered out by --ext, --min-size, --max-size, --newer or --older. */
+		} else if (S_ISREG(file_stats.st_mode))
+		{ 	/* Directory entry is a regular file. */
+			if (VERBOSE)
+			{
+				printf("%s is a regular file. \n", element->path_name);
+			}
+			WALK_file(&walk, element->path_name, &file_stats);
 		} else
 		{
 			if (VERBOSE)
 			{
-				printf("Thread %d: %s is of type other. \n", thread_id,
-						element->path_name);
+				printf("%s is of type other. \n", element->path_name);
 			}
 		}
 
 		free((void *)element);
 	}
 
-	RESULTS[thread_id] = num_occurrences;
-
-	if (VERBOSE)
-	{
-		printf("Thread %d: finished! \n", thread_id);
-	}
+	return walk.num_occurrences;
+}
 
-	return ((void*)0);
+unsigned int round_up(unsigned int dividend, unsigned int divisor)
+{
+	return (dividend + (divisor - 1)) / divisor;
 }
 
-/* Descend breadth-first and add all regular files to the shared queue */
-void* parallel_search_dynamic_files_thread(void* this_arg)
+void* parallel_search_static_thread(void* this_arg)
 {
 	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg; // Typecast the argument passed to this function to the appropriate type
 
 	int thread_id = args_for_me->threadID;
 	int num_elements = args_for_me->num_elements;
+	char* search_string = args_for_me->search_string;
 	queue_t* queue;
 	queue_element_t** input_elements = args_for_me->elements;
 	queue_element_t* element, *new_element;
@@ -719,6 +1532,10 @@ void* parallel_search_dynamic_files_thread(void* this_arg)
 	struct dirent* entry = (struct dirent*)malloc(
 			sizeof(struct dirent) + MAX_LENGTH);
 	int i;
+	WALK_t walk = { thread_id, search_string, NULL, 0, 0 };
+	int frontier = 0;
+
+	thread_stats_attach(thread_id);
 
 	/* internal queue */
 	queue = create_queue(); /* Create and initialize the queue data structure. */
@@ -729,16 +1546,19 @@ void* parallel_search_dynamic_files_thread(void* this_arg)
 		exit( EXIT_FAILURE);
 	}
 
-	/* Add (seed) input elements into queue */
+	/* Add input elements to queue */
 	for (i = 0; i < num_elements; i++)
 	{
 		insert_element(queue, input_elements[i]);
+		frontier++;
 	}
+	free(input_elements);
 
 	while (queue->head != NULL)
 	{ /* While there is work in the queue, process it. */
 
 		element = remove_element(queue);
+		frontier--;
 
 		/* Obtain information about the file. */
 		status = lstat(element->path_name, &file_stats);
@@ -746,6 +1566,12 @@ void* parallel_search_dynamic_files_thread(void* this_arg)
 		{
 			printf("Thread %d: Error obtaining stats for %s \n", thread_id,
 					element->path_name);
+			free((void*)element);
+			continue;
+		}
+
+		if (deadline_skip(&file_stats)) /* Out of time: account for the entry, don't search it */
+		{
 			free((void *)element);
 			continue;
 		}
@@ -785,6 +1611,9 @@ void* parallel_search_dynamic_files_thread(void* this_arg)
 				if (strcmp(entry->d_name, "..") == 0)
 					continue;
 
+				if (filter_dirent(element->path_name, entry)) /* Prune excluded entries before they are queued. */
+					continue;
+
 				/* Insert this directory entry in the queue. */
 				new_element = (queue_element_t *)malloc(
 						sizeof(queue_element_t));
@@ -798,32 +1627,24 @@ void* parallel_search_dynamic_files_thread(void* this_arg)
 				strcpy(new_element->path_name, element->path_name);
 				strcat(new_element->path_name, "/");
 				strcat(new_element->path_name, entry->d_name);
-				insert_element(queue, new_element);
+				WALK_enqueue(&walk, queue, &frontier, new_element);
 			}
 
 			closedir(directory);
+		} else if (S_ISREG(file_stats.st_mode)
+				&& filter_file(element->path_name, &file_stats))
+		{ 	/* Filtered out by --ext, --min-size, --max-size, --newer or --older. */
 		} else if (S_ISREG(file_stats.st_mode))
-		{ /* Directory entry is a regular file. */
+		{ 	/* Directory entry is a regular file. */
+
 			if (VERBOSE)
 			{
 				printf("Thread %d: %s is a regular file. \n", thread_id,
 						element->path_name);
 			}
 
-			/* Insert the file into the shared queue */
-
-			new_element = (queue_element_t *)malloc(sizeof(queue_element_t));
-			if (new_element == NULL)
-			{
-				perror("malloc");
-				exit(EXIT_FAILURE);
-			}
-
-			/* Construct the full path name for the directory item stored in entry. */
-			strcpy(new_element->path_name, element->path_name);
+			WALK_file(&walk, element->path_name, &file_stats);
 
-			/* SHARED functions take care of mutex_shared */
-			SHARED_insert_file_element(new_element);
 		} else
 		{
 			if (VERBOSE)
@@ -834,20 +1655,19 @@ void* parallel_search_dynamic_files_thread(void* this_arg)
 		}
 
 		free((void *)element);
+
 	}
 
 	return ((void *)0);
 }
 
-int /* Parallel search with dynamic load balancing. */
-parallel_search_dynamic(char **argv)
+long long /* Parallel search with static load balancing accross threads. */
+parallel_search_static(char** argv)
 {
-	int num_occurrences = 0;
+	long long num_occurrences;
 
 	const int NUM_THREADS = atoi(argv[3]);
 	pthread_t worker_thread[NUM_THREADS];
-	RESULTS = (int*)malloc(sizeof(int) * NUM_THREADS);
-	int* RESULTS_original = RESULTS;
 	ARGS_FOR_THREAD* args_for_thread;
 	queue_element_t* element, *new_element;
 	struct stat file_stats;
@@ -856,7 +1676,6 @@ parallel_search_dynamic(char **argv)
 	struct dirent *result = NULL;
 	struct dirent *entry = (struct dirent *)malloc(
 			sizeof(struct dirent) + MAX_LENGTH);
-
 	int i;
 
 	queue_t *queue = create_queue(); /* Create and initialize the queue data structure. */
@@ -867,14 +1686,10 @@ parallel_search_dynamic(char **argv)
 		exit( EXIT_FAILURE);
 	}
 
-	/* Initialize the SHARED data structure, which will be shared between threads */
-	SHARED_init();
-
 	strcpy(element->path_name, argv[2]); /* Copy the initial path name */
 	element->next = NULL;
 	insert_element(queue, element); /* Insert the initial path name into the queue. */
 
-	/* Get the first element (starting directory) */
 	element = remove_element(queue);
 
 	/* Obtain information about the file. */
@@ -885,7 +1700,7 @@ parallel_search_dynamic(char **argv)
 		free((void *)element);
 	}
 
-	/* Add all items in start directory to queue */
+	/* Add all items in directory to queue */
 	if (S_ISDIR(file_stats.st_mode))
 	{
 		/* If directory, descend in and post work to queue. */
@@ -893,6 +1708,7 @@ parallel_search_dynamic(char **argv)
 		{
 			printf("%s is a directory. \n", element->path_name);
 		}
+
 		directory = opendir(element->path_name);
 		if (directory == NULL)
 		{
@@ -916,6 +1732,9 @@ parallel_search_dynamic(char **argv)
 			if (strcmp(entry->d_name, "..") == 0)
 				continue;
 
+			if (filter_dirent(element->path_name, entry)) /* Prune excluded entries before they are queued. */
+				continue;
+
 			/* Insert this directory entry in the queue. */
 			new_element = (queue_element_t *)malloc(sizeof(queue_element_t));
 			if (new_element == NULL)
@@ -934,39 +1753,35 @@ parallel_search_dynamic(char **argv)
 		closedir(directory);
 	}
 
-	/* "SHARED.queue_files" now hold all files in the starting directory, "queue" holds all directories
-	 * within the starting directory
-	 */
-	int num_el = num_elements(queue);	// Num elements in the queue
-	int items_per_thread = round_up(num_el, NUM_THREADS);// round_up( num_el / NUM_THREADS )
+	int num_el = num_elements(queue);
+	int items_per_thread = round_up(num_el, NUM_THREADS);
 	if (VERBOSE)
 	{
-		printf("Items (directories) per thread = %d\n", items_per_thread);
+		printf("Items per thread = %d\n", items_per_thread);
 	}
-	int num_el_to_threads = 0;	// Number elements added to all threads
-	int num_el_to_thread = 0;	// Number elements added to current thread
+	int num_el_to_threads = 0;
+	int num_el_to_thread = 0;
+	int j;
 
 	if (VERBOSE)
 	{
-		printf("Main thread: creating %d file finding worker threads \n",
-				NUM_THREADS);
+		printf("Main thread: creating %d worker threads \n", NUM_THREADS);
 	}
+	thread_stats_begin(NUM_THREADS);
 
-	/* Create threads */
 	for (i = 0; i < NUM_THREADS; i++)
 	{
-		args_for_thread = (ARGS_FOR_THREAD *)malloc(sizeof(ARGS_FOR_THREAD)); // Allocate memory for the structure that will be used to pack the arguments
-		args_for_thread->search_string = (char*)malloc(sizeof(char) * 256);
-		strcpy(args_for_thread->search_string, argv[1]); // Copy search string
-		args_for_thread->threadID = i;						// Label threadID
-		num_el_to_thread = 0;	// Number elements already added to this thread
+		num_el_to_thread = 0; 	// Number of elements added to this thread
+		/* Allocate memory for the structure that will be used to pack the arguments */
+		args_for_thread = (ARGS_FOR_THREAD *)malloc(sizeof(ARGS_FOR_THREAD));
+		args_for_thread->search_string = (char*)malloc(sizeof(char) * 128);
+		args_for_thread->threadID = i;
+		args_for_thread->elements = (queue_element_t**)malloc(
+				sizeof(queue_element_t*) * (items_per_thread + 1));
 
-		for (int j = 0; j < items_per_thread; j++)
+		/* Add calculated "num_el" elements to each thread */
+		for (j = 0; j < items_per_thread; j++)
 		{
-			/* Add items to thread as long as we have not exceeded the total number of elements in the queue.
-			 * Another way to implement this would have been to just include a queue, with the elements already
-			 * inserted, in the args_for_thread structure.
-			 */
 			if (num_el_to_threads < num_el)
 			{
 				args_for_thread->elements[j] = remove_element(queue);
@@ -974,107 +1789,1774 @@ parallel_search_dynamic(char **argv)
 				num_el_to_threads++;
 			} else
 			{
-				// Break loop if reached end of queue (could have done "if (queue->head != NULL) {} else {}" instead)
 				break;
 			}
 		}
 
 		args_for_thread->num_elements = num_el_to_thread;
 
+		/* Copy the search string into the struct */
+		strcpy(args_for_thread->search_string, argv[1]);
 		if (VERBOSE)
 		{
 			printf("creating thread #%d... \n", i);
 		}
 		if ((pthread_create(&worker_thread[i], NULL,
-				parallel_search_dynamic_files_thread, (void *)args_for_thread))
-				!= 0)
+				parallel_search_static_thread, (void *)args_for_thread)) != 0)
 		{
 			printf("Cannot create thread \n");
 			exit(0);
 		}
+		tune_pin_thread(worker_thread[i], i);
 	}
 
-	// Wait for all the file finding worker threads to finish
+	/* Wait for all the worker threads to finish */
 	for (i = 0; i < NUM_THREADS; i++)
 		pthread_join(worker_thread[i], NULL);
 
-	if (VERBOSE)
+	/* Sum occurrences */
+	num_occurrences = thread_stats_merge();
+
+	return num_occurrences;
+}
+
+/* qsort() comparison putting the most recently modified files first */
+int compare_newest_first(const void* a, const void* b)
+{
+	time_t x = (*(queue_element_t* const*)a)->mtime;
+	time_t y = (*(queue_element_t* const*)b)->mtime;
+
+	return (x < y) - (x > y);
+}
+
+/* Empty the num_el files of queue into an array, ranked newest first */
+queue_element_t** rank_newest_first(queue_t* queue, int num_el)
+{
+	queue_element_t** ranked = (queue_element_t**)malloc(
+			sizeof(queue_element_t*) * (num_el + 1));
+	int i;
+
+	if (ranked == NULL)
 	{
-		printf("File finding workers completed. \n");
+		perror("malloc");
+		exit(EXIT_FAILURE);
 	}
 
-	/* Once all file finding threads have completed, start search threads.
-	 * This uses the same method as above to split the queue into even(ish) workloads
-	 * and then distributes those workloads to the different threads
-	 * */
-	num_el = num_elements(SHARED.queue_files);
-	items_per_thread = round_up(num_el, NUM_THREADS);
-	if (VERBOSE)
+	for (i = 0; i < num_el; i++)
+		ranked[i] = remove_element(queue);
+	qsort(ranked, num_el, sizeof(queue_element_t*), compare_newest_first);
+
+	return ranked;
+}
+
+/* For each file in the shared queue, search for search_string */
+void* parallel_search_dynamic_search_thread(void* this_arg)
+{
+	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg; // Typecast the argument passed to this function to the appropriate type
+	int thread_id = args_for_me->threadID;
+	int num_elements = args_for_me->num_elements;
+	char* search_string = args_for_me->search_string;
+	queue_t* queue;
+	queue_element_t** input_elements = args_for_me->elements;
+	queue_element_t* element;
+	struct stat file_stats;
+	int status;
+	int i;
+
+	thread_stats_attach(thread_id);
+
+	/* internal queue */
+	queue = create_queue(); /* Create and initialize the queue data structure. */
+
+	/* Add (seed) input elements into queue */
+	for (i = 0; i < num_elements; i++)
 	{
-		printf("Main thread: Items (files) per thread = %d\n",
-				items_per_thread);
+		insert_element(queue, input_elements[i]);
+	}
+	free(input_elements);
+
+	while (queue->head != NULL)
+	{ /* While there is work in the queue, process it. */
+
+		element = remove_element(queue);
+
+		/* Obtain information about the file. */
+		status = lstat(element->path_name, &file_stats);
+		if (status == -1)
+		{
+			printf("Thread %d: Error obtaining stats for %s \n", thread_id,
+					element->path_name);
+			free((void *)element);
+			continue;
+		}
+
+		if (deadline_skip(&file_stats)) /* Out of time: account for the entry, don't search it */
+		{
+			free((void *)element);
+			continue;
+		}
+
+		if (S_ISREG(file_stats.st_mode))
+		{ /* Directory entry is a regular file. */
+			if (VERBOSE)
+			{
+				printf("Thread %d: %s is a regular file. \n", thread_id,
+						element->path_name);
+			}
+
+			search_file(element->path_name, search_string, thread_id);
+		} else
+		{
+			if (VERBOSE)
+			{
+				printf("Thread %d: %s is of type other. \n", thread_id,
+						element->path_name);
+			}
+		}
+
+		free((void *)element);
 	}
-	num_el_to_threads = 0;
-	num_el_to_thread = 0;
-	int j;
 
 	if (VERBOSE)
 	{
-		printf("Main thread: creating %d keyword searching worker threads \n",
-				NUM_THREADS);
+		printf("Thread %d: finished! \n", thread_id);
+	}
+
+	return ((void*)0);
+}
+
+/* Descend breadth-first and add all regular files to the shared queue */
+void* parallel_search_dynamic_files_thread(void* this_arg)
+{
+	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg; // Typecast the argument passed to this function to the appropriate type
+
+	int thread_id = args_for_me->threadID;
+	int num_elements = args_for_me->num_elements;
+	queue_t* queue;
+	queue_element_t** input_elements = args_for_me->elements;
+	queue_element_t* element, *new_element;
+	struct stat file_stats;
+	int status;
+	DIR* directory = NULL;
+	struct dirent* result = NULL;
+	struct dirent* entry = (struct dirent*)malloc(
+			sizeof(struct dirent) + MAX_LENGTH);
+	int i;
+	WALK_t walk = { thread_id, NULL, SHARED_insert_file_element, 0, 0 };
+	int frontier = 0;
+
+	/* internal queue */
+	queue = create_queue(); /* Create and initialize the queue data structure. */
+	element = (queue_element_t *)malloc(sizeof(queue_element_t));
+	if (element == NULL)
+	{
+		perror("malloc");
+		exit( EXIT_FAILURE);
+	}
+
+	/* Add (seed) input elements into queue */
+	for (i = 0; i < num_elements; i++)
+	{
+		insert_element(queue, input_elements[i]);
+		frontier++;
+	}
+	free(input_elements);
+
+	while (queue->head != NULL)
+	{ /* While there is work in the queue, process it. */
+
+		element = remove_element(queue);
+		frontier--;
+
+		/* Obtain information about the file. */
+		status = lstat(element->path_name, &file_stats);
+		if (status == -1)
+		{
+			printf("Thread %d: Error obtaining stats for %s \n", thread_id,
+					element->path_name);
+			free((void *)element);
+			continue;
+		}
+
+		if (deadline_skip(&file_stats)) /* Out of time: account for the entry, don't search it */
+		{
+			free((void *)element);
+			continue;
+		}
+
+		if (S_ISLNK(file_stats.st_mode))
+		{ /* Ignore symbolic links. */
+		} else if (S_ISDIR(file_stats.st_mode))
+		{ /* If directory, descend in and post work to queue. */
+			if (VERBOSE)
+			{
+				printf("Thread %d: %s is a directory. \n", thread_id,
+						element->path_name);
+			}
+			directory = opendir(element->path_name);
+			if (directory == NULL)
+			{
+				printf("Thread %d: Unable to open directory %s \n", thread_id,
+						element->path_name);
+				continue;
+			}
+
+			while (1)
+			{
+				status = readdir_r(directory, entry, &result); /* Read directory entry. */
+				if (status != 0)
+				{
+					printf("Thread %d: Unable to read directory %s \n",
+							thread_id, element->path_name);
+					break;
+				}
+				if (result == NULL) /* End of directory. */
+					break;
+
+				if (strcmp(entry->d_name, ".") == 0) /* Ignore the "." and ".." entries. */
+					continue;
+
+				if (strcmp(entry->d_name, "..") == 0)
+					continue;
+
+				if (filter_dirent(element->path_name, entry)) /* Prune excluded entries before they are queued. */
+					continue;
+
+				/* Insert this directory entry in the queue. */
+				new_element = (queue_element_t *)malloc(
+						sizeof(queue_element_t));
+				if (new_element == NULL)
+				{
+					perror("malloc");
+					exit(EXIT_FAILURE);
+				}
+
+				/* Construct the full path name for the directory item stored in entry. */
+				strcpy(new_element->path_name, element->path_name);
+				strcat(new_element->path_name, "/");
+				strcat(new_element->path_name, entry->d_name);
+				WALK_enqueue(&walk, queue, &frontier, new_element);
+			}
+
+			closedir(directory);
+		} else if (S_ISREG(file_stats.st_mode)
+				&& filter_file(element->path_name, &file_stats))
+		{ 	/* Filtered out by --ext, --min-size, --max-size, --newer or --older. */
+		} else if (S_ISREG(file_stats.st_mode))
+		{ /* Directory entry is a regular file. */
+			if (VERBOSE)
+			{
+				printf("Thread %d: %s is a regular file. \n", thread_id,
+						element->path_name);
+			}
+
+			/* Insert the file into the shared queue; SHARED functions take care of
+			 * mutex_shared */
+			WALK_file(&walk, element->path_name, &file_stats);
+		} else
+		{
+			if (VERBOSE)
+			{
+				printf("Thread %d: %s is of type other. \n", thread_id,
+						element->path_name);
+			}
+		}
+
+		free((void *)element);
+	}
+
+	return ((void *)0);
+}
+
+long long /* Parallel search with dynamic load balancing. */
+parallel_search_dynamic(char **argv)
+{
+	long long num_occurrences;
+
+	const int NUM_THREADS = atoi(argv[3]);
+	pthread_t worker_thread[NUM_THREADS];
+	ARGS_FOR_THREAD* args_for_thread;
+	queue_element_t* element, *new_element;
+	struct stat file_stats;
+	int status;
+	DIR* directory = NULL;
+	struct dirent *result = NULL;
+	struct dirent *entry = (struct dirent *)malloc(
+			sizeof(struct dirent) + MAX_LENGTH);
+
+	int i;
+
+	queue_t *queue = create_queue(); /* Create and initialize the queue data structure. */
+	element = (queue_element_t*)malloc(sizeof(queue_element_t));
+	if (element == NULL)
+	{
+		perror("malloc");
+		exit( EXIT_FAILURE);
+	}
+
+	/* Initialize the SHARED data structure, which will be shared between threads */
+	SHARED_init();
+
+	strcpy(element->path_name, argv[2]); /* Copy the initial path name */
+	element->next = NULL;
+	insert_element(queue, element); /* Insert the initial path name into the queue. */
+
+	/* Get the first element (starting directory) */
+	element = remove_element(queue);
+
+	/* Obtain information about the file. */
+	status = lstat(element->path_name, &file_stats);
+	if (status == -1)
+	{
+		printf("Error obtaining stats for %s \n", element->path_name);
+		free((void *)element);
+	}
+
+	/* Add all items in start directory to queue */
+	if (S_ISDIR(file_stats.st_mode))
+	{
+		/* If directory, descend in and post work to queue. */
+		if (VERBOSE)
+		{
+			printf("%s is a directory. \n", element->path_name);
+		}
+		directory = opendir(element->path_name);
+		if (directory == NULL)
+		{
+			printf("Unable to open directory %s \n", element->path_name);
+		}
+
+		while (1)
+		{
+			status = readdir_r(directory, entry, &result); /* Read directory entry. */
+			if (status != 0)
+			{
+				printf("Unable to read directory %s \n", element->path_name);
+				break;
+			}
+			if (result == NULL) /* End of directory. */
+				break;
+
+			if (strcmp(entry->d_name, ".") == 0) /* Ignore the "." and ".." entries. */
+				continue;
+
+			if (strcmp(entry->d_name, "..") == 0)
+				continue;
+
+			if (filter_dirent(element->path_name, entry)) /* Prune excluded entries before they are queued. */
+				continue;
+
+			/* Insert this directory entry in the queue. */
+			new_element = (queue_element_t *)malloc(sizeof(queue_element_t));
+			if (new_element == NULL)
+			{
+				perror("malloc");
+				exit(EXIT_FAILURE);
+			}
+
+			/* Construct the full path name for the directory item stored in entry. */
+			strcpy(new_element->path_name, element->path_name);
+			strcat(new_element->path_name, "/");
+			strcat(new_element->path_name, entry->d_name);
+			insert_element(queue, new_element);
+		}
+
+		closedir(directory);
+	}
+
+	/* "SHARED.queue_files" now hold all files in the starting directory, "queue" holds all directories
+	 * within the starting directory
+	 */
+	int num_el = num_elements(queue);	// Num elements in the queue
+	int items_per_thread = round_up(num_el, NUM_THREADS);// round_up( num_el / NUM_THREADS )
+	if (VERBOSE)
+	{
+		printf("Items (directories) per thread = %d\n", items_per_thread);
+	}
+	int num_el_to_threads = 0;	// Number elements added to all threads
+	int num_el_to_thread = 0;	// Number elements added to current thread
+
+	if (VERBOSE)
+	{
+		printf("Main thread: creating %d file finding worker threads \n",
+				NUM_THREADS);
+	}
+
+	/* Create threads */
+	for (i = 0; i < NUM_THREADS; i++)
+	{
+		args_for_thread = (ARGS_FOR_THREAD *)malloc(sizeof(ARGS_FOR_THREAD)); // Allocate memory for the structure that will be used to pack the arguments
+		args_for_thread->search_string = (char*)malloc(sizeof(char) * 256);
+		strcpy(args_for_thread->search_string, argv[1]); // Copy search string
+		args_for_thread->threadID = i;						// Label threadID
+		args_for_thread->elements = (queue_element_t**)malloc(
+				sizeof(queue_element_t*) * (items_per_thread + 1));
+		num_el_to_thread = 0;	// Number elements already added to this thread
+
+		for (int j = 0; j < items_per_thread; j++)
+		{
+			/* Add items to thread as long as we have not exceeded the total number of elements in the queue.
+			 * Another way to implement this would have been to just include a queue, with the elements already
+			 * inserted, in the args_for_thread structure.
+			 */
+			if (num_el_to_threads < num_el)
+			{
+				args_for_thread->elements[j] = remove_element(queue);
+				num_el_to_thread++;
+				num_el_to_threads++;
+			} else
+			{
+				// Break loop if reached end of queue (could have done "if (queue->head != NULL) {} else {}" instead)
+				break;
+			}
+		}
+
+		args_for_thread->num_elements = num_el_to_thread;
+
+		if (VERBOSE)
+		{
+			printf("creating thread #%d... \n", i);
+		}
+		if ((pthread_create(&worker_thread[i], NULL,
+				parallel_search_dynamic_files_thread, (void *)args_for_thread))
+				!= 0)
+		{
+			printf("Cannot create thread \n");
+			exit(0);
+		}
+		tune_pin_thread(worker_thread[i], i);
+	}
+
+	// Wait for all the file finding worker threads to finish
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(worker_thread[i], NULL);
+
+	if (VERBOSE)
+	{
+		printf("File finding workers completed. \n");
+	}
+
+	/* Once all file finding threads have completed, start search threads.
+	 * This uses the same method as above to split the queue into even(ish) workloads
+	 * and then distributes those workloads to the different threads
+	 * */
+	num_el = num_elements(SHARED.queue_files);
+	items_per_thread = round_up(num_el, NUM_THREADS);
+	if (VERBOSE)
+	{
+		printf("Main thread: Items (files) per thread = %d\n",
+				items_per_thread);
+	}
+	num_el_to_threads = 0;
+	num_el_to_thread = 0;
+	int j;
+
+	/* With --newer or --older, rank the files that passed so the most recently
+	 * modified are searched first. The ranked files are dealt out in turn rather than
+	 * in runs, so every thread starts with the newest of its share. */
+	queue_element_t** ranked = NULL;
+	if (NEWER >= 0 || OLDER >= 0)
+	{
+		ranked = rank_newest_first(SHARED.queue_files, num_el);
+	}
+
+	if (VERBOSE)
+	{
+		printf("Main thread: creating %d keyword searching worker threads \n",
+				NUM_THREADS);
+	}
+	thread_stats_begin(NUM_THREADS);
+
+	/* Same as above */
+	for (i = 0; i < NUM_THREADS; i++)
+	{
+		args_for_thread = (ARGS_FOR_THREAD*)malloc(sizeof(ARGS_FOR_THREAD)); // Allocate memory for the structure that will be used to pack the arguments
+		args_for_thread->search_string = (char*)malloc(sizeof(char) * 128);
+		args_for_thread->threadID = i;
+		args_for_thread->elements = (queue_element_t**)malloc(
+				sizeof(queue_element_t*) * (items_per_thread + 1));
+		num_el_to_thread = 0;
+
+		for (j = 0; j < items_per_thread; j++)
+		{
+			if (ranked != NULL && j * NUM_THREADS + i < num_el)
+			{
+				args_for_thread->elements[j] = ranked[j * NUM_THREADS + i];
+				num_el_to_thread++;
+			} else if (ranked == NULL && num_el_to_threads < num_el)
+			{
+				args_for_thread->elements[j] = remove_element(
+						SHARED.queue_files);
+				num_el_to_thread++;
+				num_el_to_threads++;
+			} else
+			{
+				break;
+			}
+		}
+
+		args_for_thread->num_elements = num_el_to_thread;
+		strcpy(args_for_thread->search_string, argv[1]);
+		if (VERBOSE)
+		{
+			printf("creating thread #%d... \n", i);
+		}
+		if ((pthread_create(&worker_thread[i], NULL,
+				parallel_search_dynamic_search_thread, (void *)args_for_thread))
+				!= 0)
+		{
+			printf("Cannot create thread \n");
+			exit(0);
+		}
+		tune_pin_thread(worker_thread[i], i);
+	}
+
+	free(ranked);
+
+	// Wait for all the keyword searching worker threads to finish
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(worker_thread[i], NULL);
+
+	/* Tally up the num_occurrences from the per-thread result blocks */
+	num_occurrences = thread_stats_merge();
+
+	return num_occurrences;
+}
+
+/* Read a NUL-separated path list from stdin into the shared file queue. The queue is
+ * bounded, so a fast producer blocks instead of buffering the whole list. */
+void post_files_from_stdin()
+{
+	queue_element_t* element;
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t length;
+	struct stat file_stats;
+
+	while ((length = getdelim(&line, &line_size, '\0', stdin)) != -1)
+	{
+		if (deadline_expired())
+			break; /* The rest of the list is left unread */
+
+		if (length > 0 && line[length - 1] == '\0')
+			length--;
+		if (length == 0)
+			continue;
+
+		if (length >= MAX_LENGTH)
+		{
+			printf("Path too long, skipping: %.64s... \n", line);
+			continue;
+		}
+
+		if (filter_listed_path(line))
+			continue;
+
+		element = (queue_element_t *)malloc(sizeof(queue_element_t));
+		if (element == NULL)
+		{
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		memcpy(element->path_name, line, length);
+		element->path_name[length] = '\0';
+
+		/* The device is only needed for --per-device; the searching thread stats anyway */
+		element->dev = 0;
+		if (SHARED.by_device && stat(element->path_name, &file_stats) == 0)
+			element->dev = file_stats.st_dev;
+
+		SHARED_put_file_element(element);
+	}
+
+	free(line);
+}
+
+/* Walk the tree breadth-first from root_path, posting every regular file to the
+ * shared file queue. */
+void post_files_from_tree(const char* root_path)
+{
+	queue_element_t *element, *new_element;
+	struct stat file_stats;
+	int status;
+	DIR *directory = NULL;
+	struct dirent *result = NULL;
+	struct dirent *entry = (struct dirent *)malloc(
+			sizeof(struct dirent) + MAX_LENGTH);
+
+	queue_t *queue = create_queue();
+	WALK_t walk = { -1, NULL, SHARED_put_file_element, 0, 0 };
+	int frontier = 0;
+	element = (queue_element_t *)malloc(sizeof(queue_element_t));
+	if (element == NULL || entry == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	strcpy(element->path_name, root_path);
+	insert_element(queue, element);
+	frontier++;
+
+	while (queue->head != NULL)
+	{
+		element = remove_element(queue);
+		frontier--;
+
+		status = lstat(element->path_name, &file_stats);
+		if (status == -1)
+		{
+			printf("Error obtaining stats for %s \n", element->path_name);
+			free((void *)element);
+			continue;
+		}
+
+		if (deadline_skip(&file_stats)) /* Out of time: account for the entry, don't search it */
+		{
+			free((void *)element);
+			continue;
+		}
+
+		if (S_ISDIR(file_stats.st_mode))
+		{
+			directory = opendir(element->path_name);
+			if (directory == NULL)
+			{
+				printf("Unable to open directory %s \n", element->path_name);
+				free((void *)element);
+				continue;
+			}
+
+			while (1)
+			{
+				status = readdir_r(directory, entry, &result);
+				if (status != 0)
+				{
+					printf("Unable to read directory %s \n", element->path_name);
+					break;
+				}
+				if (result == NULL)
+					break;
+
+				if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+					continue;
+
+				if (filter_dirent(element->path_name, entry))
+					continue;
+
+				new_element = (queue_element_t *)malloc(sizeof(queue_element_t));
+				if (new_element == NULL)
+				{
+					perror("malloc");
+					exit(EXIT_FAILURE);
+				}
+
+				strcpy(new_element->path_name, element->path_name);
+				strcat(new_element->path_name, "/");
+				strcat(new_element->path_name, entry->d_name);
+				WALK_enqueue(&walk, queue, &frontier, new_element);
+			}
+
+			closedir(directory);
+			free((void *)element);
+		} else if (S_ISREG(file_stats.st_mode)
+				&& filter_file(element->path_name, &file_stats))
+		{ 	/* Filtered out by --ext, --min-size, --max-size, --newer or --older. */
+		} else if (S_ISREG(file_stats.st_mode))
+		{
+			element->mtime = file_stats.st_mtime;
+			element->dev = file_stats.st_dev;
+			progress_found(&file_stats);
+			SHARED_put_file_element(element); /* Ownership passes to the queue */
+		} else
+		{
+			free((void *)element);
+		}
+	}
+
+	free(entry);
+	free(queue);
+}
+
+void* post_files_thread(void* this_arg)
+{
+	post_files_from_tree((const char *)this_arg);
+
+	return ((void *)0);
+}
+
+/* Post the files of every root to the shared file queue. Each root is walked by its
+ * own thread, so a slow device holds up only its own walk; with --ordered the roots
+ * are walked one after another, in the order given. */
+void post_files_from_roots()
+{
+	pthread_t walker[NUM_ROOTS];
+	int i;
+
+	if (NUM_ROOTS == 1 || ORDERED)
+	{
+		for (i = 0; i < NUM_ROOTS; i++)
+			post_files_from_tree(ROOTS[i]);
+		return;
+	}
+
+	for (i = 0; i < NUM_ROOTS; i++)
+	{
+		if (pthread_create(&walker[i], NULL, post_files_thread, (void *)ROOTS[i]) != 0)
+		{
+			printf("Cannot create thread \n");
+			exit(0);
+		}
+	}
+	for (i = 0; i < NUM_ROOTS; i++)
+	{
+		pthread_join(walker[i], NULL);
+	}
+}
+
+/* Search each file taken from the shared queue until the producer has finished */
+void* parallel_search_stream_thread(void* this_arg)
+{
+	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg;
+	int thread_id = args_for_me->threadID;
+	char* search_string = args_for_me->search_string;
+	queue_element_t* element;
+	struct stat file_stats;
+	long long seq, count;
+	int device = -1;
+
+	thread_stats_attach(thread_id);
+
+	/* Workers above the tuner's target retire; it only lowers the target once */
+	while ((!AUTO_TUNING || thread_id < tune_target(&TUNE))
+			&& (element = SHARED_get_file_element(&seq, &device)) != NULL)
+	{
+		if (ORDERED)
+		{
+			reorder_wait(&REORDER, seq);
+		}
+		count = 0;
+
+		/* Paths are searched as given; directories are not walked. */
+		if (stat(element->path_name, &file_stats) == -1)
+		{
+			printf("Thread %d: Error obtaining stats for %s \n", thread_id,
+					element->path_name);
+		} else if (deadline_skip(&file_stats))
+		{	/* Out of time: account for the file, don't search it */
+		} else if (S_ISREG(file_stats.st_mode)
+				&& filter_file(element->path_name, &file_stats))
+		{ 	/* Filtered out by --ext, --min-size, --max-size, --newer or --older. */
+		} else if (S_ISREG(file_stats.st_mode))
+		{
+			if (VERBOSE)
+			{
+				printf("Thread %d: %s is a regular file. \n", thread_id,
+						element->path_name);
+			}
+
+			count = search_file(element->path_name, search_string, thread_id);
+		} else if (VERBOSE)
+		{
+			printf("Thread %d: %s is not a regular file, skipping. \n", thread_id,
+					element->path_name);
+		}
+
+		if (ORDERED)
+		{
+			reorder_put(&REORDER, seq, element->path_name, count);
+		}
+		free((void *)element);
+	}
+
+	SHARED_release_device(&device);
+
+	return ((void *)0);
+}
+
+/* Create streaming worker i */
+void stream_start_worker(STREAM_t* stream, int i)
+{
+	stream->args[i] = (ARGS_FOR_THREAD *)malloc(sizeof(ARGS_FOR_THREAD));
+	stream->args[i]->threadID = i;
+	stream->args[i]->num_elements = 0;
+	stream->args[i]->search_string = stream->search_string;
+
+	if ((pthread_create(&stream->threads[i], NULL,
+			parallel_search_stream_thread, (void *)stream->args[i])) != 0)
+	{
+		printf("Cannot create thread \n");
+		exit(0);
+	}
+	tune_pin_thread(stream->threads[i], i);
+}
+
+/* Tuner: feeds the bytes searched to TUNE every few milliseconds and starts the
+ * workers it asks for, until the walk has finished and no file is left waiting. The
+ * walk of a tree that fits in the queue is over long before the search, so it keeps
+ * going while the workers drain the queue. */
+void* parallel_search_stream_tuner_thread(void* this_arg)
+{
+	STREAM_t* stream = (STREAM_t *)this_arg;
+	struct timespec now, delay = { 0, TUNE_INTERVAL_MS * 1000000L / 4 };
+	int target;
+
+	while (!__atomic_load_n(&stream->done, __ATOMIC_RELAXED) || SHARED_files_waiting() > 0)
+	{
+		nanosleep(&delay, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		target = tune_update(&TUNE, progress_bytes_searched(),
+				now.tv_sec * 1000000000LL + now.tv_nsec);
+
+		while (stream->num_started < target)
+		{
+			stream_start_worker(stream, stream->num_started);
+			stream->num_started++;
+		}
+	}
+
+	return ((void *)0);
+}
+
+long long /* Parallel search of a NUL-separated path list read from stdin (e.g. find -print0),
+	 * or of the files of a tree walked by the main thread in serial-search order. */
+parallel_search_stream(char** argv)
+{
+	const int NUM_THREADS = AUTO_THREADS ? TUNE.max_threads : atoi(argv[3]);
+	pthread_t worker_thread[NUM_THREADS];
+	ARGS_FOR_THREAD* args_for_thread[NUM_THREADS];
+	STREAM_t stream = { worker_thread, args_for_thread, 0, false, argv[1] };
+	pthread_t tuner_thread;
+	int i;
+
+	SHARED_init();
+	thread_stats_begin(NUM_THREADS);
+
+	/* Start the workers first; they consume paths as soon as they arrive */
+	AUTO_TUNING = AUTO_THREADS;
+	for (i = 0; i < (AUTO_TUNING ? tune_target(&TUNE) : NUM_THREADS); i++)
+	{
+		stream_start_worker(&stream, i);
+		stream.num_started++;
+	}
+	if (AUTO_TUNING && pthread_create(&tuner_thread, NULL,
+			parallel_search_stream_tuner_thread, (void *)&stream) != 0)
+	{
+		printf("Cannot create thread \n");
+		exit(0);
+	}
+
+	if (strcmp(argv[2], "-") == 0)
+		post_files_from_stdin();
+	else
+		post_files_from_roots();
+	SHARED_finish();
+
+	/* The tuner stops once the queue is drained; only then is num_started final */
+	if (AUTO_TUNING)
+	{
+		__atomic_store_n(&stream.done, true, __ATOMIC_RELAXED);
+		pthread_join(tuner_thread, NULL);
+	}
+
+	for (i = 0; i < stream.num_started; i++)
+	{
+		pthread_join(worker_thread[i], NULL);
+		free(args_for_thread[i]);
+	}
+
+	return thread_stats_merge();
+}
+
+/* Pool mode: the search runs in a libminigrep context built from the command-line
+ * options, and only the results it reports are printed here. --dedup, --cold, the
+ * throttles and --deadline are features of this program, and main() refuses them. */
+void library_file_searched(void* arg, const char* path_name, long long count)
+{
+	progress_matched(count);
+	json_file_searched(path_name, count);
+	if (VERBOSE && count > 0)
+	{
+		printf("Found string %s %lld times within file %s. \n", (const char*)arg, count,
+				path_name);
+	}
+}
+
+void library_token_found(void* arg, const char* path_name, long long offset,
+		const char* token, size_t length)
+{
+	json_match(json_thread_writer(), path_name, offset, token, length);
+}
+
+long long parallel_search_library(char** argv)
+{
+	minigrep_t* search;
+	minigrep_stats_t stats;
+	long long num_occurrences = 0, count, errors = 0;
+	char error[256];
+	int i;
+
+	LIBRARY_OPTIONS.num_threads = atoi(argv[3]);
+	AUTO_FIXED = AUTO_THREADS;
+	LIBRARY_OPTIONS.on_file = library_file_searched;
+	if (JSON_MODE == JSON_MATCHES)
+	{
+		LIBRARY_OPTIONS.on_match = library_token_found;
+	}
+	LIBRARY_OPTIONS.arg = argv[1];
+
+	search = create_minigrep(argv[1], &LIBRARY_OPTIONS, error, sizeof(error));
+	if (search == NULL)
+	{
+		printf("Unable to start the search: %s \n", error);
+		exit(EXIT_FAILURE);
+	}
+
+	/* The roots are searched one after another by the same pool */
+	for (i = 0; i < NUM_ROOTS; i++)
+	{
+		count = minigrep_search(search, ROOTS[i]);
+		if (count == MINIGREP_ENOMEM)
+		{
+			printf("Out of memory searching %s \n", ROOTS[i]);
+			exit(EXIT_FAILURE);
+		} else if (count == MINIGREP_ELINK)
+		{
+			printf("%s is a symbolic link, not searched \n", ROOTS[i]);
+			count = 0;
+		} else if (count < 0)
+		{
+			printf("Error obtaining stats for %s \n", ROOTS[i]);
+			count = 0;
+		}
+		num_occurrences += count;
+
+		minigrep_get_stats(search, &stats);
+		PROGRESS.files_searched += stats.files_searched;
+		PROGRESS.bytes_searched += stats.bytes_searched;
+		PROGRESS.binary_skipped += stats.binary_skipped;
+		errors += stats.errors;
+	}
+	if (errors > 0)
+	{
+		printf("\n %lld files or directories could not be read. \n", errors);
+	}
+
+	free_minigrep(search);
+
+	return num_occurrences;
+}
+
+/* Sharded mode: the roots are split into shards, one per entry of a top directory, and
+ * a coordinator hands them to worker processes over Unix sockets (see shard.h). Each
+ * worker walks its shard depth-first in one thread and streams a record per file
+ * back; the coordinator prints and totals them. */
+long long shard_search_subtree(shard_worker_t* worker, const char* path_name, void* arg)
+{
+	WALK_t walk = { -1, (char*)arg, NULL, 0, 0 };
+
+	/* This is a worker process: results go to the coordinator, which prints them */
+	SHARD_WORKER = worker;
+	VERBOSE = false;
+	JSON_MODE = JSON_OFF;
+
+	WALK_depth_first(&walk, path_name);
+
+	return walk.num_occurrences;
+}
+
+void shard_file_searched(void* arg, const char* path_name, long long count)
+{
+	json_file_searched(path_name, count);
+	if (VERBOSE && count > 0)
+	{
+		printf("Found string %s %lld times within file %s. \n", (const char*)arg, count,
+				path_name);
+	}
+}
+
+/* Append path to the shard list */
+void shards_add(char*** shards, int* num_shards, int* max_shards, const char* path)
+{
+	if (*num_shards == *max_shards)
+	{
+		*max_shards = (*max_shards == 0) ? 64 : 2 * *max_shards;
+		*shards = (char**)realloc(*shards, sizeof(char*) * *max_shards);
+		if (*shards == NULL)
+		{
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	(*shards)[*num_shards] = strdup(path);
+	if ((*shards)[*num_shards] == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	(*num_shards)++;
+}
+
+/* Add a shard for each entry of the top directory root */
+void shards_add_root(const char* root, char*** shards, int* num_shards, int* max_shards)
+{
+	struct stat file_stats;
+	struct dirent* entry;
+	DIR* directory;
+	char path[MAX_LENGTH];
+
+	if (lstat(root, &file_stats) == -1)
+	{
+		printf("Error obtaining stats for %s \n", root);
+		return;
+	}
+
+	if (S_ISDIR(file_stats.st_mode) && (directory = opendir(root)) != NULL)
+	{
+		while ((entry = readdir(directory)) != NULL)
+		{
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+			if (filter_dirent(root, entry))
+				continue;
+
+			if (snprintf(path, MAX_LENGTH, "%s/%s", root, entry->d_name) >= MAX_LENGTH)
+			{
+				printf("Path too long, skipping: %s/%s \n", root, entry->d_name);
+				continue;
+			}
+			shards_add(shards, num_shards, max_shards, path);
+		}
+		closedir(directory);
+	} else
+	{
+		/* A single file, or a directory that cannot be listed here: one shard */
+		shards_add(shards, num_shards, max_shards, root);
+	}
+}
+
+long long parallel_search_sharded(char** argv)
+{
+	shard_options_t options;
+	char** shards = NULL;
+	int num_shards = 0, max_shards = 0;
+	long long num_occurrences;
+	int i;
+
+	AUTO_FIXED = AUTO_THREADS;
+	for (i = 0; i < NUM_ROOTS; i++)
+	{
+		shards_add_root(ROOTS[i], &shards, &num_shards, &max_shards);
+	}
+
+	options.num_workers = atoi(argv[3]);
+	options.fail_after = SHARD_FAIL_AFTER;
+	options.search = shard_search_subtree;
+	options.search_arg = argv[1];
+	options.on_file = shard_file_searched;
+	options.file_arg = argv[1];
+
+	num_occurrences = shard_search(shards, num_shards, &options, &SHARD_STATS);
+
+	for (i = 0; i < num_shards; i++)
+	{
+		free(shards[i]);
+	}
+	free(shards);
+
+	return num_occurrences;
+}
+
+/* Pipeline mode: a few I/O threads read files into a fixed pool of large aligned
+ * buffers, and the search threads only run the match kernel over filled buffers and
+ * return them to the pool. Memory use is bounded by the pool, and reads overlap with
+ * matching.
+ */
+void PIPELINE_init(int num_buffers)
+{
+	int i;
+
+	memset(&PIPELINE, 0, sizeof(PIPELINE));
+	pthread_mutex_init(&PIPELINE.mutex, NULL);
+	pthread_cond_init(&PIPELINE.cond_free, NULL);
+	pthread_cond_init(&PIPELINE.cond_filled, NULL);
+
+	PIPELINE.num_buffers = num_buffers;
+	PIPELINE.buffers = (PIPELINE_BUFFER_t*)malloc(
+			sizeof(PIPELINE_BUFFER_t) * num_buffers);
+	if (PIPELINE.buffers == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < num_buffers; i++)
+	{
+		if (posix_memalign((void**)&PIPELINE.buffers[i].data, COLD_ALIGN,
+				PIPELINE_CARRY_SIZE + PIPELINE_BUFFER_SIZE) != 0)
+		{
+			perror("posix_memalign");
+			exit(EXIT_FAILURE);
+		}
+		PIPELINE.buffers[i].data += PIPELINE_CARRY_SIZE;
+		PIPELINE.buffers[i].next = PIPELINE.free_list;
+		PIPELINE.free_list = &PIPELINE.buffers[i];
+	}
+}
+
+void PIPELINE_destroy()
+{
+	int i;
+
+	for (i = 0; i < PIPELINE.num_buffers; i++)
+		free(PIPELINE.buffers[i].data - PIPELINE_CARRY_SIZE);
+	free(PIPELINE.buffers);
+	pthread_mutex_destroy(&PIPELINE.mutex);
+	pthread_cond_destroy(&PIPELINE.cond_free);
+	pthread_cond_destroy(&PIPELINE.cond_filled);
+}
+
+/* Take an empty buffer from the pool, blocking until one is returned */
+PIPELINE_BUFFER_t* PIPELINE_get_free_buffer()
+{
+	PIPELINE_BUFFER_t* buffer;
+
+	pthread_mutex_lock(&PIPELINE.mutex);
+	while (PIPELINE.free_list == NULL)
+		pthread_cond_wait(&PIPELINE.cond_free, &PIPELINE.mutex);
+
+	buffer = PIPELINE.free_list;
+	PIPELINE.free_list = buffer->next;
+	pthread_mutex_unlock(&PIPELINE.mutex);
+
+	return buffer;
+}
+
+/* Hand a filled buffer to the search threads */
+void PIPELINE_put_filled_buffer(PIPELINE_BUFFER_t* buffer)
+{
+	buffer->next = NULL;
+
+	pthread_mutex_lock(&PIPELINE.mutex);
+	buffer->file->refs++;
+	__atomic_add_fetch(&PIPELINE.num_filled, 1, __ATOMIC_RELAXED);
+	if (PIPELINE.filled_tail == NULL)
+		PIPELINE.filled_head = buffer;
+	else
+		PIPELINE.filled_tail->next = buffer;
+	PIPELINE.filled_tail = buffer;
+	pthread_cond_signal(&PIPELINE.cond_filled);
+	pthread_mutex_unlock(&PIPELINE.mutex);
+}
+
+/* Take a filled buffer, blocking while the I/O threads are still reading. Returns
+ * NULL once all I/O threads have finished and every buffer has been taken. */
+PIPELINE_BUFFER_t* PIPELINE_get_filled_buffer()
+{
+	PIPELINE_BUFFER_t* buffer;
+
+	pthread_mutex_lock(&PIPELINE.mutex);
+	while (PIPELINE.filled_head == NULL && PIPELINE.io_running > 0)
+		pthread_cond_wait(&PIPELINE.cond_filled, &PIPELINE.mutex);
+
+	buffer = PIPELINE.filled_head;
+	if (buffer != NULL)
+	{
+		PIPELINE.filled_head = buffer->next;
+		if (PIPELINE.filled_head == NULL)
+			PIPELINE.filled_tail = NULL;
+		__atomic_sub_fetch(&PIPELINE.num_filled, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&PIPELINE.mutex);
+
+	return buffer;
+}
+
+/* Called once the file has been read and all of its buffers have been searched */
+void PIPELINE_file_finished(PIPELINE_FILE_t* file)
+{
+	if (ORDERED)
+	{
+		reorder_put(&REORDER, file->seq, file->path_name, file->count);
+	} else if (VERBOSE && file->count > 0)
+	{
+		printf("Found string %s %lld times within file %s. \n", PIPELINE.search_string,
+				file->count, file->path_name);
+	}
+	progress_matched(file->count);
+	json_file_searched(file->path_name, file->count);
+
+	if (DEDUP != NULL)
+	{
+		dedup_insert(DEDUP, &file->key, file->count);
+	}
+
+	free(file);
+}
+
+/* Report a file that was not handed to the search threads (--ordered needs a result
+ * for every sequence number) */
+void PIPELINE_file_skipped(long long seq, const char* path_name, long long count)
+{
+	if (ORDERED)
+	{
+		reorder_put(&REORDER, seq, path_name, count);
+	}
+}
+
+/* Drop one reference to a file, adding the matches found in one of its buffers */
+void PIPELINE_release_file(PIPELINE_FILE_t* file, long long count)
+{
+	bool finished;
+
+	pthread_mutex_lock(&PIPELINE.mutex);
+	file->count += count;
+	finished = (--file->refs == 0);
+	pthread_mutex_unlock(&PIPELINE.mutex);
+
+	if (finished)
+		PIPELINE_file_finished(file);
+}
+
+/* Return a searched buffer to the pool */
+void PIPELINE_return_buffer(PIPELINE_BUFFER_t* buffer)
+{
+	pthread_mutex_lock(&PIPELINE.mutex);
+	buffer->next = PIPELINE.free_list;
+	PIPELINE.free_list = buffer;
+	pthread_cond_signal(&PIPELINE.cond_free);
+	pthread_mutex_unlock(&PIPELINE.mutex);
+}
+
+/* Read files from the shared queue into pool buffers */
+void* parallel_search_pipeline_io_thread(void* this_arg)
+{
+	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg;
+	int thread_id = args_for_me->threadID;
+	queue_element_t* element;
+	PIPELINE_FILE_t* file;
+	PIPELINE_BUFFER_t* buffer, *next;
+	cold_file_t cold_file;
+	struct stat file_stats;
+	size_t filled, carry, length, split;
+	long long bytes_read;
+	ssize_t n;
+	long long seq, count;
+	int fd, device = -1;
+	gzip_reader_t gzip;
+	bool compressed;
+	long long compressed_read;
+
+	thread_stats_attach(thread_id);
+
+	while ((element = SHARED_get_file_element(&seq, &device)) != NULL)
+	{
+		if (ORDERED)
+		{
+			reorder_wait(&REORDER, seq);
+		}
+
+		/* Paths read from stdin are not checked by the walk, so stat every path here */
+		if (stat(element->path_name, &file_stats) == -1)
+		{
+			printf("I/O thread %d: Error obtaining stats for %s \n", thread_id,
+					element->path_name);
+			PIPELINE_file_skipped(seq, element->path_name, 0);
+			free((void *)element);
+			continue;
+		}
+
+		if (deadline_skip(&file_stats) || !S_ISREG(file_stats.st_mode)
+				|| filter_file(element->path_name, &file_stats))
+		{
+			PIPELINE_file_skipped(seq, element->path_name, 0);
+			free((void *)element);
+			continue;
+		}
+
+		throttle_acquire(&THROTTLE_FILES, 1);
+		fd = cold_open(element->path_name, COLD_MODE, &cold_file);
+		if (fd == -1)
+		{
+			printf("I/O thread %d: Unable to open file %s \n", thread_id,
+					element->path_name);
+			PIPELINE_file_skipped(seq, element->path_name, 0);
+			free((void *)element);
+			continue;
+		}
+
+		file = (PIPELINE_FILE_t*)malloc(sizeof(PIPELINE_FILE_t));
+		if (file == NULL)
+		{
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		strcpy(file->path_name, element->path_name);
+		file->count = 0;
+		file->refs = 1; 	/* Held by this thread until the whole file is read */
+		file->seq = seq;
+		free((void *)element);
+
+		/* Sniff the first block: binary files are skipped unless --binary is given */
+		buffer = PIPELINE_get_free_buffer();
+		n = read(fd, buffer->data, PIPELINE_BUFFER_SIZE);
+		compressed = (n > 0 && DECOMPRESS && gzip_is_compressed(buffer->data, n));
+		if (compressed)
+		{
+			/* Decompress on this thread, straight into the pool buffers */
+			if (gzip_open(&gzip, fd, buffer->data, n) == -1)
+			{
+				printf("I/O thread %d: Unable to start decompressing %s \n", thread_id,
+						file->path_name);
+				exit(EXIT_FAILURE);
+			}
+			n = gzip_read(&gzip, buffer->data, PIPELINE_BUFFER_SIZE);
+		}
+		if (n > 0 && !SEARCH_BINARY && match_is_binary(buffer->data, n))
+		{
+			if (VERBOSE)
+			{
+				printf("I/O thread %d: %s is a binary file, skipping. \n", thread_id,
+						file->path_name);
+			}
+			__atomic_add_fetch(&PROGRESS.binary_skipped, 1, __ATOMIC_RELAXED);
+			if (compressed)
+			{
+				gzip_close(&gzip);
+			}
+			PIPELINE_return_buffer(buffer);
+			cold_close(&cold_file);
+			PIPELINE_file_skipped(seq, file->path_name, 0);
+			free(file);
+			continue;
+		}
+
+		/* Identical contents were already searched: reuse the count */
+		if (DEDUP != NULL && dedup_lookup(DEDUP, fd, &file->key, &count))
+		{
+			progress_searched(file->key.size);
+			progress_matched(count);
+			json_file_searched(file->path_name, count);
+			if (compressed)
+			{
+				gzip_close(&gzip);
+			}
+			PIPELINE_return_buffer(buffer);
+			cold_close(&cold_file);
+			PIPELINE_file_skipped(seq, file->path_name, count);
+			free(file);
+			continue;
+		}
+
+		/* Fill each buffer completely, then cut it at the last token boundary and
+		 * carry the partial token over in front of the next buffer. Reads always
+		 * start at an aligned address, as O_DIRECT requires. */
+		carry = 0;
+		filled = 0;
+		bytes_read = 0;
+		compressed_read = 0;
+		while (1)
+		{
+			if (n == -1)
+			{
+				printf("I/O thread %d: Error reading file %s \n", thread_id,
+						file->path_name);
+				n = 0;
+			}
+			if (compressed)
+			{
+				throttle_acquire(&THROTTLE_BYTES, gzip.bytes_in - compressed_read);
+				compressed_read = gzip.bytes_in;
+			} else
+			{
+				throttle_acquire(&THROTTLE_BYTES, n);
+			}
+			bytes_read += n;
+
+			filled += n;
+			if (n == 0)
+				break;
+
+			if (filled == PIPELINE_BUFFER_SIZE)
+			{
+				buffer->start = buffer->data - carry;
+				length = carry + filled;
+				split = match_split(&DELIMITERS, buffer->start, length);
+				if (length - split > PIPELINE_CARRY_SIZE)
+					split = length; /* Token longer than the carry room: split it */
+
+				next = PIPELINE_get_free_buffer();
+				carry = length - split;
+				memcpy(next->data - carry, buffer->start + split, carry);
+
+				buffer->length = split;
+				buffer->offset = bytes_read - length;
+				buffer->file = file;
+				PIPELINE_put_filled_buffer(buffer);
+
+				buffer = next;
+				filled = 0;
+			}
+
+			if (compressed)
+				n = gzip_read(&gzip, buffer->data + filled, PIPELINE_BUFFER_SIZE - filled);
+			else
+				n = read(fd, buffer->data + filled, PIPELINE_BUFFER_SIZE - filled);
+		}
+
+		if (compressed)
+		{
+			progress_decompressed(&gzip);
+		}
+		cold_close(&cold_file);
+		progress_searched(bytes_read);
+
+		if (carry + filled > 0)
+		{
+			buffer->start = buffer->data - carry;
+			buffer->length = carry + filled;
+			buffer->offset = bytes_read - buffer->length;
+			buffer->file = file;
+			PIPELINE_put_filled_buffer(buffer);
+		} else
+		{
+			PIPELINE_return_buffer(buffer);
+		}
+
+		PIPELINE_release_file(file, 0);
+	}
+
+	/* The last I/O thread wakes up every search thread so they can exit */
+	SHARED_release_device(&device);
+	pthread_mutex_lock(&PIPELINE.mutex);
+	if (--PIPELINE.io_running == 0)
+		pthread_cond_broadcast(&PIPELINE.cond_filled);
+	pthread_mutex_unlock(&PIPELINE.mutex);
+
+	return ((void *)0);
+}
+
+/* Run the match kernel over filled buffers */
+void* parallel_search_pipeline_match_thread(void* this_arg)
+{
+	ARGS_FOR_THREAD* args_for_me = (ARGS_FOR_THREAD *)this_arg;
+	int thread_id = args_for_me->threadID;
+	char* search_string = args_for_me->search_string;
+	PIPELINE_BUFFER_t* buffer;
+	PIPELINE_FILE_t* file;
+	long long count;
+
+	/* The I/O threads have the first blocks */
+	thread_stats_attach(IO_THREADS + thread_id);
+
+	while ((buffer = PIPELINE_get_filled_buffer()) != NULL)
+	{
+		file = buffer->file;
+		if (JSON_MODE == JSON_MATCHES)
+			count = json_match_count(file->path_name, buffer->start, buffer->length,
+					buffer->offset, search_string);
+		else
+			count = MATCH_COUNT(&DELIMITERS, buffer->start, buffer->length, search_string);
+
+		PIPELINE_return_buffer(buffer);
+		PIPELINE_release_file(file, count);
+	}
+
+	if (VERBOSE)
+	{
+		printf("Thread %d: finished! \n", thread_id);
+	}
+
+	return ((void *)0);
+}
+
+long long /* Parallel search with separate I/O and matching threads sharing a buffer pool. */
+parallel_search_pipeline(char** argv)
+{
+	long long num_occurrences;
+
+	const int NUM_THREADS = atoi(argv[3]);
+	pthread_t worker_thread[NUM_THREADS];
+	pthread_t io_thread[IO_THREADS];
+	ARGS_FOR_THREAD args_for_worker[NUM_THREADS];
+	ARGS_FOR_THREAD args_for_io[IO_THREADS];
+	int num_buffers = NUM_BUFFERS;
+	int i;
+
+	thread_stats_begin(IO_THREADS + NUM_THREADS);
+
+	/* Every I/O thread may hold two buffers while carrying a partial token over */
+	if (num_buffers < 2 * IO_THREADS)
+		num_buffers = 2 * (IO_THREADS + NUM_THREADS);
+
+	SHARED_init();
+	PIPELINE_init(num_buffers);
+	PIPELINE.search_string = argv[1];
+	PIPELINE.io_running = IO_THREADS;
+
+	if (VERBOSE)
+	{
+		printf("Main thread: creating %d I/O threads and %d search threads, %d buffers of %d KiB \n",
+				IO_THREADS, NUM_THREADS, num_buffers, PIPELINE_BUFFER_SIZE / 1024);
+	}
+
+	for (i = 0; i < IO_THREADS; i++)
+	{
+		args_for_io[i].threadID = i;
+		args_for_io[i].num_elements = 0;
+		args_for_io[i].search_string = argv[1];
+		if ((pthread_create(&io_thread[i], NULL, parallel_search_pipeline_io_thread,
+				(void *)&args_for_io[i])) != 0)
+		{
+			printf("Cannot create thread \n");
+			exit(0);
+		}
+		tune_pin_thread(io_thread[i], i);
+	}
+
+	for (i = 0; i < NUM_THREADS; i++)
+	{
+		args_for_worker[i].threadID = i;
+		args_for_worker[i].num_elements = 0;
+		args_for_worker[i].search_string = argv[1];
+		if ((pthread_create(&worker_thread[i], NULL,
+				parallel_search_pipeline_match_thread, (void *)&args_for_worker[i])) != 0)
+		{
+			printf("Cannot create thread \n");
+			exit(0);
+		}
+		tune_pin_thread(worker_thread[i], IO_THREADS + i);
+	}
+
+	/* The main thread produces the file list while the pipeline runs */
+	if (strcmp(argv[2], "-") == 0)
+		post_files_from_stdin();
+	else
+		post_files_from_roots();
+	SHARED_finish();
+
+	for (i = 0; i < IO_THREADS; i++)
+		pthread_join(io_thread[i], NULL);
+
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(worker_thread[i], NULL);
+
+	num_occurrences = thread_stats_merge();
+
+	PIPELINE_destroy();
+
+	return num_occurrences;
+}
+
+/* Parse a number with an optional K, M or G (binary) suffix. Returns -1 if invalid. */
+double parse_size(const char* text)
+{
+	char* end;
+	double value = strtod(text, &end);
+
+	if (end == text || value < 0)
+		return -1;
+
+	switch (*end)
+	{
+	case 'k': case 'K': value *= 1024.0; end++; break;
+	case 'm': case 'M': value *= 1024.0 * 1024.0; end++; break;
+	case 'g': case 'G': value *= 1024.0 * 1024.0 * 1024.0; end++; break;
+	}
+
+	return (*end == '\0') ? value : -1;
+}
+
+/* MATCH_COUNT for --regex: the search string has already been compiled into DFA */
+int regex_count(const match_delimiters_t* delimiters, const char* buffer, size_t length,
+		const char* search_string)
+{
+	return dfa_count(DFA, delimiters, buffer, length);
+}
+
+/* Parse the argument of --newer or --older: "@SECONDS" since the epoch, a local time
+ * "YYYY-MM-DD[ HH:MM[:SS]]" (or with a 'T' between date and time), an age such as 90m,
+ * 12h or 7d counted back from now, or else the name of a file whose modification time
+ * is used, as with find -newer. Returns -1 if text is none of these. */
+time_t parse_time(const char* text)
+{
+	struct stat file_stats;
+	struct tm date;
+	long long value;
+	char* end;
+	int n = 0, m = 0;
+
+	if (text[0] == '@')
+	{
+		value = strtoll(text + 1, &end, 10);
+		return (end != text + 1 && *end == '\0') ? (time_t)value : -1;
+	}
+
+	memset(&date, 0, sizeof(date));
+	if (sscanf(text, "%4d-%2d-%2d%n", &date.tm_year, &date.tm_mon, &date.tm_mday, &n) == 3)
+	{
+		if ((text[n] == ' ' || text[n] == 'T')
+				&& sscanf(text + n + 1, "%2d:%2d%n", &date.tm_hour, &date.tm_min, &m) == 2)
+		{
+			n += 1 + m;
+			if (text[n] == ':' && sscanf(text + n + 1, "%2d%n", &date.tm_sec, &m) == 1)
+				n += 1 + m;
+		}
+		if (text[n] != '\0')
+			return -1;
+
+		date.tm_year -= 1900;
+		date.tm_mon -= 1;
+		date.tm_isdst = -1;
+		return mktime(&date);
+	}
+
+	value = strtoll(text, &end, 10);
+	if (end != text && value >= 0 && end[0] != '\0' && end[1] == '\0')
+	{
+		switch (end[0])
+		{
+		case 's':
+			return time(NULL) - (time_t)value;
+		case 'm':
+			return time(NULL) - (time_t)value * 60;
+		case 'h':
+			return time(NULL) - (time_t)value * 3600;
+		case 'd':
+			return time(NULL) - (time_t)value * 86400;
+		}
+	}
+
+	if (stat(text, &file_stats) == 0)
+		return file_stats.st_mtime;
+
+	return -1;
+}
+
+/* Add the comma-separated extensions of an --ext option (leading dots are optional) */
+void add_extensions(const char* list)
+{
+	char* copy = strdup(list);
+	char* saveptr;
+	char* token;
+
+	for (token = strtok_r(copy, ",", &saveptr); token != NULL;
+			token = strtok_r(NULL, ",", &saveptr))
+	{
+		if (*token == '.')
+			token++;
+		if (*token == '\0')
+			continue;
+		EXTENSIONS = (char**)realloc(EXTENSIONS,
+				(NUM_EXTENSIONS + 1) * sizeof(char*));
+		EXTENSIONS[NUM_EXTENSIONS++] = strdup(token);
+	}
+
+	free(copy);
+}
+
+/* Add a root to the search */
+void add_root(const char* path)
+{
+	if (strlen(path) >= MAX_LENGTH)
+	{
+		printf("Path too long: %s \n", path);
+		exit(EXIT_FAILURE);
+	}
+	ROOTS = (char**)realloc(ROOTS, sizeof(char*) * (NUM_ROOTS + 1));
+	if (ROOTS == NULL)
+	{
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+	ROOTS[NUM_ROOTS++] = (char*)path;
+}
+
+/* Lower the CPU and I/O priority of the calling thread. Called before any worker is
+ * created; new threads inherit both settings. */
+void set_background_priority(bool idle_io, bool set_nice, int nice_value)
+{
+	if (idle_io && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+			IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == -1)
+	{
+		perror("ioprio_set");
 	}
 
-	/* Same as above */
-	for (i = 0; i < NUM_THREADS; i++)
+	if (set_nice && setpriority(PRIO_PROCESS, 0, nice_value) == -1)
 	{
-		args_for_thread = (ARGS_FOR_THREAD*)malloc(sizeof(ARGS_FOR_THREAD)); // Allocate memory for the structure that will be used to pack the arguments
-		args_for_thread->search_string = (char*)malloc(sizeof(char) * 128);
-		args_for_thread->threadID = i;
-		num_el_to_thread = 0;
+		perror("setpriority");
+	}
+}
 
-		for (j = 0; j < items_per_thread; j++)
-		{
-			if (num_el_to_threads < num_el)
-			{
-				args_for_thread->elements[j] = remove_element(
-						SHARED.queue_files);
-				num_el_to_thread++;
-				num_el_to_threads++;
-			} else
-			{
-				break;
-			}
-		}
+/* --json: keep the original stdout for the records and send everything else that is
+ * printed to stderr */
+void json_redirect_stdout()
+{
+	int fd;
 
-		args_for_thread->num_elements = num_el_to_thread;
-		strcpy(args_for_thread->search_string, argv[1]);
-		if (VERBOSE)
-		{
-			printf("creating thread #%d... \n", i);
-		}
-		if ((pthread_create(&worker_thread[i], NULL,
-				parallel_search_dynamic_search_thread, (void *)args_for_thread))
-				!= 0)
-		{
-			printf("Cannot create thread \n");
-			exit(0);
-		}
+	fflush(stdout);
+	fd = dup(STDOUT_FILENO);
+	if (fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+	{
+		perror("dup");
+		exit(EXIT_FAILURE);
 	}
+	json_init(fd);
+}
 
-	// Wait for all the keyword searching worker threads to finish
-	for (i = 0; i < NUM_THREADS; i++)
-		pthread_join(worker_thread[i], NULL);
+/* --json: write out the records of the search, then its summary */
+void json_report(const char* search_string, long long num_occurrences,
+		const struct timeval* start, const struct timeval* stop)
+{
+	json_writer_t* writer;
+	json_summary_t summary;
+
+	if (JSON_MODE == JSON_OFF)
+		return;
+
+	summary.pattern = search_string;
+	summary.matches = num_occurrences;
+	summary.files_searched = PROGRESS.files_searched;
+	summary.files_matched = PROGRESS.files_matched;
+	summary.bytes_searched = PROGRESS.bytes_searched;
+	summary.seconds = stop->tv_sec - start->tv_sec
+			+ (stop->tv_usec - start->tv_usec) / 1000000.0;
+
+	/* The worker threads are done: their records go out before the summary */
+	json_flush_all();
+	writer = json_thread_writer();
+	json_summary(writer, &summary);
+	json_flush(writer);
+}
 
-	/* Tally up the num_occurrences from the shared RESULTS[] array */
-	for (i = 0; i < NUM_THREADS; i++)
+/* Persist caches and free the global search state */
+void search_cleanup()
+{
+	if (DEDUP != NULL && dedup_save(DEDUP) != 0)
 	{
-		num_occurrences = num_occurrences + RESULTS[i];
+		perror("dedup cache");
 	}
+	free_dedup(DEDUP);
+	free_exclude(EXCLUDE);
+	free_dfa(DFA);
 
-	/* Free shared data structures */
-	free(RESULTS_original);
+	if (ORDERED)
+	{
+		reorder_destroy(&REORDER);
+	}
 
-	return num_occurrences;
+	while (NUM_EXTENSIONS > 0)
+		free(EXTENSIONS[--NUM_EXTENSIONS]);
+	free(EXTENSIONS);
+	free(ROOTS);
+	free(THREAD_STATS);
+	while (NUM_RETIRED_STATS > 0)
+		free(RETIRED_STATS[--NUM_RETIRED_STATS]);
+	free(RETIRED_STATS);
+	if (JSON_MODE != JSON_OFF)
+	{
+		json_finish();
+	}
 }
 
 int main(int argc, char** argv)
@@ -1082,17 +3564,102 @@ int main(int argc, char** argv)
 
 	if (argc < 5)
 	{
-		printf("%s search-string path num-threads static [VERBOSE]\n", argv[0]);
+		printf("%s search-string path num-threads static [VERBOSE] [OPTIONS]\n", argv[0]);
+		printf("or \n");
+		printf("%s search-string path num-threads dynamic [VERBOSE] [OPTIONS]\n",
+				argv[0]);
+		printf("or \n");
+		printf("%s search-string path num-threads pipeline [VERBOSE] [OPTIONS]\n",
+				argv[0]);
 		printf("or \n");
-		printf("%s search-string path num-threads dynamic [VERBOSE]\n",
+		printf("%s search-string path num-threads pool [VERBOSE] [OPTIONS]\n", argv[0]);
+		printf("or \n");
+		printf("%s search-string path num-processes sharded [VERBOSE] [OPTIONS]\n",
 				argv[0]);
 		printf(
 				"[VERBOSE] - optional, enter 'true' for verbose output, 'false' for minimal output\n");
+		printf("num-threads - 'auto' starts with %d thread and adds threads while the\n",
+				TUNE_START_THREADS);
+		printf("              throughput keeps rising (static, dynamic and pipeline then\n");
+		printf("              search as the tree is walked); pool and sharded use one per CPU\n");
+		printf("path - '-' reads a NUL-separated list of files from stdin (e.g. find -print0)\n");
+		printf("pool, sharded - take no --dedup, --cold, --max-*-per-sec or --deadline\n");
+		printf("[OPTIONS]:\n");
+		printf("  --exclude=GLOB       skip files and directories matching GLOB (repeatable)\n");
+		printf("  --exclude-from=FILE  read gitignore-style exclusion patterns from FILE\n");
+		printf("  --dedup              search files with identical contents only once\n");
+		printf("  --dedup-cache=FILE   as --dedup, keeping file hashes in FILE between runs\n");
+		printf("  --io-threads=N       pipeline: number of threads reading files (default 2)\n");
+		printf("  --buffers=N          pipeline: number of 1 MiB buffers in the pool\n");
+		printf("  --cold[=direct|fadvise] read with O_DIRECT (default) or drop the pages read\n");
+		printf("                       with fadvise, leaving the page cache as it was\n");
+		printf("  --max-bytes-per-sec=N[K|M|G]  limit the read bandwidth of all threads\n");
+		printf("  --max-files-per-sec=N         limit the rate at which files are opened\n");
+		printf("  --idle-io            use the idle I/O scheduling class (ioprio_set)\n");
+		printf("  --nice=N             run at nice level N\n");
+		printf("  --deadline=SECONDS   stop each search after SECONDS and report partial counts\n");
+		printf("  -i, --ignore-case    ignore the case of ASCII letters\n");
+		printf("  -E, --regex          search-string is a regular expression (see dfa.h)\n");
+		printf("  --delimiters=CHARS   characters separating tokens (default \"%s\");\n",
+				MATCH_DELIMITERS);
+		printf("                       newline and NUL always separate tokens\n");
+		printf("  --ordered[=N]        print path:count for every file with matches, in\n");
+		printf("                       serial-search order, holding up to N results (default %d);\n",
+				REORDER_WINDOW);
+		printf("                       not with pool or sharded\n");
+		printf("  --max-frontier=N     walk depth-first once a traversal queue holds N entries\n");
+		printf("                       (default %d, 0 = no limit)\n", DEFAULT_MAX_FRONTIER);
+		printf("  --binary             also search files detected as binary\n");
+		printf("  -z, --decompress     search inside gzip files, decompressing as they are read\n");
+		printf("  --ext=LIST           only search files with these extensions (e.g. c,h)\n");
+		printf("  --min-size=N[K|M|G]  skip files smaller than N bytes\n");
+		printf("  --max-size=N[K|M|G]  skip files larger than N bytes\n");
+		printf("  --newer=TIME         only search files modified at or after TIME: @SECONDS,\n");
+		printf("                       YYYY-MM-DD[ HH:MM[:SS]], an age (90m, 12h, 7d) or a\n");
+		printf("                       file whose mtime is used; dynamic mode then searches\n");
+		printf("                       the newest files first\n");
+		printf("  --older=TIME         only search files modified before TIME\n");
+		printf("  --root=PATH          also search PATH (repeatable); the roots are walked\n");
+		printf("                       side by side and share one scheduler\n");
+		printf("  --per-device=N       search at most N files of one device at a time, so a\n");
+		printf("                       slow device cannot take up every thread\n");
+		printf("  --pin=cores|nodes    pin worker threads round-robin to CPUs or NUMA nodes\n");
+		printf("  --json[=files]       write JSON Lines to stdout: a record per match and per\n");
+		printf("                       file with matches (only per file with =files), then a\n");
+		printf("                       summary; other output goes to stderr and there is no\n");
+		printf("                       serial reference run. Sharded mode has no match records\n");
+		printf("  --progress=SECONDS   print progress to stderr every SECONDS; a report is\n");
+		printf("                       also printed on SIGUSR1 (kill -USR1 PID)\n");
+		printf("  --shard-fail-after=N sharded: kill the first worker after N files, to\n");
+		printf("                       exercise shard reassignment\n");
 		exit(EXIT_FAILURE);
 	}
 
+	/* With --json stdout carries the records only, so it must be set aside before
+	 * anything else is printed */
+	for (int i = 5; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--json") == 0 || strncmp(argv[i], "--json=", 7) == 0)
+		{
+			json_redirect_stdout();
+			break;
+		}
+	}
+
+	EXCLUDE = create_exclude();
+	add_root(argv[2]);
+
+	double max_bytes_per_sec = 0, max_files_per_sec = 0;
+	bool idle_io = false, set_nice = false;
+	bool ignore_case = false, regex = false;
+	const char* delimiters = MATCH_DELIMITERS;
+	int reorder_window = REORDER_WINDOW;
+	char regex_error[256];
+	int nice_value = 0;
+
 	/* Check for extra VERBOSE argument */
-	if (argc == 6)
+	int arg = 5;
+	if (argc > 5 && argv[5][0] != '-')
 	{
 		if (strcmp(argv[5], "true") == 0)
 		{
@@ -1104,13 +3671,308 @@ int main(int argc, char** argv)
 		{
 			printf("Unknown extra argument, proceeding with VERBOSE = true\n");
 		}
+		arg++;
 	} else
 	{
 		printf("No extra argument, proceeding with VERBOSE = true\n");
 
 	}
 
-	int num_occurrences;
+	/* Remaining arguments are options */
+	for (; arg < argc; arg++)
+	{
+		if (strncmp(argv[arg], "--exclude=", 10) == 0)
+		{
+			exclude_add_pattern(EXCLUDE, argv[arg] + 10);
+		} else if (strncmp(argv[arg], "--exclude-from=", 15) == 0)
+		{
+			if (exclude_add_file(EXCLUDE, argv[arg] + 15) != 0)
+			{
+				printf("Unable to read exclusion file %s \n", argv[arg] + 15);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "--dedup") == 0)
+		{
+			if (DEDUP == NULL)
+				DEDUP = create_dedup(NULL);
+		} else if (strncmp(argv[arg], "--dedup-cache=", 14) == 0)
+		{
+			free_dedup(DEDUP);
+			DEDUP = create_dedup(argv[arg] + 14);
+		} else if (strncmp(argv[arg], "--io-threads=", 13) == 0)
+		{
+			IO_THREADS = atoi(argv[arg] + 13);
+			if (IO_THREADS < 1)
+			{
+				printf("Invalid number of I/O threads %s \n", argv[arg] + 13);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "--cold") == 0
+				|| strcmp(argv[arg], "--cold=direct") == 0)
+		{
+			COLD_MODE = COLD_DIRECT;
+		} else if (strcmp(argv[arg], "--cold=fadvise") == 0)
+		{
+			COLD_MODE = COLD_FADVISE;
+		} else if (strncmp(argv[arg], "--max-bytes-per-sec=", 20) == 0)
+		{
+			max_bytes_per_sec = parse_size(argv[arg] + 20);
+			if (max_bytes_per_sec <= 0)
+			{
+				printf("Invalid bandwidth limit %s \n", argv[arg] + 20);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strncmp(argv[arg], "--max-files-per-sec=", 20) == 0)
+		{
+			max_files_per_sec = parse_size(argv[arg] + 20);
+			if (max_files_per_sec <= 0)
+			{
+				printf("Invalid file rate limit %s \n", argv[arg] + 20);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strncmp(argv[arg], "--deadline=", 11) == 0)
+		{
+			DEADLINE = atof(argv[arg] + 11);
+			if (DEADLINE <= 0)
+			{
+				printf("Invalid deadline %s \n", argv[arg] + 11);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "-i") == 0
+				|| strcmp(argv[arg], "--ignore-case") == 0)
+		{
+			ignore_case = true;
+		} else if (strcmp(argv[arg], "-E") == 0
+				|| strcmp(argv[arg], "--regex") == 0)
+		{
+			regex = true;
+		} else if (strncmp(argv[arg], "--delimiters=", 13) == 0)
+		{
+			delimiters = argv[arg] + 13;
+		} else if (strcmp(argv[arg], "--ordered") == 0
+				|| strncmp(argv[arg], "--ordered=", 10) == 0)
+		{
+			ORDERED = true;
+			if (argv[arg][9] == '=')
+			{
+				reorder_window = atoi(argv[arg] + 10);
+				if (reorder_window < 1)
+				{
+					printf("Invalid reorder window %s \n", argv[arg] + 10);
+					exit(EXIT_FAILURE);
+				}
+			}
+		} else if (strncmp(argv[arg], "--root=", 7) == 0)
+		{
+			add_root(argv[arg] + 7);
+		} else if (strncmp(argv[arg], "--per-device=", 13) == 0)
+		{
+			DEVICE_LIMIT = atoi(argv[arg] + 13);
+			if (DEVICE_LIMIT < 1)
+			{
+				printf("Invalid per-device limit %s \n", argv[arg] + 13);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "--pin=cores") == 0)
+		{
+			PIN_MODE = TUNE_PIN_CORES;
+		} else if (strcmp(argv[arg], "--pin=nodes") == 0)
+		{
+			PIN_MODE = TUNE_PIN_NODES;
+		} else if (strncmp(argv[arg], "--max-frontier=", 15) == 0)
+		{
+			MAX_FRONTIER = atoi(argv[arg] + 15);
+			if (MAX_FRONTIER < 0)
+			{
+				printf("Invalid frontier size %s \n", argv[arg] + 15);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "--binary") == 0)
+		{
+			SEARCH_BINARY = true;
+		} else if (strcmp(argv[arg], "-z") == 0 || strcmp(argv[arg], "--decompress") == 0)
+		{
+			DECOMPRESS = true;
+		} else if (strncmp(argv[arg], "--ext=", 6) == 0)
+		{
+			add_extensions(argv[arg] + 6);
+		} else if (strncmp(argv[arg], "--min-size=", 11) == 0)
+		{
+			MIN_SIZE = (long long)parse_size(argv[arg] + 11);
+			if (MIN_SIZE < 0)
+			{
+				printf("Invalid minimum size %s \n", argv[arg] + 11);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "--json") == 0)
+		{
+			JSON_MODE = JSON_MATCHES;
+		} else if (strcmp(argv[arg], "--json=files") == 0)
+		{
+			JSON_MODE = JSON_FILES;
+		} else if (strncmp(argv[arg], "--progress=", 11) == 0)
+		{
+			PROGRESS_INTERVAL = atof(argv[arg] + 11);
+			if (PROGRESS_INTERVAL <= 0)
+			{
+				printf("Invalid progress interval %s \n", argv[arg] + 11);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strncmp(argv[arg], "--shard-fail-after=", 19) == 0)
+		{
+			SHARD_FAIL_AFTER = atoi(argv[arg] + 19);
+		} else if (strncmp(argv[arg], "--newer=", 8) == 0)
+		{
+			NEWER = parse_time(argv[arg] + 8);
+			if (NEWER < 0)
+			{
+				printf("Invalid time %s \n", argv[arg] + 8);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strncmp(argv[arg], "--older=", 8) == 0)
+		{
+			OLDER = parse_time(argv[arg] + 8);
+			if (OLDER < 0)
+			{
+				printf("Invalid time %s \n", argv[arg] + 8);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strncmp(argv[arg], "--max-size=", 11) == 0)
+		{
+			MAX_SIZE = (long long)parse_size(argv[arg] + 11);
+			if (MAX_SIZE < 0)
+			{
+				printf("Invalid maximum size %s \n", argv[arg] + 11);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[arg], "--idle-io") == 0)
+		{
+			idle_io = true;
+		} else if (strncmp(argv[arg], "--nice=", 7) == 0)
+		{
+			set_nice = true;
+			nice_value = atoi(argv[arg] + 7);
+		} else if (strncmp(argv[arg], "--buffers=", 10) == 0)
+		{
+			NUM_BUFFERS = atoi(argv[arg] + 10);
+		} else
+		{
+			printf("Unknown option %s \n", argv[arg]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* The pool and the worker processes report files as they finish them, in no
+	 * particular order */
+	if (ORDERED && (strcmp(argv[4], "pool") == 0 || strcmp(argv[4], "sharded") == 0))
+	{
+		printf("--ordered cannot be combined with the %s mode \n", argv[4]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* The pool searches in libminigrep, which has no dedup cache, cold reads, throttles
+	 * or deadline. Sharded workers would each keep their own, per process, and send
+	 * none of their figures back. Refuse them rather than report figures nothing
+	 * collected. */
+	if (strcmp(argv[4], "pool") == 0 || strcmp(argv[4], "sharded") == 0)
+	{
+		const char* unsupported = NULL;
+
+		if (DEDUP != NULL)
+			unsupported = "--dedup";
+		else if (COLD_MODE != COLD_OFF)
+			unsupported = "--cold";
+		else if (max_bytes_per_sec > 0)
+			unsupported = "--max-bytes-per-sec";
+		else if (max_files_per_sec > 0)
+			unsupported = "--max-files-per-sec";
+		else if (DEADLINE > 0)
+			unsupported = "--deadline";
+
+		if (unsupported != NULL)
+		{
+			printf("%s cannot be combined with the %s mode \n", unsupported, argv[4]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Compile the rules once; the worker threads share them read-only */
+	exclude_compile(EXCLUDE);
+
+	match_init_delimiters(&DELIMITERS, delimiters);
+
+	if (ORDERED)
+	{
+		reorder_init(&REORDER, reorder_window);
+	}
+	if (JSON_MODE != JSON_OFF && ORDERED)
+	{
+		ORDERED_JSON = create_json_writer();
+		reorder_set_printer(&REORDER, json_file_ordered, ORDERED_JSON);
+	}
+	if (JSON_MODE == JSON_MATCHES && DEDUP != NULL)
+	{
+		/* A file found to be a copy would get a count but no match records */
+		printf("--dedup does not apply to --json match records; searching every file. \n");
+		free_dedup(DEDUP);
+		DEDUP = NULL;
+	}
+	if (VERBOSE)
+	{
+		printf("Token delimiters are classified with the %s kernel. \n",
+				match_classifier_name(&DELIMITERS));
+	}
+
+	if (regex)
+	{
+		DFA = create_dfa(argv[1], ignore_case, regex_error, sizeof(regex_error));
+		if (DFA == NULL)
+		{
+			printf("Invalid regular expression %s: %s \n", argv[1], regex_error);
+			exit(EXIT_FAILURE);
+		}
+		MATCH_COUNT = regex_count;
+	} else if (ignore_case)
+	{
+		MATCH_COUNT = match_count_nocase;
+	}
+
+	minigrep_default_options(&LIBRARY_OPTIONS);
+	LIBRARY_OPTIONS.ignore_case = ignore_case;
+	LIBRARY_OPTIONS.regex = regex;
+	LIBRARY_OPTIONS.search_binary = SEARCH_BINARY;
+	LIBRARY_OPTIONS.decompress = DECOMPRESS;
+	LIBRARY_OPTIONS.delimiters = delimiters;
+	LIBRARY_OPTIONS.min_size = MIN_SIZE;
+	LIBRARY_OPTIONS.max_size = MAX_SIZE;
+	LIBRARY_OPTIONS.newer = NEWER;
+	LIBRARY_OPTIONS.older = OLDER;
+	LIBRARY_OPTIONS.extensions = EXTENSIONS;
+	LIBRARY_OPTIONS.num_extensions = NUM_EXTENSIONS;
+	LIBRARY_OPTIONS.exclude = EXCLUDE;
+
+	throttle_init(&THROTTLE_BYTES, max_bytes_per_sec,
+			max_bytes_per_sec * THROTTLE_BURST_SECONDS);
+	throttle_init(&THROTTLE_FILES, max_files_per_sec,
+			max_files_per_sec * THROTTLE_BURST_SECONDS < 1 ?
+					1 : max_files_per_sec * THROTTLE_BURST_SECONDS);
+	set_background_priority(idle_io, set_nice, nice_value);
+	progress_start();
+
+	if (strcmp(argv[3], "auto") == 0)
+	{
+		/* Up to four threads per CPU: reads from slow storage overlap */
+		AUTO_THREADS = true;
+		tune_init(&TUNE, 4 * tune_online_cpus());
+		snprintf(AUTO_THREADS_ARG, sizeof(AUTO_THREADS_ARG), "%d", tune_online_cpus());
+		argv[3] = AUTO_THREADS_ARG;
+	}
+	if (tune_init_affinity(PIN_MODE) == -1)
+	{
+		printf("Cannot pin threads; running them unpinned. \n");
+	}
+
+	long long num_occurrences;
 	struct timeval start, stop;
 
 	if (pthread_mutex_init(&mutex_shared, NULL) != 0)
@@ -1125,64 +3987,210 @@ int main(int argc, char** argv)
 		exit(1);
 	}
 
-	gettimeofday(&start, NULL); /* Start timing */
+	if (strcmp(argv[2], "-") == 0 && NUM_ROOTS > 1)
+	{
+		printf("--root cannot be combined with a path list read from stdin \n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (strcmp(argv[2], "-") == 0)
+	{
+		/* The path list on stdin can only be consumed once, so there is no serial
+		 * reference run. The pipeline mode reads the list itself; static and dynamic
+		 * load balancing share the streaming queue. */
+		printf(
+				"\n Performing multi-threaded search of the paths read from stdin. \n");
+
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
+		if (strcmp(argv[4], "pipeline") == 0 && !AUTO_THREADS)
+			num_occurrences = parallel_search_pipeline(argv);
+		else
+			num_occurrences = parallel_search_stream(argv);
+		gettimeofday(&stop, NULL); /* Stop timing */
+
+		printf("\n The string %s was found %lld times within the file system.",
+				argv[1], num_occurrences);
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+		printf("\n");
+
+		json_report(argv[1], num_occurrences, &start, &stop);
+		search_cleanup();
+
+		exit(EXIT_SUCCESS);
+	}
+
+	/* With --json the records describe one search, so there is no serial reference run */
+	if (JSON_MODE == JSON_OFF)
+	{
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
 
-	num_occurrences = serial_search(argv); /* Perform a serial search of the file system. */
+		num_occurrences = serial_search(argv); /* Perform a serial search of the file system. */
 
-	gettimeofday(&stop, NULL); /* Stop timing */
-	printf("\n The string %s was found %d times within the file system. \n",
-			argv[1], num_occurrences);
+		gettimeofday(&stop, NULL); /* Stop timing */
+		printf("\n The string %s was found %lld times within the file system. \n",
+				argv[1], num_occurrences);
 
-	printf("\n Overall execution time = %fs.",
-			(float)(stop.tv_sec - start.tv_sec
-					+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+	}
 
 	/* Perform a multi-threaded search of the file system. */
-	if (strcmp(argv[4], "static") == 0)
+	if ((AUTO_THREADS
+			|| ((NUM_ROOTS > 1 || DEVICE_LIMIT > 0) && strcmp(argv[4], "pipeline") != 0))
+			&& strcmp(argv[4], "pool") != 0 && strcmp(argv[4], "sharded") != 0)
+	{
+		/* The thread count can only change while the workers share one queue, and
+		 * static and dynamic load balancing walk a single tree with no notion of
+		 * devices; so the roots are walked into the shared queue as for --ordered */
+		if (AUTO_THREADS)
+		{
+			printf(
+					"\n Performing multi-threaded search with an auto-tuned number of threads. \n");
+		} else
+		{
+			printf(
+					"\n Performing multi-threaded search of %d root(s) through per-device queues. \n",
+					NUM_ROOTS);
+		}
+
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
+		num_occurrences = parallel_search_stream(argv);
+		gettimeofday(&stop, NULL); /* Stop timing */
+
+		printf("\n The string %s was found %lld times within the file system.",
+				argv[1], num_occurrences);
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+	} else if (ORDERED && strcmp(argv[4], "pipeline") != 0)
+	{
+		/* Static and dynamic load balancing walk the tree in several threads, so
+		 * there is no single traversal order; walk it in the main thread instead. */
+		printf(
+				"\n Performing multi-threaded search in serial-search order. \n");
+
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
+		num_occurrences = parallel_search_stream(argv);
+		gettimeofday(&stop, NULL); /* Stop timing */
+
+		printf("\n The string %s was found %lld times within the file system.",
+				argv[1], num_occurrences);
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+	} else if (strcmp(argv[4], "static") == 0)
 	{
 		printf(
 				"\n Performing multi-threaded search using static load balancing. \n");
 
+		stats_begin();
 		gettimeofday(&start, NULL); /* Start timing */
 		num_occurrences = parallel_search_static(argv);
 		gettimeofday(&stop, NULL); /* Stop timing */
 
-		printf("\n The string %s was found %d times within the file system.",
+		printf("\n The string %s was found %lld times within the file system.",
 				argv[1], num_occurrences);
 		printf("\n Overall execution time = %fs.",
 				(float)(stop.tv_sec - start.tv_sec
 						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
 	} else if (strcmp(argv[4], "dynamic") == 0)
 	{
 		printf(
 				"\n Performing multi-threaded search using dynamic load balancing. \n");
 
+		stats_begin();
 		gettimeofday(&start, NULL); /* Start timing */
 		num_occurrences = parallel_search_dynamic(argv);
 		gettimeofday(&stop, NULL); /* Stop timing */
 
-		printf("\n The string %s was found %d times within the file system.",
+		printf("\n The string %s was found %lld times within the file system.",
+				argv[1], num_occurrences);
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+	} else if (strcmp(argv[4], "sharded") == 0)
+	{
+		printf(
+				"\n Performing multi-process search with %s worker processes. \n", argv[3]);
+
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
+		num_occurrences = parallel_search_sharded(argv);
+		gettimeofday(&stop, NULL); /* Stop timing */
+
+		printf("\n The string %s was found %lld times within the file system.",
+				argv[1], num_occurrences);
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+	} else if (strcmp(argv[4], "pool") == 0)
+	{
+		printf(
+				"\n Performing multi-threaded search with the libminigrep thread pool. \n");
+
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
+		num_occurrences = parallel_search_library(argv);
+		gettimeofday(&stop, NULL); /* Stop timing */
+
+		printf("\n The string %s was found %lld times within the file system.",
+				argv[1], num_occurrences);
+		printf("\n Overall execution time = %fs.",
+				(float)(stop.tv_sec - start.tv_sec
+						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
+	} else if (strcmp(argv[4], "pipeline") == 0)
+	{
+		printf(
+				"\n Performing multi-threaded search using separate I/O and search threads. \n");
+
+		stats_begin();
+		gettimeofday(&start, NULL); /* Start timing */
+		num_occurrences = parallel_search_pipeline(argv);
+		gettimeofday(&stop, NULL); /* Stop timing */
+
+		printf("\n The string %s was found %lld times within the file system.",
 				argv[1], num_occurrences);
 		printf("\n Overall execution time = %fs.",
 				(float)(stop.tv_sec - start.tv_sec
 						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
 	} else
 	{
 		printf(
 				"\n Unknown load balancing option provided. Defaulting to static load balancing. \n");
 
+		stats_begin();
 		gettimeofday(&start, NULL); /* Start timing */
 		num_occurrences = parallel_search_static(argv);
 		gettimeofday(&stop, NULL); /* Stop timing */
 
-		printf("\n The string %s was found %d times within the \file system.",
+		printf("\n The string %s was found %lld times within the \file system.",
 				argv[1], num_occurrences);
 		printf("\n Overall execution time = %fs.",
 				(float)(stop.tv_sec - start.tv_sec
 						+ (stop.tv_usec - start.tv_usec) / (float)1000000));
+		stats_report();
 	}
 
 	printf("\n");
 
+	json_report(argv[1], num_occurrences, &start, &stop);
+	search_cleanup();
+
 	exit(EXIT_SUCCESS);
 }
@@ -1,6 +1,8 @@
 #ifndef _QUEUE_H
 #define _QUEUE_H
 
+#include <sys/types.h>
+
 #define MAX_LENGTH 1024
 #define TRUE 1
 #define FALSE 0
@@ -8,6 +10,8 @@
 /* Data type for queue element. */
 typedef struct queue_element_tag{
     char path_name[MAX_LENGTH]; /* Stores the path corresponding to the file/directory. */
+    time_t mtime; /* Modification time, for files queued by a walk. */
+    dev_t dev; /* Device holding the file, for the per-device limits. */
 	struct queue_element_tag *next;
 } queue_element_t;
 
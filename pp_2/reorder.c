@@ -0,0 +1,109 @@
+/* Bounded reorder buffer that prints per-file results in traversal order.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reorder.h"
+
+void /* Set up a buffer holding up to window results. */
+reorder_init (reorder_t *reorder, int window)
+{
+	reorder->slots = (reorder_slot_t *)calloc(window, sizeof(reorder_slot_t));
+	if (reorder->slots == NULL)
+	{
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	reorder->window = window;
+	reorder->next = 0;
+	reorder->waits = 0;
+	reorder->print = NULL;
+	reorder->print_arg = NULL;
+	pthread_mutex_init(&reorder->mutex, NULL);
+	pthread_cond_init(&reorder->cond_advanced, NULL);
+}
+
+void /* Hand results to print instead of printing them */
+reorder_set_printer (reorder_t *reorder, reorder_print_fn print, void *arg)
+{
+	reorder->print = print;
+	reorder->print_arg = arg;
+}
+
+void /* Restart numbering at 0 before a search. */
+reorder_reset (reorder_t *reorder)
+{
+	int i;
+
+	pthread_mutex_lock(&reorder->mutex);
+	for (i = 0; i < reorder->window; i++)
+	{
+		free(reorder->slots[i].path_name);
+		memset(&reorder->slots[i], 0, sizeof(reorder_slot_t));
+	}
+	reorder->next = 0;
+	reorder->waits = 0;
+	pthread_mutex_unlock(&reorder->mutex);
+}
+
+void /* Wait until the result for seq fits in the window. Call before starting on seq. */
+reorder_wait (reorder_t *reorder, long long seq)
+{
+	pthread_mutex_lock(&reorder->mutex);
+	if (seq >= reorder->next + reorder->window)
+	{
+		reorder->waits++;
+		while (seq >= reorder->next + reorder->window)
+			pthread_cond_wait(&reorder->cond_advanced, &reorder->mutex);
+	}
+	pthread_mutex_unlock(&reorder->mutex);
+}
+
+void /* Record the result for seq and print every result that is now in order. */
+reorder_put (reorder_t *reorder, long long seq, const char *path_name, long long count)
+{
+	reorder_slot_t *slot;
+	bool advanced = false;
+
+	pthread_mutex_lock(&reorder->mutex);
+
+	slot = &reorder->slots[seq % reorder->window];
+	slot->ready = true;
+	slot->count = count;
+	slot->path_name = (count > 0) ? strdup(path_name) : NULL;
+
+	slot = &reorder->slots[reorder->next % reorder->window];
+	while (slot->ready)
+	{
+		if (slot->path_name != NULL)
+		{
+			if (reorder->print != NULL)
+				reorder->print(reorder->print_arg, slot->path_name, slot->count);
+			else
+				printf("%s:%lld\n", slot->path_name, slot->count);
+			free(slot->path_name);
+		}
+		memset(slot, 0, sizeof(reorder_slot_t));
+		reorder->next++;
+		advanced = true;
+		slot = &reorder->slots[reorder->next % reorder->window];
+	}
+
+	if (advanced)
+		pthread_cond_broadcast(&reorder->cond_advanced);
+	pthread_mutex_unlock(&reorder->mutex);
+}
+
+void
+reorder_destroy (reorder_t *reorder)
+{
+	reorder_reset(reorder);
+	free(reorder->slots);
+	pthread_mutex_destroy(&reorder->mutex);
+	pthread_cond_destroy(&reorder->cond_advanced);
+}
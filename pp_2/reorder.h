@@ -0,0 +1,50 @@
+#ifndef _REORDER_H
+#define _REORDER_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Reorder buffer for deterministic output. Every file taken from the traversal gets
+ * the next sequence number; workers report each file's result (with or without
+ * matches) under that number, in any order, and results are printed as "path:count"
+ * strictly in sequence order.
+ *
+ * The buffer holds "window" results. A worker only waits in reorder_wait() when it is
+ * about to start a file that is a whole window ahead of the oldest unreported one;
+ * reorder_put() never blocks, so the thread holding the oldest file always proceeds.
+ *
+ * A printer set with reorder_set_printer() gets the results in place of the
+ * "path:count" lines. It is called with the buffer's lock held, one result at a time.
+ */
+
+#define REORDER_WINDOW 1024
+
+/* arg, path, count */
+typedef void (*reorder_print_fn)(void *, const char *, long long);
+
+typedef struct reorder_slot_tag{
+	bool ready;
+	long long count;
+	char *path_name;	/* NULL if the file had no matches */
+} reorder_slot_t;
+
+typedef struct reorder_tag{
+	reorder_slot_t *slots;
+	int window;
+	long long next;		/* Oldest sequence number not yet printed */
+	long long waits;	/* Times a worker waited for the window to advance */
+	reorder_print_fn print;	/* NULL prints "path:count" */
+	void *print_arg;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_advanced;
+} reorder_t;
+
+/* Function definitions. */
+void reorder_init (reorder_t *, int);
+void reorder_set_printer (reorder_t *, reorder_print_fn, void *);
+void reorder_reset (reorder_t *);
+void reorder_wait (reorder_t *, long long);
+void reorder_put (reorder_t *, long long, const char *, long long);
+void reorder_destroy (reorder_t *);
+
+#endif
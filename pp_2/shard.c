@@ -0,0 +1,353 @@
+/* Sharded multi-process search: the coordinator and the worker loop.
+ *
+ * The coordinator polls the sockets of all its workers. A worker that becomes idle is
+ * given the next shard right away; reassigned shards are taken before new ones. A
+ * worker with nothing left to do is told to exit. Messages are written whole with one
+ * send() each and read with blocking reads, so a reader only ever waits for the rest
+ * of a message that is already on its way, or for end of file if the sender died.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "shard.h"
+
+#define SHARD_ASSIGN 1 	/* Coordinator -> worker: search the shard at path */
+#define SHARD_EXIT 2 		/* Coordinator -> worker: no more shards */
+#define SHARD_FILE 3 		/* Worker -> coordinator: count matches in the file at path */
+#define SHARD_DONE 4 		/* Worker -> coordinator: shard finished, count matches in all */
+
+typedef struct shard_message_tag{
+	uint32_t type;
+	uint32_t length; 		/* Bytes of path that follow */
+	int64_t count; 		/* A shard's total can pass 2^31 */
+} shard_message_t;
+
+struct shard_worker_tag{
+	int fd;
+	int fail_after;
+	int files_reported;
+};
+
+/* The coordinator's view of one worker process */
+typedef struct worker_slot_tag{
+	pid_t pid;
+	int fd; 					/* -1 once the process has exited */
+	int shard; 				/* Shard being searched, -1 while idle */
+} worker_slot_t;
+
+static int /* Returns -1 on error, or 0 if end of file came before any byte */
+read_full (int fd, void *buffer, size_t length)
+{
+	char *p = (char *)buffer;
+	ssize_t n;
+
+	while (length > 0)
+	{
+		n = read(fd, p, length);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+static int
+send_message (int fd, uint32_t type, long long count, const char *path)
+{
+	char buffer[sizeof(shard_message_t) + SHARD_MAX_PATH];
+	shard_message_t message;
+	size_t length = strlen(path);
+	size_t sent = 0;
+	ssize_t n;
+
+	if (length >= SHARD_MAX_PATH)
+		return -1;
+
+	message.type = type;
+	message.count = count;
+	message.length = (uint32_t)length;
+	memcpy(buffer, &message, sizeof(message));
+	memcpy(buffer + sizeof(message), path, length);
+	length += sizeof(message);
+
+	/* MSG_NOSIGNAL: a peer that died is an error to handle, not a SIGPIPE */
+	while (sent < length)
+	{
+		n = send(fd, buffer + sent, length - sent, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			return -1;
+		sent += n;
+	}
+	return 0;
+}
+
+static int /* Read one message into message and path (NUL-terminated). -1 on EOF or error. */
+receive_message (int fd, shard_message_t *message, char *path)
+{
+	if (read_full(fd, message, sizeof(shard_message_t)) == -1
+			|| message->length >= SHARD_MAX_PATH
+			|| read_full(fd, path, message->length) == -1)
+		return -1;
+
+	path[message->length] = '\0';
+	return 0;
+}
+
+/* Report a searched file to the coordinator. Called by the search function. */
+void
+shard_report_file (shard_worker_t *worker, const char *path, long long count)
+{
+	if (send_message(worker->fd, SHARD_FILE, count, path) == -1)
+		_exit(EXIT_FAILURE); 	/* The coordinator is gone */
+
+	worker->files_reported++;
+	if (worker->fail_after > 0 && worker->files_reported == worker->fail_after)
+		raise(SIGKILL);
+}
+
+static void
+worker_main (int fd, const shard_options_t *options, int fail_after)
+{
+	shard_worker_t worker = { fd, fail_after, 0 };
+	shard_message_t message;
+	char path[SHARD_MAX_PATH];
+	long long count;
+
+	while (receive_message(fd, &message, path) == 0 && message.type == SHARD_ASSIGN)
+	{
+		count = options->search(&worker, path, options->search_arg);
+		if (send_message(fd, SHARD_DONE, count, "") == -1)
+			break;
+	}
+
+	close(fd);
+	fflush(stdout);
+	_exit(EXIT_SUCCESS);
+}
+
+static void
+spawn_worker (worker_slot_t *slots, int num_slots, int i, const shard_options_t *options,
+		int fail_after, shard_stats_t *stats)
+{
+	int fds[2];
+	pid_t pid;
+	int j;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+	{
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	fflush(stdout); 	/* Or the child would print the parent's buffered output again */
+	pid = fork();
+	if (pid == -1)
+	{
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+
+	if (pid == 0)
+	{
+		close(fds[0]);
+		for (j = 0; j < num_slots; j++)
+		{
+			if (slots[j].fd != -1)
+				close(slots[j].fd);
+		}
+		worker_main(fds[1], options, fail_after);
+	}
+
+	close(fds[1]);
+	slots[i].pid = pid;
+	slots[i].fd = fds[0];
+	slots[i].shard = -1;
+	stats->workers_started++;
+}
+
+static void
+stop_worker (worker_slot_t *slot)
+{
+	close(slot->fd);
+	slot->fd = -1;
+	while (waitpid(slot->pid, NULL, 0) == -1 && errno == EINTR)
+		;
+}
+
+/* Search the shards with options->num_workers worker processes and return the total
+ * number of matches in the shards that were completed. */
+long long
+shard_search (char **shards, int num_shards, const shard_options_t *options,
+		shard_stats_t *stats)
+{
+	int num_slots = (options->num_workers < num_shards) ? options->num_workers : num_shards;
+	worker_slot_t *slots;
+	struct pollfd *fds;
+	int *slot_of_fd;
+	int *attempts;
+	int *todo; 				/* Ring of shards waiting for a worker */
+	int todo_head = 0, todo_count = num_shards;
+	int remaining = num_shards;
+	shard_message_t message;
+	char path[SHARD_MAX_PATH];
+	long long total = 0;
+	int i, n, shard;
+
+	memset(stats, 0, sizeof(shard_stats_t));
+	stats->shards = num_shards;
+	if (num_shards == 0)
+		return 0;
+	if (num_slots < 1)
+		num_slots = 1;
+
+	slots = (worker_slot_t *)malloc(num_slots * sizeof(worker_slot_t));
+	fds = (struct pollfd *)malloc(num_slots * sizeof(struct pollfd));
+	slot_of_fd = (int *)malloc(num_slots * sizeof(int));
+	attempts = (int *)calloc(num_shards, sizeof(int));
+	todo = (int *)malloc(num_shards * sizeof(int));
+	if (slots == NULL || fds == NULL || slot_of_fd == NULL || attempts == NULL
+			|| todo == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < num_shards; i++)
+		todo[i] = i;
+	for (i = 0; i < num_slots; i++)
+		slots[i].fd = -1;
+	for (i = 0; i < num_slots; i++)
+		spawn_worker(slots, num_slots, i, options, (i == 0) ? options->fail_after : 0, stats);
+
+	while (remaining > 0)
+	{
+		/* Hand out shards to idle workers, and let the rest go once nothing is left */
+		n = 0;
+		for (i = 0; i < num_slots; i++)
+		{
+			if (slots[i].fd == -1)
+				continue;
+
+			if (slots[i].shard == -1 && todo_count > 0)
+			{
+				slots[i].shard = todo[todo_head];
+				todo_head = (todo_head + 1) % num_shards;
+				todo_count--;
+				attempts[slots[i].shard]++;
+				send_message(slots[i].fd, SHARD_ASSIGN, 0, shards[slots[i].shard]);
+				/* A failed send shows up as end of file below */
+			} else if (slots[i].shard == -1)
+			{
+				send_message(slots[i].fd, SHARD_EXIT, 0, "");
+				stop_worker(&slots[i]);
+				continue;
+			}
+
+			fds[n].fd = slots[i].fd;
+			fds[n].events = POLLIN;
+			slot_of_fd[n] = i;
+			n++;
+		}
+
+		if (poll(fds, n, -1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			worker_slot_t *slot = &slots[slot_of_fd[i]];
+
+			if (fds[i].revents == 0)
+				continue;
+
+			if (receive_message(slot->fd, &message, path) == 0)
+			{
+				if (message.type == SHARD_FILE)
+				{
+					if (options->on_file != NULL)
+						options->on_file(options->file_arg, path, message.count);
+				} else if (message.type == SHARD_DONE)
+				{
+					total += message.count;
+					stats->completed++;
+					remaining--;
+					slot->shard = -1;
+				}
+				continue;
+			}
+
+			/* End of file: the worker died. Put its shard back and replace it. */
+			shard = slot->shard;
+			stop_worker(slot);
+			stats->workers_died++;
+			if (shard != -1 && attempts[shard] >= SHARD_MAX_ATTEMPTS)
+			{
+				printf("Giving up on shard %s: %d workers died searching it. \n",
+						shards[shard], attempts[shard]);
+				stats->failed++;
+				remaining--;
+			} else if (shard != -1)
+			{
+				printf("Worker process %d died searching shard %s; reassigning it. \n",
+						(int)slot->pid, shards[shard]);
+				todo_head = (todo_head + num_shards - 1) % num_shards;
+				todo[todo_head] = shard;
+				todo_count++;
+				stats->reassigned++;
+			}
+			if (remaining > 0)
+				spawn_worker(slots, num_slots, slot_of_fd[i], options, 0, stats);
+		}
+	}
+
+	for (i = 0; i < num_slots; i++)
+	{
+		if (slots[i].fd != -1)
+		{
+			send_message(slots[i].fd, SHARD_EXIT, 0, "");
+			stop_worker(&slots[i]);
+		}
+	}
+
+	free(slots);
+	free(fds);
+	free(slot_of_fd);
+	free(attempts);
+	free(todo);
+
+	return total;
+}
+
+void
+shard_print_stats (const shard_stats_t *stats)
+{
+	printf("\n Shards: %d of %d completed by %d worker processes (%d died, %d shards reassigned).",
+			stats->completed, stats->shards, stats->workers_started, stats->workers_died,
+			stats->reassigned);
+	if (stats->failed > 0)
+	{
+		printf("\n Shards: %d given up after %d attempts; counts are partial.",
+				stats->failed, SHARD_MAX_ATTEMPTS);
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sharded multi-process search. The coordinator forks worker processes, each connected
+ * to it by a Unix socket pair, and hands them shards (paths: a subtree or a single
+ * file) one at a time. A worker searches its shard in its own address space, streams
+ * one record per file back as it goes, and ends the shard with its total. Only
+ * completed shards count towards the result.
+ *
+ * A worker that dies (the socket reaches end of file before its shard is done) is
+ * reaped and replaced, and its shard goes back to the front of the list. The files it
+ * had already reported are reported again by the next worker. A shard that has killed
+ * SHARD_MAX_ATTEMPTS workers is given up on.
+ *
+ * Messages are a fixed header followed by "length" bytes of path, in both directions.
+ */
+
+#define SHARD_MAX_PATH 4096
+#define SHARD_MAX_ATTEMPTS 3
+
+typedef struct shard_worker_tag shard_worker_t;
+
+/* Runs in a worker: search the shard at path, report each file with
+ * shard_report_file() and return the number of matches. */
+typedef long long (*shard_search_fn)(shard_worker_t *, const char *, void *);
+
+/* Runs in the coordinator for every file record streamed back: arg, path, count */
+typedef void (*shard_file_fn)(void *, const char *, long long);
+
+typedef struct shard_options_tag{
+	int num_workers;
+	int fail_after; 			/* For testing: the first worker kills itself after
+									 * reporting this many files (0 = never) */
+	shard_search_fn search;
+	void *search_arg;
+	shard_file_fn on_file; 	/* May be NULL */
+	void *file_arg;
+} shard_options_t;
+
+typedef struct shard_stats_tag{
+	int shards;
+	int completed;
+	int failed; 				/* Given up after SHARD_MAX_ATTEMPTS */
+	int workers_started;
+	int workers_died;
+	int reassigned;
+} shard_stats_t;
+
+/* Function definitions. */
+long long shard_search (char **, int, const shard_options_t *, shard_stats_t *);
+void shard_report_file (shard_worker_t *, const char *, long long);
+void shard_print_stats (const shard_stats_t *);
+
+#endif
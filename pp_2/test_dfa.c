@@ -0,0 +1,209 @@
+/* Differential test of the regular expression mode: dfa_count() is compared with
+ * POSIX regexec() applied to each token, over random patterns and buffers, with and
+ * without ignore_case. Every pattern is generated twice, in the syntax of dfa.h and
+ * as the equivalent POSIX extended expression (\d becomes [0-9], and so on).
+ *
+ * usage: ./test_dfa [patterns]
+ *
+ * Author: William Anderson
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include "dfa.h"
+
+#define MAX_PATTERN 256
+#define MAX_BUFFER 200
+#define BUFFERS_PER_PATTERN 20
+
+/* Token delimiters of the test; '.' is left out so that \. has something to match */
+#define DELIMITERS " ,"
+
+static const char ALPHABET[] = "aabbcAB019_.\t ,";
+
+typedef struct pattern_tag
+{
+	char dfa[MAX_PATTERN];
+	char posix[MAX_PATTERN];
+	size_t dfa_length;
+	size_t posix_length;
+} pattern_t;
+
+static void
+append (pattern_t *pattern, const char *dfa, const char *posix)
+{
+	size_t n = strlen(dfa), m = strlen(posix);
+
+	if (pattern->dfa_length + n < MAX_PATTERN && pattern->posix_length + m < MAX_PATTERN)
+	{
+		memcpy(pattern->dfa + pattern->dfa_length, dfa, n + 1);
+		memcpy(pattern->posix + pattern->posix_length, posix, m + 1);
+		pattern->dfa_length += n;
+		pattern->posix_length += m;
+	}
+}
+
+static void random_expression (pattern_t *, int);
+
+static void
+random_atom (pattern_t *pattern, int depth)
+{
+	static const char *atoms[][2] = {
+		{ "a", "a" }, { "b", "b" }, { "c", "c" }, { "A", "A" }, { "1", "1" },
+		{ ".", "." }, { "\\.", "\\." },
+		{ "[ab]", "[ab]" }, { "[^a]", "[^a]" }, { "[a-c]", "[a-c]" },
+		{ "[^b1]", "[^b1]" },
+		{ "\\d", "[0-9]" }, { "\\D", "[^0-9]" },
+		{ "\\w", "[A-Za-z0-9_]" }, { "\\W", "[^A-Za-z0-9_]" },
+		{ "\\s", "[ \t\n\r\f\v]" }, { "\\S", "[^ \t\n\r\f\v]" },
+	};
+	int n = sizeof(atoms) / sizeof(atoms[0]);
+
+	if (depth < 2 && rand() % 6 == 0)
+	{
+		append(pattern, "(", "(");
+		random_expression(pattern, depth + 1);
+		append(pattern, ")", ")");
+	} else
+	{
+		n = rand() % n;
+		append(pattern, atoms[n][0], atoms[n][1]);
+	}
+}
+
+static void
+random_expression (pattern_t *pattern, int depth)
+{
+	static const char *repeats[] = { "*", "+", "?" };
+	int branches = 1 + (rand() % 4 == 0);
+	int pieces, i, j;
+
+	for (i = 0; i < branches; i++)
+	{
+		if (i > 0)
+			append(pattern, "|", "|");
+		pieces = 1 + rand() % 3;
+		for (j = 0; j < pieces; j++)
+		{
+			random_atom(pattern, depth);
+			if (rand() % 4 == 0)
+			{
+				const char *repeat = repeats[rand() % 3];
+				append(pattern, repeat, repeat);
+			}
+		}
+	}
+}
+
+static void
+random_pattern (pattern_t *pattern)
+{
+	bool anchor_start = rand() % 4 == 0, anchor_end = rand() % 4 == 0;
+
+	pattern->dfa[0] = pattern->posix[0] = '\0';
+	pattern->dfa_length = pattern->posix_length = 0;
+
+	/* An anchor applies to the whole pattern, hence the group around alternatives */
+	if (anchor_start)
+		append(pattern, "^(", "^(");
+	else if (anchor_end)
+		append(pattern, "(", "(");
+	random_expression(pattern, 0);
+	if (anchor_start || anchor_end)
+		append(pattern, ")", ")");
+	if (anchor_end)
+		append(pattern, "$", "$");
+}
+
+static int /* Tokens of buffer matched by regex, split one byte at a time */
+posix_count (const regex_t *regex, const match_delimiters_t *delimiters,
+		const char *buffer, size_t length)
+{
+	char token[MAX_BUFFER + 1];
+	size_t i = 0, start;
+	int count = 0;
+
+	while (i < length)
+	{
+		while (i < length && match_is_delimiter(delimiters, buffer[i]))
+			i++;
+		start = i;
+		while (i < length && !match_is_delimiter(delimiters, buffer[i]))
+			i++;
+		if (i > start)
+		{
+			memcpy(token, buffer + start, i - start);
+			token[i - start] = '\0';
+			if (regexec(regex, token, 0, NULL, 0) == 0)
+				count++;
+		}
+	}
+	return count;
+}
+
+int main(int argc, char** argv)
+{
+	int num_patterns = (argc > 1) ? atoi(argv[1]) : 5000;
+	match_delimiters_t delimiters;
+	pattern_t pattern;
+	char buffer[MAX_BUFFER];
+	char error[256];
+	regex_t regex;
+	dfa_t *dfa;
+	size_t length;
+	int n, b, i, expected, count, failures = 0;
+	bool ignore_case;
+
+	srand(1);
+	match_init_delimiters(&delimiters, DELIMITERS);
+
+	for (n = 0; n < num_patterns && failures < 5; n++)
+	{
+		random_pattern(&pattern);
+		ignore_case = rand() % 2;
+
+		dfa = create_dfa(pattern.dfa, ignore_case, error, sizeof(error));
+		if (dfa == NULL)
+		{
+			printf("FAIL create_dfa(\"%s\"): %s\n", pattern.dfa, error);
+			failures++;
+			continue;
+		}
+		if (regcomp(&regex, pattern.posix,
+				REG_EXTENDED | REG_NOSUB | (ignore_case ? REG_ICASE : 0)) != 0)
+		{
+			printf("FAIL regcomp(\"%s\")\n", pattern.posix);
+			free_dfa(dfa);
+			failures++;
+			continue;
+		}
+
+		for (b = 0; b < BUFFERS_PER_PATTERN; b++)
+		{
+			length = rand() % MAX_BUFFER;
+			for (i = 0; i < (int)length; i++)
+				buffer[i] = ALPHABET[rand() % (int)(sizeof(ALPHABET) - 1)];
+
+			expected = posix_count(&regex, &delimiters, buffer, length);
+			count = dfa_count(dfa, &delimiters, buffer, length);
+			if (count != expected)
+			{
+				printf("FAIL \"%s\"%s (POSIX \"%s\"): expected %d, got %d\n  buffer: \"%.*s\"\n",
+						pattern.dfa, ignore_case ? " ignoring case" : "", pattern.posix,
+						expected, count, (int)length, buffer);
+				failures++;
+				break;
+			}
+		}
+
+		regfree(&regex);
+		free_dfa(dfa);
+	}
+
+	printf("dfa: %d patterns, %d failed\n", n, failures);
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
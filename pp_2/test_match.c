@@ -0,0 +1,235 @@
+/* Differential test of the match kernel: match_count(), match_count_nocase(),
+ * match_tokens() and match_split() are compared with a naive tokenizer over random
+ * buffers, search strings and delimiter sets, once with each classifier the CPU
+ * supports. match.c is included so that the classifiers can be chosen directly.
+ *
+ * usage: ./test_match [cases-per-classifier]
+ *
+ * Author: William Anderson
+ */
+
+#include "match.c" 	/* First: it defines _GNU_SOURCE */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_BUFFER 300
+
+/* Letters in both cases, the default delimiters and a few bytes from each end of the
+ * range, so that delimiter sets and buffers overlap often */
+static const char ALPHABET[] = "abcABCxyzXYZ ,.-_:\t\n\x01\x7f\x80\xa0\xff";
+
+typedef struct token_list_tag
+{
+	const char *starts[MAX_BUFFER];
+	size_t lengths[MAX_BUFFER];
+	int count;
+} token_list_t;
+
+static char
+random_byte (void)
+{
+	return ALPHABET[rand() % (int)(sizeof(ALPHABET) - 1)];
+}
+
+static bool
+equal_bytes (char a, char b, bool ignore_case)
+{
+	unsigned char x = (unsigned char)a, y = (unsigned char)b;
+
+	if (ignore_case)
+	{
+		if (x >= 'A' && x <= 'Z')
+			x |= 0x20;
+		if (y >= 'A' && y <= 'Z')
+			y |= 0x20;
+	}
+	return x == y;
+}
+
+static bool /* Does token[0 .. length) contain search_string? */
+naive_contains (const char *token, size_t length, const char *search_string,
+		bool ignore_case)
+{
+	size_t search_length = strlen(search_string);
+	size_t i, j;
+
+	for (i = 0; i + search_length <= length; i++)
+	{
+		for (j = 0; j < search_length; j++)
+		{
+			if (!equal_bytes(token[i + j], search_string[j], ignore_case))
+				break;
+		}
+		if (j == search_length)
+			return true;
+	}
+	return false;
+}
+
+static int /* Tokens containing search_string, split one byte at a time */
+naive_count (const match_delimiters_t *delimiters, const char *buffer, size_t length,
+		const char *search_string, bool ignore_case, token_list_t *tokens)
+{
+	size_t i = 0, start;
+
+	tokens->count = 0;
+	while (i < length)
+	{
+		while (i < length && match_is_delimiter(delimiters, buffer[i]))
+			i++;
+		start = i;
+		while (i < length && !match_is_delimiter(delimiters, buffer[i]))
+			i++;
+		if (i > start && naive_contains(buffer + start, i - start, search_string,
+				ignore_case))
+		{
+			tokens->starts[tokens->count] = buffer + start;
+			tokens->lengths[tokens->count] = i - start;
+			tokens->count++;
+		}
+	}
+	return tokens->count;
+}
+
+static size_t
+naive_split (const match_delimiters_t *delimiters, const char *buffer, size_t length)
+{
+	size_t i;
+
+	for (i = length; i > 0; i--)
+	{
+		if (match_is_delimiter(delimiters, buffer[i - 1]))
+			return i;
+	}
+	return length;
+}
+
+static void
+record_token (void *arg, const char *token, size_t length)
+{
+	token_list_t *tokens = (token_list_t *)arg;
+
+	if (tokens->count < MAX_BUFFER)
+	{
+		tokens->starts[tokens->count] = token;
+		tokens->lengths[tokens->count] = length;
+	}
+	tokens->count++;
+}
+
+static void
+print_case (const char *what, const char *chars, const char *buffer, size_t length,
+		const char *search_string, long long expected, long long got)
+{
+	size_t i;
+
+	printf("FAIL %s: expected %lld, got %lld\n  delimiters:", what, expected, got);
+	for (i = 0; chars[i] != '\0'; i++)
+		printf(" %02x", (unsigned char)chars[i]);
+	printf("\n  search:");
+	for (i = 0; search_string[i] != '\0'; i++)
+		printf(" %02x", (unsigned char)search_string[i]);
+	printf("\n  buffer:");
+	for (i = 0; i < length; i++)
+		printf(" %02x", (unsigned char)buffer[i]);
+	printf("\n");
+}
+
+static int /* Number of failed cases */
+run_cases (const char *classifier, uint32_t (*classify)(const match_delimiters_t *,
+		const char *), int num_cases)
+{
+	match_delimiters_t delimiters;
+	token_list_t expected, got;
+	char chars[16];
+	char buffer[MAX_BUFFER];
+	char search_string[5];
+	size_t length, split;
+	int n, i, size, count, num_run = 0, failures = 0;
+	bool ignore_case;
+
+	for (n = 0; n < num_cases && failures < 5; n++)
+	{
+		size = rand() % 12;
+		for (i = 0; i < size; i++)
+			chars[i] = random_byte();
+		chars[i] = '\0';
+		match_init_delimiters(&delimiters, chars);
+
+		/* The table classifier works for every set; the nibble tables only for sets
+		 * that match_init_delimiters() found a vector classifier for */
+		if (classify != classify_table && delimiters.classify == classify_table)
+			continue;
+		delimiters.classify = classify;
+		num_run++;
+
+		length = rand() % MAX_BUFFER;
+		for (i = 0; i < (int)length; i++)
+			buffer[i] = random_byte();
+
+		size = rand() % 5;
+		for (i = 0; i < size; i++)
+			search_string[i] = random_byte();
+		search_string[i] = '\0';
+		ignore_case = rand() % 2;
+
+		naive_count(&delimiters, buffer, length, search_string, ignore_case, &expected);
+		if (ignore_case)
+			count = match_count_nocase(&delimiters, buffer, length, search_string);
+		else
+			count = match_count(&delimiters, buffer, length, search_string);
+		if (count != expected.count)
+		{
+			print_case(ignore_case ? "match_count_nocase" : "match_count", chars,
+					buffer, length, search_string, expected.count, count);
+			failures++;
+			continue;
+		}
+
+		got.count = 0;
+		match_tokens(&delimiters, buffer, length, search_string, ignore_case,
+				record_token, &got);
+		for (i = 0; i < got.count && i < expected.count; i++)
+		{
+			if (got.starts[i] != expected.starts[i]
+					|| got.lengths[i] != expected.lengths[i])
+				break;
+		}
+		if (got.count != expected.count || i < got.count)
+		{
+			print_case("match_tokens", chars, buffer, length, search_string,
+					expected.count, got.count);
+			failures++;
+			continue;
+		}
+
+		split = match_split(&delimiters, buffer, length);
+		if (split != naive_split(&delimiters, buffer, length))
+		{
+			print_case("match_split", chars, buffer, length, search_string,
+					(long long)naive_split(&delimiters, buffer, length), (long long)split);
+			failures++;
+		}
+	}
+
+	printf("%s: %d cases, %d failed\n", classifier, num_run, failures);
+	return failures;
+}
+
+int main(int argc, char** argv)
+{
+	int num_cases = (argc > 1) ? atoi(argv[1]) : 100000;
+	int failures;
+
+	srand(1);
+	failures = run_cases("table", classify_table, num_cases);
+#ifdef MATCH_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		failures += run_cases("ssse3", classify_ssse3, num_cases);
+	if (__builtin_cpu_supports("avx2"))
+		failures += run_cases("avx2", classify_avx2, num_cases);
+#endif
+
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,90 @@
+/* Token bucket rate limiter used to throttle background scans.
+ *
+ * Author: William Anderson
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include "throttle.h"
+
+static double
+seconds_between (const struct timespec *from, const struct timespec *to)
+{
+	return (double)(to->tv_sec - from->tv_sec)
+			+ (double)(to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+void /* Set up a bucket with the given rate (per second) and burst size. */
+throttle_init (throttle_t *throttle, double rate, double burst)
+{
+	throttle->rate = rate;
+	throttle->burst = burst;
+	pthread_mutex_init(&throttle->mutex, NULL);
+	throttle_reset(throttle);
+}
+
+void /* Empty the bucket and restart the rate measurement. */
+throttle_reset (throttle_t *throttle)
+{
+	pthread_mutex_lock(&throttle->mutex);
+	throttle->tokens = 0; 	/* No initial burst, so short scans keep to the rate too */
+	throttle->total = 0;
+	clock_gettime(CLOCK_MONOTONIC, &throttle->last);
+	throttle->start = throttle->last;
+	pthread_mutex_unlock(&throttle->mutex);
+}
+
+bool
+throttle_enabled (const throttle_t *throttle)
+{
+	return throttle->rate > 0;
+}
+
+void /* Take "amount" tokens, sleeping as long as needed to stay within the rate. */
+throttle_acquire (throttle_t *throttle, double amount)
+{
+	struct timespec now, delay;
+	double wait;
+
+	if (!throttle_enabled(throttle) || amount <= 0)
+		return;
+
+	pthread_mutex_lock(&throttle->mutex);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	throttle->tokens += seconds_between(&throttle->last, &now) * throttle->rate;
+	if (throttle->tokens > throttle->burst)
+		throttle->tokens = throttle->burst;
+	throttle->last = now;
+
+	/* Reserve the tokens now; later callers queue up behind this debt */
+	throttle->tokens -= amount;
+	throttle->total += (uint64_t)amount;
+	wait = (throttle->tokens < 0) ? -throttle->tokens / throttle->rate : 0;
+
+	pthread_mutex_unlock(&throttle->mutex);
+
+	if (wait > 0)
+	{
+		delay.tv_sec = (time_t)wait;
+		delay.tv_nsec = (long)((wait - (double)delay.tv_sec) * 1e9);
+		while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+			;
+	}
+}
+
+double /* Tokens taken per second since the last reset. */
+throttle_observed_rate (throttle_t *throttle)
+{
+	struct timespec now;
+	double elapsed, rate;
+
+	pthread_mutex_lock(&throttle->mutex);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = seconds_between(&throttle->start, &now);
+	rate = (elapsed > 0) ? (double)throttle->total / elapsed : 0;
+	pthread_mutex_unlock(&throttle->mutex);
+
+	return rate;
+}
@@ -0,0 +1,32 @@
+#ifndef _THROTTLE_H
+#define _THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+/* Token bucket shared by the worker threads of one process. Tokens accrue at "rate" per second up to
+ * "burst". A caller that takes more tokens than are available goes into debt and
+ * sleeps until the debt is repaid, outside the lock; because every reservation is made
+ * under the lock, the long-run rate holds regardless of the number of threads.
+ * The bucket starts empty after a reset. A rate of 0 disables it.
+ */
+typedef struct throttle_tag{
+	double rate;			/* Tokens per second, 0 = unlimited */
+	double burst;			/* Maximum tokens that can accumulate */
+	double tokens;			/* May be negative while callers sleep off their debt */
+	struct timespec last;	/* Time of the last refill */
+	struct timespec start;	/* Time of the last throttle_reset() */
+	uint64_t total;			/* Tokens taken since the last reset */
+	pthread_mutex_t mutex;
+} throttle_t;
+
+/* Function definitions. */
+void throttle_init (throttle_t *, double, double);
+void throttle_reset (throttle_t *);
+void throttle_acquire (throttle_t *, double);
+bool throttle_enabled (const throttle_t *);
+double throttle_observed_rate (throttle_t *);
+
+#endif
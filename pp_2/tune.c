@@ -0,0 +1,232 @@
+/* Thread-count autotuning by hill-climbing on throughput, and CPU affinity.
+ *
+ * Author: William Anderson
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include "tune.h"
+
+/* Affinity: the CPUs the process may run on, and for each NUMA node the CPUs of that
+ * node among them. Set once by tune_init_affinity(), before any thread is pinned. */
+static tune_pin_t PIN = TUNE_PIN_NONE;
+static int NUM_CPUS = 0;
+static int CPUS[TUNE_MAX_CPUS];
+static int NUM_NODES = 0;
+static cpu_set_t NODE_CPUS[TUNE_MAX_NODES];
+static int PINNED = 0; 		/* Threads pinned since the last tune_reset_affinity_stats() */
+
+int /* Number of online CPUs, at least 1 */
+tune_online_cpus (void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n < 1) ? 1 : (int)n;
+}
+
+void /* Set up a tuner that runs at most max_threads workers */
+tune_init (tune_t *tune, int max_threads)
+{
+	if (max_threads > TUNE_MAX_THREADS)
+		max_threads = TUNE_MAX_THREADS;
+	if (max_threads < TUNE_START_THREADS)
+		max_threads = TUNE_START_THREADS;
+	tune->max_threads = max_threads;
+	tune_reset(tune, 0);
+}
+
+void /* Start a new climb at TUNE_START_THREADS; now_ns is the CLOCK_MONOTONIC time */
+tune_reset (tune_t *tune, long long now_ns)
+{
+	__atomic_store_n(&tune->target, TUNE_START_THREADS, __ATOMIC_RELAXED);
+	tune->settled = false;
+	tune->steps = 1;
+	tune->best_threads = TUNE_START_THREADS;
+	tune->best_rate = 0;
+	tune->last_bytes = 0;
+	tune->last_ns = now_ns;
+}
+
+int /* Feed in the bytes searched so far; returns the number of workers to run */
+tune_update (tune_t *tune, long long bytes, long long now_ns)
+{
+	int target = tune->target;
+	double rate;
+
+	if (tune->settled || now_ns - tune->last_ns < TUNE_INTERVAL_MS * 1000000LL)
+		return target;
+
+	rate = (bytes - tune->last_bytes) / ((now_ns - tune->last_ns) / 1e9);
+	tune->last_bytes = bytes;
+	tune->last_ns = now_ns;
+	if (rate <= 0)
+		return target; 	/* Starved by the walk: says nothing about the workers */
+
+	if (rate >= tune->best_rate * (1 + TUNE_MIN_GAIN))
+	{
+		tune->best_rate = rate;
+		tune->best_threads = target;
+		if (target < tune->max_threads)
+		{
+			target = (2 * target < tune->max_threads) ? 2 * target : tune->max_threads;
+			tune->steps++;
+		} else
+		{
+			tune->settled = true;
+		}
+	} else
+	{
+		/* Plateau: the last step did not pay off, so back off to the best count */
+		target = tune->best_threads;
+		tune->settled = true;
+	}
+
+	__atomic_store_n(&tune->target, target, __ATOMIC_RELAXED);
+	return target;
+}
+
+int /* Workers that should be running; workers with higher indexes retire */
+tune_target (tune_t *tune)
+{
+	return __atomic_load_n(&tune->target, __ATOMIC_RELAXED);
+}
+
+void
+tune_print_stats (tune_t *tune)
+{
+	printf("\n Threads: auto-tuned to %d workers (%.2f MiB/s at %d; %d counts tried, limit %d)%s.",
+			tune->target, tune->best_rate / (1024.0 * 1024.0), tune->best_threads,
+			tune->steps, tune->max_threads, tune->settled ? "" : ", still climbing at the end");
+}
+
+static int /* Parse a cpulist ("0-3,8,10-11") into set; returns the number of CPUs */
+parse_cpulist (const char *list, cpu_set_t *set)
+{
+	const char *p = list;
+	char *end;
+	long first, last, cpu;
+	int n = 0;
+
+	CPU_ZERO(set);
+	while (*p != '\0' && *p != '\n')
+	{
+		first = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		last = first;
+		p = end;
+		if (*p == '-')
+		{
+			last = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+		{
+			CPU_SET(cpu, set);
+			n++;
+		}
+		if (*p == ',')
+			p++;
+	}
+	return n;
+}
+
+int /* Read the CPU topology for pin; returns -1 if it cannot be determined */
+tune_init_affinity (tune_pin_t pin)
+{
+	cpu_set_t allowed, node;
+	char path[64], list[4096];
+	FILE *file;
+	int cpu, i;
+
+	PIN = pin;
+	if (pin == TUNE_PIN_NONE)
+		return 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+	{
+		perror("sched_getaffinity");
+		PIN = TUNE_PIN_NONE;
+		return -1;
+	}
+	NUM_CPUS = 0;
+	for (cpu = 0; cpu < CPU_SETSIZE && NUM_CPUS < TUNE_MAX_CPUS; cpu++)
+	{
+		if (CPU_ISSET(cpu, &allowed))
+			CPUS[NUM_CPUS++] = cpu;
+	}
+
+	/* Nodes without allowed CPUs (memory-only nodes, or excluded by a cpuset) are left out */
+	NUM_NODES = 0;
+	for (i = 0; i < TUNE_MAX_NODES; i++)
+	{
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", i);
+		file = fopen(path, "r");
+		if (file == NULL)
+			break;
+		if (fgets(list, sizeof(list), file) != NULL && parse_cpulist(list, &node) > 0)
+		{
+			CPU_AND(&node, &node, &allowed);
+			if (CPU_COUNT(&node) > 0)
+				NODE_CPUS[NUM_NODES++] = node;
+		}
+		fclose(file);
+	}
+	if (NUM_NODES == 0)
+	{
+		NODE_CPUS[0] = allowed;
+		NUM_NODES = 1;
+	}
+
+	return 0;
+}
+
+void /* Pin the thread with the given index as set up by tune_init_affinity() */
+tune_pin_thread (pthread_t thread, int index)
+{
+	cpu_set_t set;
+	int error;
+
+	if (PIN == TUNE_PIN_NONE || NUM_CPUS == 0)
+		return;
+
+	if (PIN == TUNE_PIN_CORES)
+	{
+		CPU_ZERO(&set);
+		CPU_SET(CPUS[index % NUM_CPUS], &set);
+	} else
+	{
+		set = NODE_CPUS[index % NUM_NODES];
+	}
+
+	/* Not fatal: the thread just runs wherever the scheduler puts it */
+	error = pthread_setaffinity_np(thread, sizeof(set), &set);
+	if (error != 0)
+		fprintf(stderr, "pthread_setaffinity_np: %s\n", strerror(error));
+	else
+		__atomic_add_fetch(&PINNED, 1, __ATOMIC_RELAXED);
+}
+
+void
+tune_reset_affinity_stats (void)
+{
+	__atomic_store_n(&PINNED, 0, __ATOMIC_RELAXED);
+}
+
+void
+tune_print_affinity (void)
+{
+	if (PINNED == 0)
+		return;
+
+	if (PIN == TUNE_PIN_CORES)
+		printf("\n Affinity: %d threads pinned round-robin to %d CPUs.", PINNED, NUM_CPUS);
+	else
+		printf("\n Affinity: %d threads pinned round-robin to %d NUMA nodes.", PINNED,
+				NUM_NODES);
+}
@@ -0,0 +1,58 @@
+#ifndef _TUNE_H
+#define _TUNE_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Thread-count autotuning and CPU affinity.
+ *
+ * The tuner hill-climbs on throughput. A search starts with TUNE_START_THREADS
+ * workers; every TUNE_INTERVAL_MS the caller passes in the bytes searched so far and
+ * gets back the number of workers it should run. While doubling the workers raises
+ * the rate by at least TUNE_MIN_GAIN, the count keeps doubling, up to the maximum.
+ * The first step that does not pay off ends the climb: the count goes back to the
+ * best one seen and stays there for the rest of the search. Intervals in which
+ * nothing was searched (the workers were waiting for the walk) decide nothing.
+ *
+ * Affinity pins thread i to the i-th CPU the process may run on (TUNE_PIN_CORES), or
+ * to all the CPUs of NUMA node i mod the number of nodes (TUNE_PIN_NODES), read from
+ * /sys/devices/system/node. Without NUMA information all CPUs form one node.
+ */
+
+#define TUNE_START_THREADS 1
+#define TUNE_INTERVAL_MS 100
+#define TUNE_MIN_GAIN 0.10		/* Relative rate increase that justifies more workers */
+#define TUNE_MAX_THREADS 256
+#define TUNE_MAX_CPUS 1024
+#define TUNE_MAX_NODES 64
+
+typedef enum tune_pin_tag{
+	TUNE_PIN_NONE,
+	TUNE_PIN_CORES,
+	TUNE_PIN_NODES
+} tune_pin_t;
+
+typedef struct tune_tag{
+	int max_threads;
+	int target;				/* Workers to run now; read by the workers (atomic) */
+	bool settled;			/* The climb has ended */
+	int steps;				/* Counts tried */
+	int best_threads;
+	double best_rate;		/* Bytes per second */
+	long long last_bytes;
+	long long last_ns;
+} tune_t;
+
+/* Function definitions. */
+int tune_online_cpus (void);
+void tune_init (tune_t *, int);
+void tune_reset (tune_t *, long long);
+int tune_update (tune_t *, long long, long long);
+int tune_target (tune_t *);
+void tune_print_stats (tune_t *);
+int tune_init_affinity (tune_pin_t);
+void tune_pin_thread (pthread_t, int);
+void tune_reset_affinity_stats (void);
+void tune_print_affinity (void);
+
+#endif